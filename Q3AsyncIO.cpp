@@ -0,0 +1,347 @@
+#include <chrono>
+#include <fstream>
+#include <Misc/Q3ThreadPool.h>
+#include <Misc/Q3AsyncIO.h>
+
+//opt-in, the build that defines Q3_USE_IO_URING links liburing as well
+#if defined(Q3_USE_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define Q3_HAVE_IO_URING 1
+#endif
+#endif
+
+#if defined(Q3_HAVE_IO_URING)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <liburing.h>
+#endif
+
+namespace Misc
+{
+#if defined(Q3_HAVE_IO_URING)
+	struct Q3AsyncReader::Ring
+	{
+		struct io_uring m_ring;
+	};
+
+	namespace
+	{
+		enum eOpStage : std::uint64_t
+		{
+			STAGE_OPEN = 0,
+			STAGE_READ = 1
+		};
+		//the stage is kept in the low bit of the user data, ops are at least 2 byte aligned
+		void* PackUserData(void* op, eOpStage stage)
+		{
+			return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(op) | stage);
+		}
+	}
+#else
+	struct Q3AsyncReader::Ring
+	{
+	};
+#endif
+
+	Q3AsyncReader::Q3AsyncReader(int queueDepth)
+		: m_ring(nullptr)
+		, m_queueDepth(queueDepth)
+		, m_quit(false)
+		, m_nextTicket(0)
+	{
+		if (initRing(queueDepth))
+			m_ringThread = std::thread(&Q3AsyncReader::ringThreadMain, this);
+	}
+
+	Q3AsyncReader::~Q3AsyncReader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wakeRing.notify_all();
+		if (m_ringThread.joinable())
+			m_ringThread.join();
+#if defined(Q3_HAVE_IO_URING)
+		if (m_ring)
+			io_uring_queue_exit(&m_ring->m_ring);
+#endif
+		delete m_ring;
+	}
+
+	Q3AsyncReader& Q3AsyncReader::Global()
+	{
+		static Q3AsyncReader reader;
+		return reader;
+	}
+
+	Q3AsyncReader::Ticket Q3AsyncReader::submit(const String& path, Completion onDone)
+	{
+		auto op = std::make_unique<ReadOp>();
+		op->m_ticket		 = m_nextTicket++;
+		op->m_onDone		 = std::move(onDone);
+		op->m_result.m_path	 = path;
+		auto ticket = op->m_ticket;
+
+		if (m_ring)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_pending.push_back(std::move(op));
+			}
+			m_wakeRing.notify_one();
+		}
+		else
+		{
+			//std::function needs a copyable callable
+			auto shared = std::shared_ptr<ReadOp>(op.release());
+			Q3ThreadPool::Global().enqueue([this, shared]()
+			{
+				if (!ReadFileBlocking(shared->m_result))
+					readFallback(shared->m_result);
+				complete(ReadOpPtr(new ReadOp(std::move(*shared))));
+			});
+		}
+		return ticket;
+	}
+
+	std::vector<Q3AsyncReader::Ticket> Q3AsyncReader::submitBatch(const std::vector<String>& paths)
+	{
+		std::vector<Ticket> tickets;
+		tickets.reserve(paths.size());
+		for (const auto& path : paths)
+			tickets.push_back(submit(path));
+		return tickets;
+	}
+
+	void Q3AsyncReader::setFallbackReader(FileReader reader)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_fallback = std::move(reader);
+	}
+
+	Q3ReadResult Q3AsyncReader::wait(Ticket ticket)
+	{
+		auto isDone = [this, ticket]() { return m_done.count(ticket) != 0; };
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!isDone())
+		{
+			lock.unlock();
+			if (!Q3ThreadPool::Global().runPendingTask())
+			{
+				lock.lock();
+				m_readDone.wait_for(lock, std::chrono::milliseconds(1), isDone);
+				continue;
+			}
+			lock.lock();
+		}
+		auto it = m_done.find(ticket);
+		Q3ReadResult result = std::move(it->second);
+		m_done.erase(it);
+		return result;
+	}
+
+	void Q3AsyncReader::complete(ReadOpPtr op)
+	{
+		if (op->m_onDone)
+		{
+			op->m_onDone(op->m_result);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_done[op->m_ticket] = std::move(op->m_result);
+		}
+		m_readDone.notify_all();
+	}
+
+	bool Q3AsyncReader::ReadFileBlocking(Q3ReadResult& result)
+	{
+		std::ifstream file(result.m_path.c_str(), std::ios::binary | std::ios::ate);
+		result.m_succes = false;
+		if (!file)
+			return false;
+		auto size = static_cast<std::size_t>(file.tellg());
+		file.seekg(0, std::ios::beg);
+		result.m_data.resize(size);
+		if (size && !file.read(reinterpret_cast<char*>(result.m_data.data()), size))
+		{
+			result.m_data.clear();
+			return false;
+		}
+		result.m_succes = true;
+		return true;
+	}
+
+	bool Q3AsyncReader::readFallback(Q3ReadResult& result)
+	{
+		FileReader reader;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			reader = m_fallback;
+		}
+		result.m_succes = reader && reader(result.m_path, result.m_data);
+		if (!result.m_succes)
+			result.m_data.clear();
+		return result.m_succes;
+	}
+
+#if defined(Q3_HAVE_IO_URING)
+	bool Q3AsyncReader::initRing(int queueDepth)
+	{
+		auto ring = new Ring();
+		if (io_uring_queue_init(static_cast<unsigned>(queueDepth), &ring->m_ring, 0) < 0)
+		{
+			delete ring;	//no io_uring in this kernel/sandbox, use the thread pool
+			return false;
+		}
+		m_ring = ring;
+		return true;
+	}
+
+	void Q3AsyncReader::ringThreadMain()
+	{
+		auto ring = &m_ring->m_ring;
+		int inFlight = 0;
+
+		auto submitRead = [ring](ReadOp* op) -> bool
+		{
+			auto sqe = io_uring_get_sqe(ring);
+			if (!sqe)
+				return false;
+			auto remaining = op->m_result.m_data.size() - op->m_offset;
+			io_uring_prep_read(sqe, op->m_fd, op->m_result.m_data.data() + op->m_offset,
+				static_cast<unsigned>(remaining), op->m_offset);
+			io_uring_sqe_set_data(sqe, PackUserData(op, STAGE_READ));
+			return true;
+		};
+		auto finish = [this, &inFlight](ReadOp* op, bool succes)
+		{
+			if (op->m_fd >= 0)
+				close(op->m_fd);
+			op->m_fd = -1;
+			if (!succes)
+				op->m_result.m_data.clear();
+			op->m_result.m_succes = succes;
+			inFlight--;
+			complete(ReadOpPtr(op));
+		};
+		//not a loose file, the fallback reader may block so it runs on the pool
+		auto fallback = [this, &inFlight](ReadOp* op)
+		{
+			inFlight--;
+			auto shared = std::shared_ptr<ReadOp>(op);
+			Q3ThreadPool::Global().enqueue([this, shared]()
+			{
+				readFallback(shared->m_result);
+				complete(ReadOpPtr(new ReadOp(std::move(*shared))));
+			});
+		};
+		//open done( or done synchronously ), size the buffer & queue the read
+		auto startRead = [&](ReadOp* op, int fd)
+		{
+			op->m_fd = fd;
+			struct stat st;
+			if (fd < 0)
+			{
+				fallback(op);
+				return;
+			}
+			if (fstat(fd, &st) != 0)
+			{
+				finish(op, false);
+				return;
+			}
+			op->m_result.m_data.resize(static_cast<std::size_t>(st.st_size));
+			if (st.st_size == 0)
+				finish(op, true);
+			else if (!submitRead(op))
+				finish(op, ReadFileBlocking(op->m_result));
+		};
+
+		for (;;)
+		{
+			std::vector<ReadOpPtr> batch;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (inFlight == 0)
+					m_wakeRing.wait(lock, [this]() { return m_quit || !m_pending.empty(); });
+				if (m_quit && inFlight == 0)
+					break;
+				while (!m_pending.empty() && inFlight + static_cast<int>(batch.size()) < m_queueDepth)
+				{
+					batch.push_back(std::move(m_pending.front()));
+					m_pending.pop_front();
+				}
+			}
+
+			//queue the whole batch of opens with a single submit
+			for (auto& op : batch)
+			{
+				auto sqe = io_uring_get_sqe(ring);
+				inFlight++;
+				if (!sqe)
+				{
+					auto raw = op.release();
+					startRead(raw, open(raw->m_result.m_path.c_str(), O_RDONLY | O_CLOEXEC));
+					continue;
+				}
+				io_uring_prep_openat(sqe, AT_FDCWD, op->m_result.m_path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+				io_uring_sqe_set_data(sqe, PackUserData(op.release(), STAGE_OPEN));
+			}
+			io_uring_submit(ring);
+			if (inFlight == 0)
+				continue;
+
+			//short wait so new submissions aren't held up behind slow reads
+			struct __kernel_timespec timeout = { 0, 1000000 };
+			struct io_uring_cqe* cqe = nullptr;
+			if (io_uring_wait_cqe_timeout(ring, &cqe, &timeout) < 0)
+				continue;
+
+			unsigned head, numSeen = 0;
+			io_uring_for_each_cqe(ring, head, cqe)
+			{
+				numSeen++;
+				auto data  = reinterpret_cast<std::uintptr_t>(io_uring_cqe_get_data(cqe));
+				auto op	   = reinterpret_cast<ReadOp*>(data & ~std::uintptr_t(1));
+				auto stage = static_cast<eOpStage>(data & 1);
+				auto res   = cqe->res;
+
+				if (stage == STAGE_OPEN)
+				{
+					//kernels before 5.6 have no async openat
+					if (res == -EINVAL || res == -EOPNOTSUPP)
+						res = open(op->m_result.m_path.c_str(), O_RDONLY | O_CLOEXEC);
+					startRead(op, res);
+				}
+				else if (res <= 0)
+				{
+					finish(op, res == 0 && op->m_offset == op->m_result.m_data.size());
+				}
+				else
+				{
+					op->m_offset += static_cast<std::size_t>(res);
+					if (op->m_offset == op->m_result.m_data.size())
+						finish(op, true);
+					else if (!submitRead(op))
+						finish(op, ReadFileBlocking(op->m_result));
+				}
+			}
+			io_uring_cq_advance(ring, numSeen);
+			io_uring_submit(ring);
+		}
+	}
+#else
+	bool Q3AsyncReader::initRing(int)
+	{
+		return false;
+	}
+
+	void Q3AsyncReader::ringThreadMain()
+	{
+	}
+#endif
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+#include <App/AppTypeDefs.h>
+
+namespace Misc
+{
+	/*
+		@brief: Contents of a file read by Q3AsyncReader
+	*/
+	struct Q3ReadResult
+	{
+		String						m_path;
+		std::vector<std::uint8_t>	m_data;
+		bool						m_succes = false;
+	};
+
+	/*
+		@brief: Asynchronous whole-file reader. On Linux batches of opens & reads are submitted
+		through io_uring from a single I/O thread, elsewhere( or when io_uring isn't available )
+		files are read on the global thread pool. io_uring is opt-in, the build has to define
+		Q3_USE_IO_URING & link liburing( -luring ). Files that can't be opened directly( packaged
+		files ) are read by the fallback reader on the thread pool
+	*/
+	class Q3AsyncReader
+	{
+	public:
+		using Ticket	 = int;
+		using Completion = std::function<void(Q3ReadResult&)>;
+		using FileReader = std::function<bool(const String& path, std::vector<std::uint8_t>& data)>;
+
+		const static Ticket INVALID_TICKET = -1;
+
+		explicit Q3AsyncReader( int queueDepth = 64 );
+		~Q3AsyncReader();
+
+		Q3AsyncReader( const Q3AsyncReader& ) = delete;
+		Q3AsyncReader& operator = ( const Q3AsyncReader& ) = delete;
+
+		/*
+			@brief: Process wide reader
+		*/
+		static Q3AsyncReader&		Global();
+
+		/*
+			@brief: Queue a read, without a completion the result is kept until wait(ticket)
+			is called. A completion runs on an I/O or pool thread and should only hand the data
+			on, it's never called from within submit
+		*/
+		Ticket						submit( const String& path, Completion onDone = nullptr );
+
+		std::vector<Ticket>			submitBatch( const std::vector<String>& paths );
+
+		/*
+			@brief: Block until the read for 'ticket' is done & return its result, runs pool tasks
+			while it waits so a pool thread waiting on a pool read can't stall the pool
+		*/
+		Q3ReadResult				wait( Ticket ticket );
+
+		bool						usesIoUring() const { return m_ring != nullptr; }
+
+		/*
+			@brief: Reader for paths that aren't loose files, e.g. the engine file stream
+		*/
+		void						setFallbackReader( FileReader reader );
+
+	private:
+		struct ReadOp
+		{
+			Ticket					m_ticket;
+			Completion				m_onDone;
+			Q3ReadResult			m_result;
+			int						m_fd = -1;
+			std::size_t				m_offset = 0;
+		};
+		using ReadOpPtr = std::unique_ptr<ReadOp>;
+
+		void						complete( ReadOpPtr op );
+		static bool					ReadFileBlocking( Q3ReadResult& result );
+		bool						readFallback( Q3ReadResult& result );
+
+		//io_uring backend
+		bool						initRing( int queueDepth );
+		void						ringThreadMain();
+
+		struct Ring;
+		Ring*						m_ring;
+		std::thread					m_ringThread;
+		std::deque<ReadOpPtr>		m_pending;		//waiting for a submission slot
+		int							m_queueDepth;
+		bool						m_quit;
+
+		std::mutex					m_mutex;
+		std::condition_variable		m_wakeRing;
+		std::condition_variable		m_readDone;
+		std::map<Ticket, Q3ReadResult> m_done;
+		std::atomic<Ticket>			m_nextTicket;
+		FileReader					m_fallback;
+	};
+}
@@ -10,6 +10,8 @@
 #include <ConsoleIncludes.h>
 #include <App/AppCommon.h>
 #include <Misc/Q3BuildGLSL.h>
+#include <Misc/Q3TextureStream.h>
+#include <Misc/Q3LoadProfiler.h>
 #include <Misc/Q3BSPShader.h>
 
 namespace Misc
@@ -244,7 +246,7 @@ namespace Misc
 
 		auto idx = TexturePathValid(texturePath);
 		if (idx == INVALID_INDEX) {
-			App::AddConsoleMessage(context, "File path not found: " + texturePath, App::LOG_LEVEL_WARNING);
+			Q3PostConsoleMessage(context, "File path not found: " + texturePath, true);
 			return nullptr;
 		}
 
@@ -541,7 +543,7 @@ namespace Misc
 			case eQ3VertexDeformFunc::VD_WAVE:
 			{
 				const auto& wave = vDef.m_waveForm;
-				vertFunction += doubleTab + "float deformTmp = ( vertIn.x + vertIn.y + vertIn.z  ) * " + to_string(vDef.m_dvDiv) + ";\n";
+				vertFunction += doubleTab + "float deformTmp = ( vertPos.x + vertPos.y + vertPos.z  ) * " + to_string(vDef.m_dvDiv) + ";\n";
 				vertFunction += doubleTab + "float base   = " + to_string(wave.m_base) + ";\n";
 				vertFunction += doubleTab + "float phase  = " + to_string(wave.m_phase) + " + deformTmp;\n";
 				vertFunction += doubleTab + "float amp    = " + to_string(wave.m_amp) + ";\n";
@@ -556,7 +558,7 @@ namespace Misc
 				float bulgeWidth  = vDef.m_dvBulge[0];
 				float bulgeHeight = vDef.m_dvBulge[1];
 				float bulgeSpeed  = vDef.m_dvBulge[2];
-				vertFunction += doubleTab + "vec2 stCoord = stIn;\n";
+				vertFunction += doubleTab + "vec2 stCoord = stOffset + stIn;\n";
 				vertFunction += doubleTab + "float width = stCoord[0] * " + to_string(bulgeWidth) + ";\n";
 				vertFunction += doubleTab + "float speed =  m_programTime * " + to_string(bulgeSpeed) + ";\n";
 				vertFunction += doubleTab + "float offset = sin( speed + width ) * " + to_string(bulgeHeight) + ";\n";
@@ -623,7 +625,8 @@ namespace Misc
 		{ //Build vertex shader
 			
 			String vertFunction = vec4 + "getWorld( vec3 normal )" + openBrack + endLn ; //vec4 getWorld() { 
-			vertFunction += tab + "vec3 worldCalc = vertIn;\n";
+			vertFunction += tab + "vec3 vertPos = posOffset + vertIn * posScale;\n";
+			vertFunction += tab + "vec3 worldCalc = vertPos;\n";
 			vertFunction += AddVertexDeform(shader );
 
 			vertFunction += tab + "return vec4(worldCalc, 1.0);\n";
@@ -1028,19 +1031,34 @@ namespace Misc
 		if (!shaderFile.open(QFile::ReadOnly))
 			return false;
 
-		App::AddConsoleMessage(m_context, String("Begin parsing of: ") + m_fileName);
+		auto fileData = shaderFile.readAll();
+		return parseShaderData(fileData.constData(), static_cast<std::size_t>(fileData.size()));
+	}
+
+	bool Q3ParseShader::parseShaderData(const char* data, std::size_t size)
+	{
+		Q3PostConsoleMessage(m_context, String("Begin parsing of: ") + m_fileName);
 
 		//TODO use a lexical analyzer in the future
-		QTextStream in(&shaderFile);
-		QString result;
-		while (!in.atEnd())
+		//normalize line endings, parser only knows about '\n'
+		m_fileData.clear();
+		m_fileData.reserve(size + 1);
+		for (std::size_t i = 0; i < size; ++i)
 		{
-			QString line = in.readLine();
-			result += line + "\n";
+			if (data[i] == '\r')
+			{
+				if (i + 1 == size || data[i + 1] != '\n')
+					m_fileData.push_back('\n');
+				continue;
+			}
+			if (data[i] == '\0')
+				break;
+			m_fileData.push_back(data[i]);
 		}
-
-		auto data = result.toStdString();
-		m_dataPtr = data.data();
+		if (m_fileData.empty() || m_fileData.back() != '\n')
+			m_fileData.push_back('\n');
+		m_dataPtr	= m_fileData.data();
+		m_lineNumber = 1;
 		enum eShaderState
 		{
 			STATE_SHADER_GLOBAL = 0,
@@ -1130,7 +1148,7 @@ namespace Misc
 			}
 		} while (*m_dataPtr != '\0');
 
-		App::AddConsoleMessage(m_context, String("Parsed  ") + std::to_string(m_shaders.size())
+		Q3PostConsoleMessage(m_context, String("Parsed  ") + std::to_string(m_shaders.size())
 			+ String(" from: ") + m_fileName);
 
 		return true;
@@ -1725,7 +1743,7 @@ namespace Misc
 		msg += "][";
 		msg += std::to_string(m_lineNumber);
 		msg += "]";
-		AddConsoleMessage(m_context, msg, App::LOG_LEVEL_WARNING);
+		Q3PostConsoleMessage(m_context, msg, true);
 	}
 
 	Q3Shader::Q3Shader(App::EngineContext* context, const String& fileName, const String& shadName)
@@ -1759,6 +1777,11 @@ namespace Misc
 		for (auto& tex : stage.m_textureList)
 			resMan->removeResource(tex->getResourceHandle());
 
+		//back to the parsed state, cached shaders are loaded again by the next map that uses them
+		for (auto& stage : m_shaderStages)
+			stage.m_textureList.clear();
+		m_gpuShader = nullptr;
+		m_loaded	= false;
 		return true;
 	}
 
@@ -1858,6 +1881,9 @@ namespace Misc
 		m_asMajorDir.registerUniform("asMajorDir",		shader);		
 		m_asWidth.registerUniform("asWidth",			shader);
 		m_asHeight.registerUniform("asHeight",			shader);
+		m_posOffset.registerUniform("posOffset",		shader);
+		m_posScale.registerUniform("posScale",			shader);
+		m_stOffset.registerUniform("stOffset",			shader);
 
 		//register texture stages
 		for (int i = 0; i < m_shaderStages.size(); ++i)
@@ -1876,6 +1902,31 @@ namespace Misc
 		return CreateRegularShaderImp(context, name);
 	}
 
+	String Q3Shader::ResolveTexturePath(const String& name)
+	{
+		auto idx = TexturePathValid(name);
+		return idx == INVALID_INDEX ? String() : Q3BasePath() + name + ImageExtensions[idx];
+	}
+
+	StringList Q3Shader::getTexturePaths() const
+	{
+		StringList result;
+		for (const auto& stage : m_shaderStages)
+		{
+			if (stage.m_lightmap)
+				continue;
+			for (const auto& str : stage.m_textures)
+			{
+				if (Common::StringEquals(str, "$whiteimage", true))
+					continue;
+				auto path = ResolveTexturePath(str);
+				if (!path.empty())
+					result.push_back(path);
+			}
+		}
+		return result;
+	}
+
 	Misc::Q3ShaderPtr Q3Shader::CreateFallBackShader(App::EngineContext* context)
 	{
 		Q3ShaderPtr result = std::make_shared<Q3Shader>(context);
@@ -1902,9 +1953,18 @@ namespace Misc
 		//autosprite 2
 		m_asHeight.setData(dI.m_asHeight);
 		m_asMajorDir.setData(dI.m_asMajorDir);
+		//compact vertices
+		m_posOffset.setData(dI.m_decode.m_posOffset);
+		m_posScale.setData(dI.m_decode.m_posScale);
+		m_stOffset.setData(dI.m_decode.m_stOffset);
 	}
 
 	bool Q3Shader::bind()
+	{
+		return bind(nullptr);
+	}
+
+	bool Q3Shader::bind(const TexturePtr& lightmap)
 	{
 		Common::ExpectFalse(m_objBound);
 
@@ -1929,7 +1989,16 @@ namespace Misc
 		//set all stages
 		for (int i =0; i < m_shaderStages.size(); ++i) 
 		{
-			m_gpuShader->bind(SamplerNames[i].c_str(), m_shaderStages[i].getStageTexture()->getRawPointer());
+			const auto& stage = m_shaderStages[i];
+			if (stage.m_lightmap)
+			{
+				TexturePtr texture = lightmap;
+				if (!texture)
+					texture = m_context->getSystem<App::ResourceManager>()->getResourceSafe<App::Texture>("DefaultWhiteTexture");
+				m_gpuShader->bind(SamplerNames[i].c_str(), texture->getRawPointer());
+				continue;
+			}
+			m_gpuShader->bind(SamplerNames[i].c_str(), stage.getStageTexture()->getRawPointer());
 			//stage.m_uniform.setData( stage.getStageTexture() );		
 		}
 		m_objBound = succes;
@@ -1949,14 +2018,22 @@ namespace Misc
 	}
 
 	void Q3Shader::beginLoad()
+	{
+		loadTextures(nullptr);
+	}
+
+	void Q3Shader::loadTextures(Q3TextureStreamer* streamer)
 	{
 		if (m_loaded)
 			return;
 		m_loaded = true;
+		//a shader that failed before starts over
+		for (auto& stage : m_shaderStages)
+			stage.m_textureList.clear();
 		//load all the textures
 		std::uint32_t flag = isSolid() ? 0 : FLAGS_ADD_ALPHA;
 		for (auto& stage : m_shaderStages) {		
-			m_loaded &= stage.loadTexture(0);
+			m_loaded &= stage.loadTexture(0, streamer, this);
 		}
 
 		m_status = m_loaded ? App::RESOURCE_LOADED : App::RESOURCE_FAILURE;
@@ -2038,7 +2115,7 @@ namespace Misc
 	}
 
 
-	bool Q3ShaderStage::loadTexture(const std::uint32_t flags )
+	bool Q3ShaderStage::loadTexture(const std::uint32_t flags, Q3TextureStreamer* streamer, const Q3Shader* owner )
 	{
 		auto resMan = m_context->getSystem<App::ResourceManager>();
 		for (const auto& str : m_textures)
@@ -2059,28 +2136,41 @@ namespace Misc
 				{
 					resource = std::make_shared<App::Texture>(m_context);
 					//flip tga images
-					if (Common::EndsWith(ImageExtensions[idx], "tga"))
-						resource->m_flipMode = Common::FLIPMASK_VERTICAL;
+					bool flipImage = Common::EndsWith(ImageExtensions[idx], "tga");
 					if (m_clamp)
 					{
 						resource->m_params.m_clampMode_S = GL_CLAMP_TO_EDGE;
 						resource->m_params.m_clampMode_T = GL_CLAMP_TO_EDGE;
 					}
-					if (FLAGS_ADD_ALPHA & flags)
-					{
-						resource->m_params.m_addAlphaChannel = true;
-						resource->m_params.m_alphaValue      = 0;
-					}
+					bool addAlpha = (FLAGS_ADD_ALPHA & flags) != 0;
 
 					resource->m_fromInternal = true;
 					resource->setResourcePath(BASE_PATH + str + ImageExtensions[idx]); //add base path
 					resource->setResourceName(str.c_str());
-					resource->beginLoad();
-					if (resource->getStatus() == App::RESOURCE_LOADED) 
+					if (streamer) //placeholder now, image data later
+						resOk = streamer->request(resource, Q3BasePath() + str + ImageExtensions[idx], owner, flipImage, addAlpha);
+					else //decoded like streamed textures, flip, alpha & mips by the image kernels
 					{
-						resMan->addResource(resource, false);
-						resOk = true;
+						auto path = Q3BasePath() + str + ImageExtensions[idx];
+						std::vector<std::uint8_t> fileData;
+						Common::Image image;
+						{
+							Q3_PROFILE_SCOPE( "read texture", path );
+							resOk = Q3ReadFile(m_context, path, fileData);
+						}
+						if (resOk)
+						{
+							Q3_PROFILE_SCOPE( "decode texture", path );
+							resOk = DecodeQ3Texture(fileData.data(), fileData.size(), flipImage, addAlpha, image);
+						}
+						if (resOk)
+						{
+							Q3_PROFILE_SCOPE( "upload texture", path );
+							resOk = resource->setFromImage(image);
+						}
 					}
+					if (resOk) 
+						resMan->addResource(resource, false);
 				}
 				if (!resOk) //use fallback resource
 				{
@@ -2088,6 +2178,8 @@ namespace Misc
 					resource = resMan->getResourceSafe<App::Texture>("DefaultAlbedo");
 				}
 			}
+			else if (streamer)
+				streamer->addOwner(resource, owner);
 			if (resource) {
 				m_hasAlphaMap = resource->m_texture->getImageFormat().m_numChannels == 4;
 				m_textureList.push_back(resource);
@@ -2160,6 +2252,10 @@ namespace Misc
 		, m_leafId(INVALID_INDEX)
 		, m_vertexStart(0)
 		, m_vertexCount(0)
+		, m_indexStart(0)
+		, m_indexCount(0)
+		, m_firstMeshlet(0)
+		, m_numMeshlets(0)
 	{
 
 	}
@@ -2170,6 +2266,10 @@ namespace Misc
 		, m_leafId(leaf)
 		, m_vertexStart(start)
 		, m_vertexCount(count)
+		, m_indexStart(0)
+		, m_indexCount(0)
+		, m_firstMeshlet(0)
+		, m_numMeshlets(0)
 		, m_bounds(bounds)
 
 
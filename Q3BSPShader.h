@@ -2,11 +2,13 @@
 #include <Resource/IResource.hpp>
 #include <Graphics/RenderUniforms.h>
 #include <Misc/Q3BspTypes.h>
+#include <Misc/Q3VertexFormat.h>
 #include <App/AppTypeDefs.h>
 
 namespace Misc
 {
 	class Q3Shader;
+	class Q3TextureStreamer;
 	using Q3ShaderPtr = std::shared_ptr<Q3Shader>;
 	
 	//////////////////////////////////////////////////////////////////////////
@@ -127,6 +129,10 @@ namespace Misc
 		int				m_leafId;
 		int				m_vertexStart;
 		int				m_vertexCount;
+		int				m_indexStart;	//range in the leaf index buffer
+		int				m_indexCount;
+		int				m_firstMeshlet;	//range in the leaf meshlets, none for autosprites & vertex deforms
+		int				m_numMeshlets;
 
 		Math::BBox3f	 m_bounds;
 		//auto sprite stuff
@@ -135,6 +141,7 @@ namespace Misc
 		float			 m_asHeight;	   //autosprite2		
 		Math::Vector3f	 m_asMajorDir;	   //autosprite2 direction
 		Math::Vector3f	 m_asVertexPos[2]; //autosprite2
+		Q3VertexDecode	 m_decode;		   //compact vertices( r_compactVertices ), identity otherwise
 	};
 
 
@@ -146,10 +153,12 @@ namespace Misc
 
 		void			reset();
 		/*
-			@brief: Load texture for this stage, 
+			@brief: Load texture for this stage, when a streamer is passed new textures 
+			start out as placeholders and are decoded in the background
 			TODO stage shouldn't be aware of engine context
 		*/
-		bool							loadTexture( const std::uint32_t flags = 0 );
+		bool							loadTexture( const std::uint32_t flags = 0, Q3TextureStreamer* streamer = nullptr,
+													 const Q3Shader* owner = nullptr );
 
 		const TexturePtr&				getStageTexture() const;
 
@@ -256,12 +265,33 @@ namespace Misc
 		static Q3ShaderPtr			CreateRegularShader( App::EngineContext* context, const String& name );
 		static Q3ShaderPtr			CreateFallBackShader( App::EngineContext* context );
 
+		/*
+			@brief: Full path of the image for texture 'name', empty if there is no such file
+		*/
+		static String				ResolveTexturePath( const String& name );
+
+		/*
+			@brief: Image files used by the stages of this shader, lightmap & builtin textures excluded
+		*/
+		StringList					getTexturePaths() const;
+
 		void						setDrawInfo		( const Q3DrawInfo& dI );
 
 		bool						bind()			override;
+
+		/*
+			@brief: Bind with 'lightmap' for all lightmap stages, white without one. The lightmap belongs to
+			the map being drawn, it's never stored in the shader as shaders are shared between maps
+		*/
+		bool						bind			( const TexturePtr& lightmap );
 		bool						unBind()		override;
 
 		virtual void                beginLoad()		override;
+
+		/*
+			@brief: Same as beginLoad, textures are streamed if 'streamer' is set
+		*/
+		void						loadTextures	( Q3TextureStreamer* streamer );
 		virtual void                reload()		override {};                               
 		virtual void                endLoad()		override {};                       
 		virtual void                release()		override {};
@@ -300,6 +330,11 @@ namespace Misc
 		HwUniform<float>			m_asWidth;
 		HwUniform<float>			m_asHeight;		
 		HwUniform<Math::Vector3f>	m_asMajorDir;	
+
+		//compact vertex decode
+		HwUniform<Math::Vector3f>	m_posOffset;
+		HwUniform<float>			m_posScale;
+		HwUniform<Math::Vector2f>	m_stOffset;
 	};
 
 
@@ -307,10 +342,16 @@ namespace Misc
 	{
 	public:
 		friend class Q3BspFile;
+		friend class Q3ShaderRegistry;
 		explicit Q3ParseShader(App::EngineContext* context, const String& fileName);
 
 
 		bool					parseShaderFile();
+
+		/*
+		* @brief: Parse shader script contents that were read elsewhere, ie by Q3AsyncReader
+		*/
+		bool					parseShaderData(const char* data, std::size_t size);
 		bool					parseShaderStage(Q3ShaderStage& curStage, Q3ShaderPtr shader);
 		bool					parseShaderLocal(Q3ShaderPtr curShader);
 		void					printError( const String& msg, const String& optional = "" ) const;
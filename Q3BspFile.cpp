@@ -1,6 +1,12 @@
 #include <sstream>
+#include <iomanip>
 #include <cmath>
 #include <string>
+#include <cstring>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <array>
 
 #include <QtCore/QProcess>
 #include <QtCore/QDebug>
@@ -25,6 +31,18 @@
 #include <Component/Camera.hpp>
 #include <Graphics/View.hpp>
 #include <Scene/Scene.hpp>
+#include <Misc/Q3ImageKernels.h>
+#include <Misc/Q3PatchKernels.h>
+#include <Misc/Q3VertexWeld.h>
+#include <Misc/Q3IndexOptimize.h>
+#include <Misc/Q3AsyncIO.h>
+#include <Misc/Q3ThreadPool.h>
+#include <Misc/Q3TaskGraph.h>
+#include <Misc/Q3LoadProfiler.h>
+#include <Misc/Q3HugePages.h>
+#include <Misc/Q3ShaderRegistry.h>
+#include <Misc/Q3CookedMap.h>
+#include <Misc/Q3TextureStream.h>
 #include <Misc/Q3BuildGLSL.h>
 #include <Misc/Q3BspFile.h>
 
@@ -35,6 +53,55 @@ namespace
     using namespace Misc;	
     using namespace Math;
 
+    const std::size_t CONVERT_GRAIN_SIZE = 4096;	//elements per chunk when converting lumps in parallel
+
+    /*
+    * @brief: Typed view on a lump, bounds are checked by Q3Header::lumpsInBounds
+    */
+    template<typename T>
+    Q3LumpView<T> GetLump(const Q3MappedFile& file, const Q3Header& header, int lump)
+    {
+        const auto& entry = header.m_DirEntries[lump];
+        return Q3LumpView<T>(reinterpret_cast<const T*>(file.data() + entry.m_Offset), entry.m_Length / sizeof(T));
+    }
+
+    /*
+    * @brief: Size of a lump as profile scope detail, views only touch their pages later on
+    */
+    String LumpBytes(const Q3Header& header, int lump)
+    {
+        return std::to_string(header.m_DirEntries[lump].m_Length) + " bytes";
+    }
+
+    /*
+    * @brief: Owned copy of a lump, for lumps that are modified after loading
+    */
+    template<typename List>
+    void CopyLump(const Q3MappedFile& file, const Q3Header& header, int lump, List& result)
+    {
+        auto view = GetLump<typename List::value_type>(file, header, lump);
+        result.assign(std::begin(view), std::end(view));
+    }
+
+    /*
+    * @brief: Bytes held by a vector, its capacity counts
+    */
+    template<typename List>
+    std::size_t ListBytes(const List& list)
+    {
+        return list.capacity() * sizeof(typename List::value_type);
+    }
+
+    /*
+    * @brief: Clear a vector & give its memory back, clear() alone keeps the capacity. Arena lists
+    * keep their arena, its memory is given back by Q3MapArena::release
+    */
+    template<typename List>
+    void ReleaseList(List& list)
+    {
+        List( list.get_allocator() ).swap(list);
+    }
+
     const Q3Face& GetMapFace(const Q3BspFile* q3bsp, int faceId)
     {
         return q3bsp->m_faceList[faceId];
@@ -104,7 +171,7 @@ namespace
             stBounds.updateBounds(i.m_stCoord);
 
         if (!stBounds.isValid()) {
-            App::AddConsoleMessage(q3bsp->getContext(), "AutoSprite no st coords", App::LOG_LEVEL_WARNING);
+            Q3PostConsoleMessage(q3bsp->getContext(), "AutoSprite no st coords", true);
             return false;
         }
         //normalize uv coordinates
@@ -207,7 +274,7 @@ namespace
         
         if ( (dI.m_asWidth < FLOAT_EPSILON) || (dI.m_asHeight < FLOAT_EPSILON ) )
         {
-            App::AddConsoleMessage( q3bsp->getContext(), "AutoSprite2 zero area face", App::LOG_LEVEL_WARNING );
+            Q3PostConsoleMessage( q3bsp->getContext(), "AutoSprite2 zero area face", true );
             return false;
         }
         dI.m_asMajorDir = (dI.m_asVertexPos[1] - dI.m_asVertexPos[0]).getNormalized();
@@ -234,49 +301,33 @@ namespace
         return false;
     }
 
-    std::vector<Q3Triangle>	GetTrianglesForLeaf(const Q3BspFile* q3bsp, int leafId, std::uint32_t sortflags )
+    /*
+        @brief: Triangles of the faces owned by a leaf, see Q3BspFile::assignFaceOwners
+    */
+    std::vector<Q3Triangle>	GetTrianglesForLeaf(const Q3BspFile* q3bsp, const int* faces, int numFaces, std::uint32_t sortflags )
     {
+        Q3_PROFILE_SCOPE( "triangulate leaf" );
         TriangleList result;		
-        const auto& q3leaf = q3bsp->m_drawLeafs[leafId];
-        for (int i = 0; i < q3leaf.m_numFaces; ++i)
-        {
-            int offset			= q3leaf.m_firstFace + i;
-            auto faceId			= q3bsp->m_leafFaceList[offset].m_faceIndex;
-            const auto& face	= q3bsp->m_faceList[faceId];
-            auto shader			= q3bsp->getShader(face.m_texIndex);
-            if ( shader->hasAutoSprite() ) //ignore here gives unwanted results
-                continue;
-            auto tmpTriangles = q3bsp->triangulateFace(faceId);	
+        for (int i = 0; i < numFaces; ++i)
+        {
+            auto tmpTriangles = q3bsp->triangulateFace(faces[i]);	
             result.insert(std::end(result), std::begin(tmpTriangles), std::end(tmpTriangles));
         }	
-        //slow but will lets us see autosprites
-        for (int i = 0; i < q3bsp->m_faceList.size(); ++i)
-        {
-            const auto& face = q3bsp->m_faceList[i];
-            auto shader = q3bsp->getShader(face.m_texIndex);
-            if (shader->hasAutoSprite()) 
-            {
-                auto faceCenter = GetFaceCenter(q3bsp, i);
-                auto asId = q3bsp->leafNodeForPosition(faceCenter);
-                if (asId == leafId)
-                {
-                    auto tmpTriangles = q3bsp->triangulateFace(i);
-                    result.insert(std::end(result), std::begin(tmpTriangles), std::end(tmpTriangles));
-                }
-            }
-        }
 
         std::sort(std::begin(result), std::end(result),
             [](const Q3Triangle& a, const Q3Triangle& b)
         {
-            return a.m_shaderId < b.m_shaderId;
+            if (a.m_shaderId != b.m_shaderId)
+                return a.m_shaderId < b.m_shaderId;
+            return a.m_lightmapId < b.m_lightmapId; //lightmap atlas
         });
         return result;		
     }
 
 
-    VaoBuffer	CreateVAO(App::EngineContext* context, const Vertex* dataPtr, size_t numVerts)
+    VaoBuffer	CreateVAO(App::EngineContext* context, const Vertex* dataPtr, size_t numVerts, const CompactVertexList* compact = nullptr)
     {
+        Q3_PROFILE_SCOPE( "create vao" );
         using namespace Render;
         auto renderer = context->getSystem<OpenGLRenderer>();
         VaoBuffer vaoPtr = VaoBuffer( renderer->createVertexArrayObject() );
@@ -285,6 +336,26 @@ namespace
         auto _FlOAT = GetConstant("FLOAT");
         auto _UBYTE = GetConstant("UNSIGNED_BYTE");;
         auto _DRAWMODE = GetConstant("STATIC_DRAW");
+        if (compact) //same locations, positions & lightmap uv normalized, st half floats
+        {
+            auto _USHORT	 = GetConstant("UNSIGNED_SHORT");
+            auto _HALF		 = GetConstant("HALF_FLOAT");
+            auto _VERTEXSIZE = sizeof(Q3CompactVertex);
+            auto _BUFFERSIZE = compact->size() * _VERTEXSIZE;
+            auto compactPtr	 = compact->data();
+            VertexBuffer vBuffers[] = {
+                VertexBuffer(compactPtr, _USHORT, 3, _VERTEXSIZE, _DRAWMODE, 0,  1, 0, 0,  _BUFFERSIZE),
+                VertexBuffer(compactPtr, _UBYTE,  4, _VERTEXSIZE, _DRAWMODE, 1,  1, 0, 8,  _BUFFERSIZE),
+                VertexBuffer(compactPtr, _HALF,   2, _VERTEXSIZE, _DRAWMODE, 2,  0, 0, 12, _BUFFERSIZE),	//tex coord
+                VertexBuffer(compactPtr, _USHORT, 2, _VERTEXSIZE, _DRAWMODE, 3,  1, 0, 16, _BUFFERSIZE),	//lightmap
+                VertexBuffer(compactPtr, _UBYTE,  4, _VERTEXSIZE, _DRAWMODE, 4,  1, 0, 20, _BUFFERSIZE)
+            };
+            for (const auto& vb : vBuffers)
+                vaoPtr->addVertexBuffer(vb);
+            vaoPtr->initialize();
+            return vaoPtr;
+        }
+
         auto _VERTEXSIZE = sizeof(Vertex);
         auto _BUFFERSIZE = numVerts * _VERTEXSIZE;
         //create vertex array object
@@ -301,6 +372,41 @@ namespace
         return vaoPtr;
     }
 
+    /*
+        @brief: Element buffer for 'vao', the element binding is part of the vao state
+    */
+    Q3IndexBufferPtr CreateIndexBuffer(const VaoBuffer& vao, const std::uint32_t* indices, size_t numIndices, size_t numVerts)
+    {
+        Q3_PROFILE_SCOPE( "create index buffer" );
+        auto result = std::make_shared<Q3IndexBuffer>();
+        std::vector<std::uint16_t> shortIndices;
+        const void* dataPtr = indices;
+        if (numVerts <= std::numeric_limits<std::uint16_t>::max())
+        {
+            shortIndices.assign(indices, indices + numIndices);
+            dataPtr = shortIndices.data();
+            result->m_indexType = GL_UNSIGNED_SHORT;
+            result->m_indexSize = sizeof(std::uint16_t);
+        }
+        else
+        {
+            result->m_indexType = GL_UNSIGNED_INT;
+            result->m_indexSize = sizeof(std::uint32_t);
+        }
+        vao->bind();
+        glGenBuffers(1, &result->m_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result->m_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * result->m_indexSize, dataPtr, GL_STATIC_DRAW);
+        vao->unBind();
+        return result;
+    }
+
+    //leaf vertices are merged when all their attributes match
+    bool SameVertexBytes(const Vertex& a, const Vertex& b)
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+
     
 	ViewPortVector UpdatePortalViews(const Misc::Q3BspFile* q3bsp, const ViewPortPtr& view, int clusterId )
 	{
@@ -367,19 +473,30 @@ namespace
         auto drawMultiPass	= commandList.getVariable<int>( "r_drawMultiPass"	) != 0;		
         auto drawTriangles  = commandList.getVariable<int>( "r_drawTriangles"   ) != 0;		*/
 
+        //leafs share the world vao with r_worldBuffer, it's only bound once then
+        const VaoBuffer* boundVao = nullptr;
         for (const auto& drawInfo : drawList)
         {
             const auto& leaf = q3bsp->m_drawLeafs[drawInfo->m_leafId];
             auto shaderId = drawInfo->m_shaderId;
             auto& q3Shader = q3bsp->m_shaders[shaderId];
-            if (!q3Shader->bind())
+            //per map state is passed on each draw, shaders are shared with other maps
+            auto lightMapId = static_cast<std::size_t>(drawInfo->m_lightMapId);
+            if (!q3Shader->bind( lightMapId < q3bsp->m_lightmaps.size() ? q3bsp->m_lightmaps[lightMapId] : nullptr ))
                 continue;
 
             q3Shader->setDrawInfo( *drawInfo );
 
-            leaf.m_vaoBuffer->bind();
-            leaf.m_vaoBuffer->setDrawInformation( GL_TRIANGLES, drawInfo->m_vertexStart, drawInfo->m_vertexCount, false );
-            leaf.m_vaoBuffer->draw();
+            const auto& vao			= q3bsp->m_worldVao ? q3bsp->m_worldVao : leaf.m_vaoBuffer;
+            const auto& indexBuffer = q3bsp->m_worldVao ? *q3bsp->m_worldIndexBuffer : *leaf.m_indexBuffer;
+            auto indexOffset = static_cast<std::size_t>(drawInfo->m_indexStart) * indexBuffer.m_indexSize;
+            if (boundVao != &vao)
+            {
+                vao->bind();
+                boundVao = &vao;
+            }
+            glDrawRangeElements( GL_TRIANGLES, drawInfo->m_vertexStart, drawInfo->m_vertexStart + drawInfo->m_vertexCount - 1,
+                drawInfo->m_indexCount, indexBuffer.m_indexType, reinterpret_cast<const void*>(indexOffset) );
 
             q3Shader->unBind();
 
@@ -436,18 +553,47 @@ namespace Misc
     //////////////////////////////////////////////////////////////////////////
     Q3BspFile::Q3BspFile( App::EngineContext* context) 
         : App::RootObject( context )
+        , m_arena			(&m_hugePages)
+        , m_drawLeafs		(&m_arena)
+        , m_clusterList		(&m_arena)
+        , m_visStorage		(&m_arena)
+        , m_nodeList		(&m_arena)
+        , m_modelList		(&m_arena)
+        , m_effectList		(&m_arena)
+        , m_faceList		(&m_arena)
+        , m_vertexList		(&m_arena)
         , m_loaded			(false)
         , m_numPolyFaces	(0) 
         , m_numPatches		(0)
         , m_numMeshFaces	(0)
         , m_numBillBoards	(0)
+        , m_cacheTriangles	(0)
+        , m_cacheMissesBefore(0)
+        , m_cacheMissesAfter(0)
+        , m_numCompactVertices(0)
+        , m_trimmed			(false)
+        , m_drawFrame		(0)
+        , m_culledTriangles	(0)
+        , m_numLightmapAtlases(0)
+        , m_loadStage		(LOAD_STAGE_IDLE)
+        , m_postedStage		(LOAD_STAGE_IDLE)
+        , m_cancelLoad		(false)
+        , m_numGpuJobs		(0)
+        , m_numGpuJobsDone	(0)
     {
+        //async reads( shader scripts ) of files that aren't loose go through the engine file stream
+        auto engine = context;
+        Q3AsyncReader::Global().setFallbackReader([engine](const String& path, std::vector<std::uint8_t>& data)
+        {
+            return Q3ReadFile( engine, path, data );
+        });
     };
 
 
     Q3BspFile::~Q3BspFile()
     {
         clear();
+        Q3ShaderRegistry::Global().purgeUnused();
     }
 
 	bool Q3BspFile::isLoaded() const
@@ -455,46 +601,327 @@ namespace Misc
 		return m_loaded;
 	}
 
+	bool Q3BspFile::isLoaded(eQ3LoadStage stage) const
+	{
+		auto current = m_loadStage.load();
+		return current >= stage && current <= LOAD_STAGE_DONE;
+	}
+
+	float Q3BspFile::getLoadProgress() const
+	{
+		auto stage = m_loadStage.load();
+		if (stage == LOAD_STAGE_DONE)
+			return 1.0f;
+		if (stage == LOAD_STAGE_IDLE || stage > LOAD_STAGE_DONE)
+			return 0.0f;
+		//cpu stages & gpu jobs count equally, jobs keep being queued until the upload stage
+		auto cpu	 = static_cast<float>(stage - LOAD_STAGE_PARSING) / (LOAD_STAGE_UPLOAD - LOAD_STAGE_PARSING);
+		auto numJobs = m_numGpuJobs.load();
+		auto gpu	 = numJobs ? static_cast<float>(m_numGpuJobsDone.load()) / numJobs : 0.0f;
+		return 0.5f * cpu + 0.5f * gpu;
+	}
+
 	bool Q3BspFile::loadFile(const String& fileName)
     {
         if ((m_fileName == fileName) && m_loaded)
             return true;
-		
+
+        //same stages as an async load, entities & gpu jobs run here while the load thread waits on them
+        beginLoadAsync( fileName );
+        while (!updateLoad( std::numeric_limits<float>::max() ))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return m_loaded;
+    }
+
+	bool Q3BspFile::beginLoadAsync(const String& fileName)
+	{
+		if ((m_fileName == fileName) && m_loaded)
+			return true;
+
+		clear();
+		beginLoadProfile( fileName );
+		//created here the first time, it looks up default textures in the resource manager
+		auto fallbackShader = Q3ShaderRegistry::Global().getFallbackShader(m_context);
+		setLoadStage( LOAD_STAGE_PARSING );
+		m_loadThread = std::thread([this, fileName, fallbackShader]()
+		{
+			runLoadStages( fileName, fallbackShader );
+		});
+		return true;
+	}
+
+	bool Q3BspFile::updateLoad(float budgetMs)
+	{
+		using Clock = std::chrono::steady_clock;
+		const auto start = Clock::now();
+		auto elapsedMs = [start]() -> float
+		{
+			return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+		};
+
+		//at least one job per call so a load always makes progress
+		for (bool ranJob = false; !ranJob || elapsedMs() < budgetMs; ranJob = true)
+		{
+			std::function<void()> job;
+			{
+				std::lock_guard<std::mutex> lock(m_gpuJobMutex);
+				if (m_gpuJobs.empty())
+					break;
+				job = std::move(m_gpuJobs.front());
+				m_gpuJobs.pop_front();
+			}
+			job();
+			m_numGpuJobsDone++;
+		}
+		//console output of the load thread & pool jobs
+		Q3FlushConsoleMessages();
+
+		auto stage = m_loadStage.load();
+		if (stage >= LOAD_STAGE_UPLOAD && m_loadThread.joinable())
+			m_loadThread.join(); //cpu stages are done, the thread is on its way out
+		if (stage == LOAD_STAGE_FAILED && m_postedStage != LOAD_STAGE_FAILED)
+		{
+			clear();
+			setLoadStage( LOAD_STAGE_FAILED );
+		}
+		//events are posted from here so listeners run on the main thread
+		if (stage != m_postedStage)
+		{
+			m_postedStage = stage;
+			m_context->getSystem<App::EventSystem>()->postEvent(EVENT_TYPE(MAP_LOAD_PROGRESS));
+		}
+		return stage >= LOAD_STAGE_DONE;
+	}
+
+	void Q3BspFile::cancelLoad()
+	{
+		auto stage = m_loadStage.load();
+		if (stage == LOAD_STAGE_IDLE || stage >= LOAD_STAGE_DONE)
+			return;
 		clear();
-        //do we have a valid q3 bsp file?
-        if (!parseLumps( fileName )) {           
+		setLoadStage( LOAD_STAGE_CANCELLED );
+	}
+
+	void Q3BspFile::beginLoadProfile(const String& fileName)
+	{
+		auto& profiler = Q3LoadProfiler::Global();
+		const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+		if (commandList.getVariable<int>("dbg_profileLoad") != 0)
+			profiler.beginSession( fileName );
+		else
+			profiler.endSession(); //a cancelled load may have left one running
+	}
+
+	void Q3BspFile::endLoadProfile()
+	{
+		auto& profiler = Q3LoadProfiler::Global();
+		if (!profiler.enabled())
+			return;
+		profiler.setCounter( "poly faces", m_numPolyFaces );
+		profiler.setCounter( "patch faces", m_numPatches );
+		profiler.setCounter( "mesh faces", m_numMeshFaces );
+		profiler.setCounter( "billboard faces", m_numBillBoards );
+		profiler.setCounter( "bsp vertices", static_cast<std::int64_t>(m_vertexList.size()) );
+		profiler.setCounter( "leafs", static_cast<std::int64_t>(m_drawLeafs.size()) );
+		profiler.setCounter( "lightmap atlases", m_numLightmapAtlases );
+		profiler.setCounter( "gpu jobs", m_numGpuJobs );
+		profiler.setCounter( "arena bytes", static_cast<std::int64_t>(m_arena.bytesUsed()) );
+		profiler.setCounter( "arena blocks", m_arena.numBlocks() );
+		profiler.endSession();
+
+		auto path = Q3GetMapPath() + m_fileName;
+		if (profiler.writeJson( path + ".load.json" ) && profiler.writeChromeTrace( path + ".trace.json" ))
+			AddConsoleMessage( m_context, String( "Load profile written: " ) + path + ".load.json" );
+		else
+			AddConsoleMessage( m_context, String( "Could not write load profile: " ) + path, App::LOG_LEVEL_WARNING );
+	}
+
+	void Q3BspFile::setLoadStage(eQ3LoadStage stage)
+	{
+		m_loadStage = stage;
+	}
+
+	void Q3BspFile::enqueueGpuJob(std::function<void()> job)
+	{
+		std::lock_guard<std::mutex> lock(m_gpuJobMutex);
+		m_gpuJobs.push_back(std::move(job));
+		m_numGpuJobs++;
+	}
+
+	bool Q3BspFile::runOnMainThread(std::function<void()> job)
+	{
+		auto done = std::make_shared<std::atomic<bool>>(false);
+		enqueueGpuJob([job, done]()
+		{
+			job();
+			*done = true;
+		});
+		//poll, a cancelled load drops the job without running it. Called from graph tasks on the pool,
+		//other pool work goes on meanwhile
+		while (!*done)
+		{
+			if (loadCancelled())
+				return false;
+			if (!Q3ThreadPool::Global().runPendingTask())
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+    bool Q3BspFile::runLoadStages(const String& fileName, const Q3ShaderPtr& fallbackShader)
+    {
+        auto failed = [this]() -> bool
+        {
+            //a cancelled load is cleaned up by whoever cancelled it
+            if (!loadCancelled())
+                setLoadStage( LOAD_STAGE_FAILED );
             return false;
+        };
+
+        setLoadStage( LOAD_STAGE_PARSING );
+        const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+        //large map arrays( arena blocks ) on huge pages, takes effect for this load
+        auto hugePages = static_cast<eQ3HugePageMode>(std::min(std::max(commandList.getVariable<int>("r_hugePages"), 0), 2));
+        if (m_hugePages.getMode() != hugePages)
+        {
+            m_hugePages.setMode( hugePages );
+            m_arena.release( false ); //the kept block has the old page size
+        }
+        //read all shader scripts in one batch, they arrive while the map is mapped & parsed
+        auto scripts  = beginShaderDirectoryRead();
+        if (m_mapFile.open( Q3GetMapPath() + fileName ))
+            m_mapFile.willNeed(); //pages are read ahead while the header & textures are parsed
+        else
+        {
+            //not a loose file( packaged ), read it through the engine file stream instead
+            std::vector<std::uint8_t> mapData;
+            if (Q3ReadFile( m_context, Q3GetMapPath() + fileName, mapData ) && !mapData.empty())
+                m_mapFile.assign( std::move(mapData) );
         }
 
-        //do a first pass to cache shaders
-        parseShaderDirectory();
-        
-        //parse the entity string
-        parseEntityString();
-        
-        //update bounds
-        calculateBounds();
-        
-        //offset map so min values are at origin & max bounds are a power of two
-        offsetMap( m_worldBounds.getMin() * -1.0f );	
-               
-        //load shaders&textures found in this map
-        loadShaders();			
+        //do we have a valid q3 bsp file? texture names first so their reads can start early
+        if (!m_mapFile.isOpen() || !parseTextureLumps()) {
+            for (const auto& script : scripts) //don't leave finished reads behind
+                Q3AsyncReader::Global().wait( script.second );
+            m_mapFile.close();
+            return failed();
+        }
 
-        //link entities together
-        buildDrawClusters();
+        //the remaining phases only wait for the data they use, critical path is lumps -> shaders -> leafs
+        auto useCooked	= commandList.getVariable<int>("r_cookedMaps") != 0;
+        auto cookedPath = Q3GetMapPath() + fileName + COOKED_MAP_EXTENSION;
+        std::uint64_t cookedKey = 0;
+        auto cooked		= false;
+        auto builtLeafs = false;
 
-        //link entities together
-        linkEntities();
-            
-        //build vertex buffers for draw leafs/clusters
-        buildVAOForLeafs();
+        Q3TaskGraph graph;
+        auto shaderDir = graph.addTask("shader directory", [&]()
+        {
+            //do a first pass to cache shaders
+            parseShaderDirectory( scripts );
+            //read textures used by this map while the remaining lumps are parsed
+            prefetchTextures();
+        });
+        auto lumps = graph.addTask("lumps", [&]()
+        {
+            if (loadCancelled() || !parseLumps( fileName ))
+                graph.cancel();
+        });
+        auto entities = graph.addTask("entities", [&]()
+        {
+            //entities subscribe to engine events so they're created on the main thread
+            if (!runOnMainThread([this]() { parseEntityString(); }))
+                graph.cancel();
+        });
+        auto offset = graph.addTask("offset map", [&]()
+        {
+            //update bounds
+            calculateBounds();
+            //offset map so min values are at origin & max bounds are a power of two
+            offsetMap( m_worldBounds.getMin() * -1.0f );
+        }, { lumps, entities });
+        auto cookedSetup = graph.addTask("cooked map", [&]()
+        {
+            //derived data comes from the cooked map when it was built from this bsp, its shaders & settings.
+            //keyed before regular shaders are added to the shader LUT
+            cookedKey = useCooked ? cookedMapKey() : 0;
+            cooked	  = useCooked && m_cookedMap.open( cookedPath, cookedKey, sizeof(Vertex), m_mapFile );
+        }, { shaderDir });
+        auto shaders = graph.addTask("shaders", [&]()
+        {
+            resolveShaders( fallbackShader );
+        }, { cookedSetup });
+        graph.addTask("shader upload", [&]()
+        {
+            //textures & GLSL are done by gpu jobs while the geometry is built, after the lightmap upload.
+            //runs next to the leafs, don't step back when they got to the geometry stage first
+            auto parsing = LOAD_STAGE_PARSING;
+            m_loadStage.compare_exchange_strong( parsing, LOAD_STAGE_SHADERS );
+            uploadShaders();
+        }, { shaders, offset });
+        auto clusters = graph.addTask("clusters", [&]()
+        {
+            //only needs leafs & vis data
+            if (!cooked || !loadCookedClusters())
+                buildDrawClusters();
+        }, { lumps, cookedSetup });
+        auto leafs = graph.addTask("leafs", [&]()
+        {
+            //build vertex buffers for draw leafs/clusters
+            setLoadStage( LOAD_STAGE_GEOMETRY );
+            //face owners & shared leafs are part of the cooked leafs
+            if (!cooked || !loadCookedLeafs())
+            {
+                builtLeafs = true;
+                buildVAOForLeafs( assignFaceOwners() );
+            }
+        }, { offset, shaders });
+        auto link = graph.addTask("link entities", [&]()
+        {
+            //link entities together, triangulates portal faces so it doesn't overlap building the leafs
+            if (!runOnMainThread([this]() { linkEntities(); }))
+                graph.cancel();
+        }, { clusters, leafs });
+        graph.addTask("save cooked map", [&]()
+        {
+            if (builtLeafs && useCooked && !saveCookedMap( cookedPath, cookedKey ))
+                Q3PostConsoleMessage( m_context, String( "Could not write cooked map: " ) + cookedPath, true );
+        }, { leafs, link });
 
-		//notify listeners
-		m_context->getSystem<App::EventSystem>()->postEvent(EVENT_TYPE(MAP_INITIALIZED));
+        //serial runs the phases in the order above, for reproducing load issues
+        graph.run( commandList.getVariable<int>("dbg_serialMapLoad") != 0 );
+        if (graph.cancelled() || loadCancelled())
+            return failed();
 
-        m_loaded = true;
-        return m_loaded;
+        Q3PostConsoleMessage( m_context, String( cooked ? "Loaded cooked map: " : "Built map: " ) + fileName );
+
+        setLoadStage( LOAD_STAGE_UPLOAD );
+        enqueueGpuJob([this]()
+        {
+            m_cookedMap.close(); //vaos of cooked leafs are created straight from its mapping
+            //shaders of the previous map that this one doesn't use
+            Q3ShaderRegistry::Global().purgeUnused();
+            const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+            if (commandList.getVariable<int>("r_trimMapData") != 0) //all vaos are created, this is the last job
+            {
+                auto released = trimLoadData();
+                AddConsoleMessage( m_context, String( "Map data trimmed, released bytes: " ) + std::to_string( released ) );
+                AddConsoleMessage( m_context, memoryReport() );
+            }
+            if (auto numQueries = commandList.getVariable<int>("dbg_benchmarkQueries"))
+                AddConsoleMessage( m_context, benchmarkQueries( numQueries ) );
+            if (auto numRuns = commandList.getVariable<int>("dbg_benchmarkPatches"))
+                AddConsoleMessage( m_context, benchmarkPatches( numRuns ) );
+            if (auto numRuns = commandList.getVariable<int>("dbg_benchmarkImageKernels"))
+                AddConsoleMessage( m_context, benchmarkImageKernels( numRuns ) );
+            m_loaded = true;
+            setLoadStage( LOAD_STAGE_DONE );
+            endLoadProfile();
+
+            //notify listeners
+            m_context->getSystem<App::EventSystem>()->postEvent(EVENT_TYPE(MAP_INITIALIZED));
+        });
+        return true;
     }
 
 
@@ -533,6 +960,9 @@ namespace Misc
         using namespace Render;
         using namespace App;
 
+        if (!m_loaded) //still loading, leafs may be half built
+            return;
+
         const auto& commandList = getContext()->getSystem<CommandStack>()->getCommandList();        
         auto view				= commandList.getVariable<IView*>("ActiveView");
 		
@@ -547,6 +977,64 @@ namespace Misc
 		DrawListPtr solidContent, translucentContent, portalContent;
         bool skyVisible = !false;
         int culledSurfaces = 0;
+        //faces are owned by a single leaf, visible leafs pull in the owners of the faces they share
+        m_leafDrawFrame.resize(m_drawLeafs.size(), 0);
+        auto drawFrame = ++m_drawFrame;
+        auto cullMeshlets = commandList.getVariable<int>("r_cullMeshlets") != 0;
+        m_meshletDraws.clear();
+        m_culledTriangles = 0;
+        //owners are pulled in whatever their own bounds, their draw ranges are frustum tested instead
+        auto addLeaf = [&](int leafId, bool testRanges)
+        {
+            if (m_leafDrawFrame[leafId] == drawFrame)
+                return;
+            m_leafDrawFrame[leafId] = drawFrame;
+            auto& drawLeaf = m_drawLeafs[leafId];
+            for (auto& drawInfo : drawLeaf.m_drawInfoList)
+            {
+                if (testRanges && !frustum.boxInside(drawInfo.m_bounds))
+                {
+                    culledSurfaces++;
+                    continue;
+                }
+                auto q3Shader		 = getShader(drawInfo.m_shaderId);
+                auto& activeDrawList = q3Shader->isSolid() ? solidContent : translucentContent;
+                if (!cullMeshlets || drawInfo.m_numMeshlets == 0)
+                {
+                    activeDrawList.push_back(&drawInfo);
+                    continue;
+                }
+                //visible meshlets next to each other in the index range are drawn together
+                auto coneCull		= q3Shader->m_cullFace == GL_BACK;
+                const auto* meshlet = drawLeaf.m_meshlets.data() + drawInfo.m_firstMeshlet;
+                int runStart = 0, runEnd = 0;
+                auto addRun = [&]()
+                {
+                    if (runEnd == runStart)
+                        return;
+                    m_meshletDraws.push_back(drawInfo);
+                    auto& run = m_meshletDraws.back();
+                    run.m_indexStart += runStart;
+                    run.m_indexCount  = runEnd - runStart;
+                    activeDrawList.push_back(&run);
+                };
+                for (int i = 0; i < drawInfo.m_numMeshlets; ++i, ++meshlet)
+                {
+                    if (!frustum.boxInside(meshlet->m_bounds) || (coneCull && meshlet->backFacing(camPos)))
+                    {
+                        m_culledTriangles += meshlet->m_indexCount / 3;
+                        continue;
+                    }
+                    if (meshlet->m_indexStart != runEnd)
+                    {
+                        addRun();
+                        runStart = meshlet->m_indexStart;
+                    }
+                    runEnd = meshlet->m_indexStart + meshlet->m_indexCount;
+                }
+                addRun();
+            }
+        };
         for (auto i : currentCluster.m_visibleLeafs)
         {
             auto& leaf = m_drawLeafs[i];
@@ -554,14 +1042,30 @@ namespace Misc
                 skyVisible = true;
             if (!frustum.boxInside(leaf.m_bounds))
                 continue;
-            for (auto& drawInfo : leaf.m_drawInfoList)
+            addLeaf(i, false);
+            for (auto owner : leaf.m_sharedLeafs)
+                addLeaf(owner, true);
+        }
+    
+        if (m_textureStreamer && m_textureStreamer->numPending())
+        {
+            m_textureStreamer->update(commandList.getVariable<float>("r_textureStreamBudget"));
+
+            //stream textures of the biggest visible surfaces first
+            std::vector<float> shaderScreenSize(m_shaders.size(), 0.0f);
+            for (const auto* drawList : { &solidContent, &translucentContent })
+            for (const auto* drawInfo : *drawList)
             {
-                auto q3Shader		 = getShader(drawInfo.m_shaderId);
-                auto& activeDrawList = q3Shader->isSolid() ? solidContent : translucentContent;
-                activeDrawList.push_back(&drawInfo);
+                auto radius = drawInfo->m_bounds.getSize().length() * 0.5f;
+                auto dist   = std::max(1.0f, camPos.distance(drawInfo->m_bounds.getCenter()));
+                auto& size  = shaderScreenSize[drawInfo->m_shaderId];
+                size = std::max(size, radius / dist);
             }
+            for (int i = 0; i < static_cast<int>(shaderScreenSize.size()); ++i)
+                if (shaderScreenSize[i] > 0.0f)
+                    m_textureStreamer->touch(m_shaders[i].get(), shaderScreenSize[i]);
         }
-    
+
         glFrontFace(GL_CCW);
 
         { //sky
@@ -602,9 +1106,22 @@ namespace Misc
 
     bool Q3BspFile::clear()
     {
-        if (!m_loaded)
+        //stop a load in flight first, queued jobs point at the state cleared below
+        m_cancelLoad = true;
+        if (m_loadThread.joinable())
+            m_loadThread.join();
+        m_cancelLoad   = false;
+        {
+            std::lock_guard<std::mutex> lock(m_gpuJobMutex);
+            m_gpuJobs.clear();
+        }
+        m_numGpuJobs	 = 0;
+        m_numGpuJobsDone = 0;
+
+        if (!m_loaded && m_loadStage == LOAD_STAGE_IDLE)
             return false;
 
+        setLoadStage( LOAD_STAGE_IDLE );
         m_loaded	= false;
         m_fileName	= "";
 		
@@ -613,19 +1130,51 @@ namespace Misc
         m_numPatches	  = 0;
         m_numMeshFaces	  = 0;
         m_numBillBoards	  = 0;
+        m_cacheTriangles  = 0;
+        m_cacheMissesBefore = 0;
+        m_cacheMissesAfter  = 0;
+        m_numCompactVertices = 0;
+        m_compactError	  = Q3CompactError();
+        m_trimmed		  = false;
+        m_leafDrawFrame.clear();
+        m_drawFrame		  = 0;
+        m_meshletDraws.clear();
+        m_culledTriangles = 0;
         m_bytesPerVisCluster = 0;
         m_numVisClusters  = 0;
-        m_lightmap	      = nullptr;
+        m_lightmaps.clear();
+        m_lightmapPages.clear();
+        m_lightmapImages.clear();
+        m_numLightmapAtlases = 0;
         m_skyBox		  = nullptr;
 
-		for (auto shader : m_shaders)
-			shader->unloadShader();
+        //shaders stay cached for the next map, unused ones are unloaded once it's loaded
+        auto& registry = Q3ShaderRegistry::Global();
+        registry.release(m_shaders);
+        std::vector<Q3ShaderPtr> streaming;
+        if (m_textureStreamer) 
+        {
+            for (const auto& shader : m_shaders)
+                if (m_textureStreamer->isStreaming(shader.get()))
+                    streaming.push_back(shader);
+            m_textureStreamer->clear(); //stop decoding before textures are released
+        }
+        m_textureStreamer = nullptr;
+        m_texturePrefetcher = nullptr;
+        //their requests are dropped, the next map has to load them again
+        for (const auto& shader : streaming)
+            registry.unloadIfUnused(shader);
 
         m_worldBounds.clearBounds();
         m_faceTriangles.clear();
         m_facePatches.clear();
-        m_drawLeafs.clear();
+        m_facePatchIndex.clear();
+        m_patchLevels.clear();
+        ReleaseList(m_drawLeafs);
+        m_worldVao		   = nullptr;
+        m_worldIndexBuffer = nullptr;
         m_shaders.clear();
+        m_shaderFlags.clear();
         m_entityList.clear();
         m_shaderLUT.clear();  
         m_clusterList.clear();
@@ -634,18 +1183,24 @@ namespace Misc
         m_fileHeader.clear();
         m_entityString.clear();
         m_visData.clear();
+        ReleaseList(m_visStorage);
         m_textureList.clear();       
-        m_nodeList.clear();      
+        ReleaseList(m_nodeList);
         m_leafFaceList.clear();
         m_leafBrushList.clear();
-        m_modelList.clear();
+        ReleaseList(m_modelList);
         m_brushList.clear();
         m_brushSidesList.clear();
-        m_vertexList.clear();
+        ReleaseList(m_vertexList);
         m_meshVertexList.clear();
-        m_effectList.clear();
-        m_faceList.clear();       
+        ReleaseList(m_effectList);
+        ReleaseList(m_faceList);
         m_lightVolumeList.clear();
+        m_mapFile.close(); //after the views into it
+        m_cookedMap.close();
+        m_shaderScriptHashes.clear();
+        //map lifetime containers are empty now, their memory goes back in one go
+        m_arena.release();
 
         return true;
     }
@@ -674,6 +1229,21 @@ namespace Misc
 
         result << "Draw tri's:    " << m_faceTriangles.size()   << "\n";
         result << "Draw patches:  " << m_facePatches.size()     << "\n";
+        if (m_cacheTriangles)
+        {
+            result << "Index ACMR:    " << static_cast<float>(m_cacheMissesBefore) / m_cacheTriangles
+                << " -> " << static_cast<float>(m_cacheMissesAfter) / m_cacheTriangles << "\n";
+        }
+        if (m_numCompactVertices)
+        {
+            result << "Compact verts: " << m_numCompactVertices << ", max error position " << m_compactError.m_position
+                << " st " << m_compactError.m_st << " lightmap " << m_compactError.m_uv << "\n";
+        }
+        std::size_t numMeshlets = 0;
+        for (const auto& leaf : m_drawLeafs)
+            numMeshlets += leaf.m_meshlets.size();
+        if (numMeshlets)
+            result << "Meshlets:      " << numMeshlets << ", last frame culled " << m_culledTriangles << " tri's\n";
 
         result << "Bounds min:    " << m_worldBounds.getMin().toString().c_str() << "\n";
         result << "Bounds max:    " << m_worldBounds.getMax().toString().c_str() << "\n";
@@ -681,66 +1251,416 @@ namespace Misc
         return result.str();
     }
 
-    EntityList Q3BspFile::getEntitiesByName(const String& name, bool getAll /*= false */) const
+    std::size_t Q3BspFile::trimLoadData()
     {
-        EntityList result;
-        if (name.empty())
+        auto totalBytes = [](const MemoryUsage& usage)
+        {
+            std::size_t result = 0;
+            for (const auto& entry : usage)
+                result += entry.second;
             return result;
-        for (auto& ent : m_entityList)
+        };
+        const auto bytesBefore = totalBytes(memoryUsage());
+
+        //leafs are drawn from their vaos, autosprite vertices were sorted before the upload
+        for (auto& leaf : m_drawLeafs)
         {
-            if ( ent->m_targetName == name )
-            {
-                result.push_back(ent);
-                if (!getAll)
-                    break;
-            }
+            ReleaseList(leaf.m_vertexList);
+            ReleaseList(leaf.m_indexList);
         }
-        return result;
+        //only read while building the leafs, the entities & the cooked map key
+        ReleaseList(m_facePatches);
+        ReleaseList(m_facePatchIndex);
+        ReleaseList(m_faceTriangles);
+        ReleaseList(m_entityString);
+        ReleaseList(m_textureList);
+        m_shaderScriptHashes.clear();
+
+        //triangulateFace, getFacesOfType & the bsp queries keep using these. Lists in the map arena
+        //are sized from their lumps already, shrinking them would only copy within the arena
+        m_planeList.shrink_to_fit();
+        m_lightmapPages.shrink_to_fit();
+        m_trimmed = true;
+
+        return bytesBefore - totalBytes(memoryUsage());
     }
 
+    Q3BspFile::MemoryUsage Q3BspFile::memoryUsage() const
+    {
+        std::size_t leafVertices = 0;
+        std::size_t leafIndices	 = 0;
+        std::size_t drawInfos	 = ListBytes(m_drawLeafs);
+        for (const auto& leaf : m_drawLeafs)
+        {
+            leafVertices += ListBytes(leaf.m_vertexList);
+            leafIndices	 += ListBytes(leaf.m_indexList);
+            drawInfos	 += ListBytes(leaf.m_drawInfoList) + ListBytes(leaf.m_sharedLeafs) + ListBytes(leaf.m_meshlets);
+        }
+        std::size_t patches = ListBytes(m_facePatches) + ListBytes(m_facePatchIndex);
+        for (const auto& patch : m_facePatches)
+            patches += ListBytes(patch.m_patches) + ListBytes(patch.m_vertices) + ListBytes(patch.m_indices);
+        patches += ListBytes(m_patchLevels);
+        for (const auto& levels : m_patchLevels)
+            patches += ListBytes(levels.m_levelsX) + ListBytes(levels.m_levelsY);
+        std::size_t clusters = 0;
+        for (const auto& cluster : m_clusterList)
+        {
+            clusters += sizeof(cluster) + ListBytes(cluster.second.m_staticEntities) +
+                ListBytes(cluster.second.m_visibleClusters) + ListBytes(cluster.second.m_visibleLeafs);
+        }
+        std::size_t portals = 0;
+        for (const auto& portal : getEntitiesByType<Q3DrawPortal>())
+            portals += ListBytes(portal->m_portalTriangles);
+        std::size_t scriptHashes = 0;
+        for (const auto& script : m_shaderScriptHashes)
+            scriptHashes += sizeof(script) + script.first.capacity();
+
+        return {
+            { "Leaf vertices",	 leafVertices },
+            { "Leaf indices",	 leafIndices },
+            { "Draw leafs",		 drawInfos },
+            { "Draw clusters",	 clusters },
+            { "Patches",		 patches },
+            { "Face triangles",	 ListBytes(m_faceTriangles) },
+            { "Portal triangles",portals },
+            { "Faces",			 ListBytes(m_faceList) },
+            { "Vertices",		 ListBytes(m_vertexList) },
+            { "Planes",			 ListBytes(m_planeList) },
+            { "Nodes",			 ListBytes(m_nodeList) },
+            { "Models",			 ListBytes(m_modelList) },
+            { "Effects",		 ListBytes(m_effectList) },
+            { "Textures",		 ListBytes(m_textureList) },
+            { "Lightmap pages",	 ListBytes(m_lightmapPages) },
+            { "Entity string",	 ListBytes(m_entityString) },
+            { "Script hashes",	 scriptHashes }
+        };
+    }
 
-    EntityList Q3BspFile::getEntitiesForCluster(int clusterId) const
+    String Q3BspFile::memoryReport() const
     {
-        EntityList result;
-        if (clusterId == -1)
-            return result;
+        std::stringstream result;
+        std::size_t total = 0;
 
-        auto AddEntities = [this, &result](const Q3DrawCluster& cluster )
+        result << "========= Q3 Bsp Memory =========\n";
+        for (const auto& entry : memoryUsage())
         {
-            result.insert( result.end(), 
-                cluster.m_staticEntities.begin(), cluster.m_staticEntities.end());
-        };
-        //add current cluster
-        auto curCluster = m_clusterList.at(clusterId);
-        //add entities from clusters visible from this cluster
-        for (auto clId : curCluster.m_visibleClusters)
-            AddEntities(m_clusterList.at(clId));
+            result << std::left << std::setw(18) << (entry.first + ":") << entry.second << " bytes\n";
+            total += entry.second;
+        }
+        result << "Total:            " << total << " bytes\n";
+        //lump views point into the mapping, its pages are file backed & can be dropped by the os
+        result << "Mapped file:      " << m_mapFile.size() << " bytes\n";
+        result << "Arena:            " << m_arena.bytesUsed() << " of " << m_arena.bytesReserved() 
+            << " bytes in " << m_arena.numBlocks() << " blocks\n";
+        result << "Huge pages:       " << m_hugePages.bytesMapped() << " bytes\n";
+        result << "Trimmed:          " << (m_trimmed ? "yes" : "no") << "\n";
 
-        return result;
+        return result.str();
     }
 
-	Misc::Q3ShaderPtr Q3BspFile::getShader(int id) const
-	{
-#if DEBUG
-		assert(id >= 0 && id < m_shaders.size());
-#endif
-		return m_shaders[id];
-	}
+    String Q3BspFile::benchmarkQueries(int numQueries)
+    {
+        using Clock = std::chrono::steady_clock;
+        std::stringstream result;
+        if (m_drawLeafs.empty() || m_nodeList.empty() || numQueries <= 0)
+            return result.str();
+
+        //same positions every run, so runs with different page modes compare
+        std::mt19937 random(numQueries);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const auto boundsMin  = m_worldBounds.getMin();
+        const auto boundsSize = m_worldBounds.getSize();
+        std::vector<Math::Vector3f> positions(numQueries);
+        for (auto& position : positions)
+        {
+            position = Math::Vector3f(boundsMin[0] + unit(random) * boundsSize[0],
+                boundsMin[1] + unit(random) * boundsSize[1], boundsMin[2] + unit(random) * boundsSize[2]);
+        }
+        std::vector<int> clusters(numQueries);
 
-	int Q3BspFile::leafNodeForPosition(const Math::Vector3f& position) const
-	{
-		int nodeIdx = 0;
-		while (nodeIdx >= 0)
-		{
-			auto planeIdx = m_nodeList[nodeIdx].m_splitPlane;
-			const auto& plane = m_planeList[planeIdx];
-			auto result = plane.classifyPoint(position, FLOAT_EPSILON);
-			if (Math::POINT_FRONT_PLANE == result)
-				nodeIdx = m_nodeList[nodeIdx].m_children[0];
-			else
-				nodeIdx = m_nodeList[nodeIdx].m_children[1];
-		}
-		return ~nodeIdx;
+        static const char* MODE_NAMES[] = { "off", "transparent", "explicit" };
+        result << "========= Q3 Bsp Query Benchmark =========\n";
+        result << "Huge pages:       " << MODE_NAMES[m_hugePages.getMode()] << ", " 
+            << m_hugePages.bytesMapped() << " bytes mapped\n";
+
+        //a pass returns the number of items it processed & counts its hits, which are reported so
+        //the loops can't be optimized away
+        Q3TlbMissCounter tlbMisses;
+        auto runPass = [&](const char* name, const char* unitName, const std::function<std::int64_t(std::int64_t&)>& pass)
+        {
+            std::int64_t numHits = 0;
+            tlbMisses.start();
+            const auto start = Clock::now();
+            auto numItems	 = pass(numHits);
+            auto seconds	 = std::max(1e-9, std::chrono::duration<double>(Clock::now() - start).count());
+            auto misses		 = tlbMisses.stop();
+            result << std::left << std::setw(18) << name << static_cast<std::int64_t>(numItems / seconds) << " " << unitName 
+                << "/s, dTLB misses: " << (misses < 0 ? String("n/a") : std::to_string(misses)) << ", hits: " << numHits << "\n";
+        };
+
+        runPass("Leaf lookup:", "queries", [&](std::int64_t& numHits)
+        {
+            for (int i = 0; i < numQueries; ++i)
+            {
+                clusters[i] = m_drawLeafs[leafNodeForPosition(positions[i])].m_cluster;
+                numHits += clusters[i] != -1 ? 1 : 0;
+            }
+            return static_cast<std::int64_t>(numQueries);
+        });
+        runPass("Cluster visible:", "queries", [&](std::int64_t& numHits)
+        {
+            for (int i = 0; i < numQueries; ++i)
+                numHits += clusterVisible(clusters[i], clusters[(i + numQueries / 2) % numQueries]) ? 1 : 0;
+            return static_cast<std::int64_t>(numQueries);
+        });
+        //the visible leafs of each position against a sphere around it, the access pattern of draw
+        const auto cullRadius = boundsSize.length() * 0.1f;
+        //looked up front so the pass measures reads only, positions outside the map( no cluster ) are skipped.
+        //the lookup doesn't cache, the benchmark leaves the cluster cache & map arena as they are
+        std::vector<const Q3DrawCluster*> visible(numQueries, nullptr);
+        for (int i = 0; i < numQueries; ++i)
+            visible[i] = clusters[i] >= 0 ? findVisibleClusters(clusters[i]) : nullptr;
+        runPass("Leaf culling:", "leafs", [&](std::int64_t& numHits)
+        {
+            std::int64_t numTested = 0;
+            for (int i = 0; i < numQueries; ++i)
+            {
+                if (!visible[i])
+                    continue;
+                for (auto leafId : visible[i]->m_visibleLeafs)
+                {
+                    numTested++;
+                    if (m_drawLeafs[leafId].m_bounds.getCenter().distance(positions[i]) < cullRadius)
+                        numHits++;
+                }
+            }
+            return numTested;
+        });
+        return result.str();
+    }
+
+    String Q3BspFile::benchmarkPatches(int numRuns)
+    {
+        using Clock = std::chrono::steady_clock;
+        std::stringstream result;
+        if (numRuns <= 0)
+            return result.str();
+
+        //every 3x3 block of the map at the level it was built with
+        struct PatchBlock
+        {
+            int				m_faceId;
+            int				m_levelX;
+            int				m_levelY;
+            Q3BiQuadPatch	m_patch;
+        };
+        std::vector<PatchBlock> blocks;
+        std::int64_t numVertices = 0;
+        for (int i = 0; i < static_cast<int>(m_faceList.size()); ++i)
+        {
+            const auto& face = m_faceList[i];
+            if (face.m_faceType != PATCHFACE)
+                continue;
+            auto width	= face.m_patchSize[0];
+            auto numX	= (width - 1) / 2;
+            auto numY	= (face.m_patchSize[1] - 1) / 2;
+            const auto* levels = i < static_cast<int>(m_patchLevels.size()) && !m_patchLevels[i].m_levelsX.empty() ? &m_patchLevels[i] : nullptr;
+            for (int y = 0; y < numY; ++y)
+            {
+                for (int x = 0; x < numX; ++x)
+                {
+                    PatchBlock block;
+                    block.m_faceId = i;
+                    block.m_levelX = levels ? levels->m_levelsX[x] : Q3BiQuadPatch::TESS_LEVEL;
+                    block.m_levelY = levels ? levels->m_levelsY[y] : Q3BiQuadPatch::TESS_LEVEL;
+                    for (int row = 0; row < 3; ++row)
+                        for (int point = 0; point < 3; ++point)
+                            block.m_patch.m_controls[row * 3 + point] = m_vertexList[face.m_vertex + (2 * y + row) * width + 2 * x + point];
+                    numVertices += (block.m_levelX + 1) * (block.m_levelY + 1);
+                    blocks.push_back(block);
+                }
+            }
+        }
+
+        result << "========= Q3 Patch Tessellation Benchmark =========\n";
+        result << "Patch blocks:     " << blocks.size() << ", " << numVertices << " vertices, SIMD: " << (PatchKernelsSIMD() ? "yes" : "no") << "\n";
+        if (blocks.empty())
+            return result.str();
+
+        //a pass returns the number of triangles it made, reported so the work can't be optimized away
+        auto runPass = [&](const char* name, const std::function<std::int64_t()>& pass)
+        {
+            const auto start = Clock::now();
+            std::int64_t numTriangles = 0;
+            for (int run = 0; run < numRuns; ++run)
+                numTriangles += pass();
+            auto seconds = std::max(1e-9, std::chrono::duration<double>(Clock::now() - start).count());
+            result << std::left << std::setw(18) << name << std::fixed << std::setprecision(3) << seconds * 1000.0 / numRuns 
+                << " ms/run, " << static_cast<std::int64_t>(numVertices * numRuns / seconds) << " vertices/s, triangles: " 
+                << numTriangles / numRuns << "\n";
+        };
+        runPass("Reference:", [&]()
+        {
+            std::int64_t numTriangles = 0;
+            for (auto& block : blocks)
+                numTriangles += block.m_patch.tesselateReference(m_faceList[block.m_faceId], block.m_faceId, block.m_levelX, block.m_levelY).size();
+            return numTriangles;
+        });
+        Q3PatchGrid grid;
+        runPass("Grid SoA:", [&]()
+        {
+            std::int64_t numTriangles = 0;
+            for (const auto& block : blocks)
+            {
+                TessellatePatchGrid(block.m_patch.m_controls, block.m_levelX, block.m_levelY, grid);
+                numTriangles += grid.m_indices.size() / 3;
+            }
+            return numTriangles;
+        });
+        runPass("Grid SoA scalar:", [&]()
+        {
+            std::int64_t numTriangles = 0;
+            for (const auto& block : blocks)
+            {
+                TessellatePatchGridScalar(block.m_patch.m_controls, block.m_levelX, block.m_levelY, grid);
+                numTriangles += grid.m_indices.size() / 3;
+            }
+            return numTriangles;
+        });
+
+        //both tessellators evaluate the same curves, positions only differ by rounding
+        float maxError = 0.0f;
+        for (auto& block : blocks)
+        {
+            const auto& face = m_faceList[block.m_faceId];
+            auto reference	 = block.m_patch.tesselateReference(face, block.m_faceId, block.m_levelX, block.m_levelY);
+            TessellatePatchGrid(block.m_patch.m_controls, block.m_levelX, block.m_levelY, grid);
+            for (std::size_t i = 0; i < std::min(reference.size(), grid.m_indices.size() / 3); ++i)
+                for (int j = 0; j < 3; ++j)
+                    maxError = std::max(maxError, reference[i].m_vertices[j].m_worldCoord.distance(grid.getVertex(grid.m_indices[i * 3 + j]).m_worldCoord));
+        }
+        result << "Max position error: " << maxError << "\n";
+        return result.str();
+    }
+
+    String Q3BspFile::benchmarkImageKernels(int numRuns)
+    {
+        using Clock = std::chrono::steady_clock;
+        std::stringstream result;
+        auto lightmaps = GetLump<Q3LightMap>(m_mapFile, m_fileHeader, LIGHTMAP_LUMP);
+        if (numRuns <= 0 || lightmaps.empty())
+            return result.str();
+
+        //the lightmap pages of this map back to back, the data the lightmap atlases are built from
+        const auto* pages	  = reinterpret_cast<const std::uint8_t*>(lightmaps.data());
+        const auto numPages	  = static_cast<int>(lightmaps.size());
+        const auto pageBytes  = sizeof(Q3LightMap);
+        const auto numPixels  = static_cast<std::size_t>(numPages) * LIGHTMAP_SIZE * LIGHTMAP_SIZE;
+        const auto mipBytes	  = pageBytes / 4;
+        const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+        const auto lightmapScale = commandList.getVariable<float>("r_lightmapScale");
+
+        result << "========= Q3 Image Kernel Benchmark =========\n";
+        result << "Lightmap pages:   " << numPages << ", " << numPages * pageBytes / 1024 << " KB, SIMD: " << (ImageKernelsSIMD() ? "yes" : "no") << "\n";
+
+        //a pass reads 'numBytes' per run, throughput is reported against them
+        auto runPass = [&](const char* name, std::size_t numBytes, const std::function<void()>& pass)
+        {
+            const auto start = Clock::now();
+            for (int run = 0; run < numRuns; ++run)
+                pass();
+            auto seconds = std::max(1e-9, std::chrono::duration<double>(Clock::now() - start).count());
+            result << std::left << std::setw(18) << name << std::fixed << std::setprecision(3) << seconds * 1000.0 / numRuns
+                << " ms/run, " << static_cast<std::int64_t>(numBytes * numRuns / seconds / (1024.0 * 1024.0)) << " MB/s\n";
+        };
+
+        //rescaling saturates after a few runs, the kernels do the same work for any value
+        std::vector<std::uint8_t> rescaled(pages, pages + numPages * pageBytes), rescaledScalar(rescaled);
+        runPass("Rescale:", rescaled.size(), [&]() { RescaleOverbright(rescaled.data(), rescaled.size(), lightmapScale); });
+        runPass("Rescale scalar:", rescaled.size(), [&]() { RescaleOverbrightScalar(rescaledScalar.data(), rescaledScalar.size(), lightmapScale); });
+
+        std::vector<std::uint8_t> rgba(numPixels * 4), rgbaScalar(numPixels * 4);
+        runPass("RGB to RGBA:", numPages * pageBytes, [&]() { ExpandRGBToRGBA(pages, rgba.data(), numPixels, 255); });
+        runPass("RGB to RGBA scalar:", numPages * pageBytes, [&]() { ExpandRGBToRGBAScalar(pages, rgbaScalar.data(), numPixels, 255); });
+
+        std::vector<std::uint8_t> mips(numPages * mipBytes), mipsScalar(numPages * mipBytes);
+        runPass("Box filter:", numPages * pageBytes, [&]()
+        {
+            for (int i = 0; i < numPages; ++i)
+                BoxFilterDownsample(pages + i * pageBytes, LIGHTMAP_SIZE, LIGHTMAP_SIZE, 3, mips.data() + i * mipBytes);
+        });
+        runPass("Box filter scalar:", numPages * pageBytes, [&]()
+        {
+            for (int i = 0; i < numPages; ++i)
+                BoxFilterDownsampleScalar(pages + i * pageBytes, LIGHTMAP_SIZE, LIGHTMAP_SIZE, 3, mipsScalar.data() + i * mipBytes);
+        });
+
+        //the SIMD paths are exact, any difference is a kernel bug
+        auto matches = rescaled == rescaledScalar && rgba == rgbaScalar && mips == mipsScalar;
+        result << "Matches scalar:   " << (matches ? "yes" : "no") << "\n";
+        return result.str();
+    }
+
+    EntityList Q3BspFile::getEntitiesByName(const String& name, bool getAll /*= false */) const
+    {
+        EntityList result;
+        if (name.empty())
+            return result;
+        for (auto& ent : m_entityList)
+        {
+            if ( ent->m_targetName == name )
+            {
+                result.push_back(ent);
+                if (!getAll)
+                    break;
+            }
+        }
+        return result;
+    }
+
+
+    EntityList Q3BspFile::getEntitiesForCluster(int clusterId) const
+    {
+        EntityList result;
+        if (clusterId == -1)
+            return result;
+
+        auto AddEntities = [this, &result](const Q3DrawCluster& cluster )
+        {
+            result.insert( result.end(), 
+                cluster.m_staticEntities.begin(), cluster.m_staticEntities.end());
+        };
+        //add current cluster
+        auto curCluster = m_clusterList.at(clusterId);
+        //add entities from clusters visible from this cluster
+        for (auto clId : curCluster.m_visibleClusters)
+            AddEntities(m_clusterList.at(clId));
+
+        return result;
+    }
+
+	Misc::Q3ShaderPtr Q3BspFile::getShader(int id) const
+	{
+#if DEBUG
+		assert(id >= 0 && id < m_shaders.size());
+#endif
+		return m_shaders[id];
+	}
+
+	int Q3BspFile::leafNodeForPosition(const Math::Vector3f& position) const
+	{
+		int nodeIdx = 0;
+		while (nodeIdx >= 0)
+		{
+			auto planeIdx = m_nodeList[nodeIdx].m_splitPlane;
+			const auto& plane = m_planeList[planeIdx];
+			auto result = plane.classifyPoint(position, FLOAT_EPSILON);
+			if (Math::POINT_FRONT_PLANE == result)
+				nodeIdx = m_nodeList[nodeIdx].m_children[0];
+			else
+				nodeIdx = m_nodeList[nodeIdx].m_children[1];
+		}
+		return ~nodeIdx;
 	}
 
 	int Q3BspFile::clusterForPosition(const Math::Vector3f& position) const
@@ -817,23 +1737,30 @@ namespace Misc
     {
         auto setShaderLambda = [this]( Q3Triangle& tri ) ->void 
         {
-            //adjust light map id & uv coordinates
-            if (tri.m_lightmapId >= 0) 
-            {
-				const float LM_SIZE = 128.0f;
-				for (auto& v : tri.m_vertices) 
-                {
-                    float uCoord = (v.m_uvCoord[0] * LM_SIZE)  + (tri.m_lightmapId * LM_SIZE);
-                    v.m_uvCoord[0] = uCoord / m_lightmap->m_texture->getTextureWidth();
-                }
-                tri.m_lightmapId = 0;		
-            }
+            tri.m_lightmapId = adjustLightmapCoords(tri.m_lightmapId, tri.m_vertices, 3);
             assert(tri.m_shaderId >= 0);
         };       
 
         std::for_each(std::begin(triangles), std::end(triangles), setShaderLambda);   
     }
 
+    int Q3BspFile::adjustLightmapCoords(int lightmapId, Vertex* vertices, std::size_t numVertices) const
+    {
+        //adjust uv coordinates, lightmap id becomes the atlas id
+        if (lightmapId < 0)
+            return lightmapId;
+        if (lightmapId >= static_cast<int>(m_lightmapPages.size()))
+            return 0;
+        const auto& page = m_lightmapPages[lightmapId];
+        for (std::size_t i = 0; i < numVertices; ++i)
+        {
+            auto& v = vertices[i];
+            v.m_uvCoord[0] = page.m_offset[0] + v.m_uvCoord[0] * page.m_scale[0];
+            v.m_uvCoord[1] = page.m_offset[1] + v.m_uvCoord[1] * page.m_scale[1];
+        }
+        return page.m_atlas;
+    }
+
     
 
 
@@ -871,7 +1798,16 @@ namespace Misc
         if (it != std::end(m_clusterList))
             return it->second;
 
-        Q3DrawCluster newCluster;
+        //counted first, the lists are allocated once & straight from the map arena
+        std::size_t numVisible = 0;
+        for (const auto& leaf : m_drawLeafs)
+        {
+            if (leaf.m_cluster != -1 && clusterVisible(clusterId, leaf.m_cluster))
+                numVisible++;
+        }
+        auto& newCluster = m_clusterList[clusterId];
+        newCluster.m_visibleClusters.reserve(numVisible);
+        newCluster.m_visibleLeafs.reserve(numVisible);
         for (const auto& leaf : m_drawLeafs)
         {
             if (leaf.m_cluster != -1) 
@@ -883,12 +1819,18 @@ namespace Misc
                 }
             }
         }
-        m_clusterList[clusterId] = newCluster;		
-        return m_clusterList[clusterId];
+        return newCluster;
+    }
+
+    const Q3DrawCluster* Q3BspFile::findVisibleClusters(int clusterId) const
+    {
+        auto it = m_clusterList.find(clusterId);
+        return it != std::end(m_clusterList) ? &it->second : nullptr;
     }
 
     void Q3BspFile::linkEntities()
     {
+        Q3_PROFILE_SCOPE( "link entities" );
         using namespace Math;
         auto cStack = m_context->getSystem<App::CommandStack>();	
     
@@ -963,177 +1905,501 @@ namespace Misc
 
     void Q3BspFile::buildDrawClusters()
     {
-        for (auto drawLeaf : m_drawLeafs) {
+        Q3_PROFILE_SCOPE( "build draw clusters" );
+        for (const auto& drawLeaf : m_drawLeafs) {
             getVisibleClusters(drawLeaf.m_cluster);
         }
     }
 
-    bool Q3BspFile::parseLumps(const String& fileName)
+    bool Q3BspFile::parseTextureLumps()
     {
-        m_loaded = false;
-        using FileInputStream = App::FileInputStream;
-        FileInputStream ifs(m_context);
-        if (!ifs.open( (Q3GetMapPath() + fileName ).c_str(), App::FILE_TYPE_BINARY)) {
+        if (m_mapFile.size() < sizeof(Q3Header)) {
             return false;
         }
-        ifs.read(&m_fileHeader, 1);
-        if (!m_fileHeader.valid()) {
+        std::memcpy(&m_fileHeader, m_mapFile.data(), sizeof(Q3Header));
+        //lump bounds are validated once, views & copies below don't check again
+        if (!m_fileHeader.valid() || !m_fileHeader.lumpsInBounds(m_mapFile.size())) {
            return false;
         }
-
-        const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();		
-        auto lightmapScale		= commandList.getVariable<float>("r_lightmapScale");
+        //one block for the lists of this map, they're sized from the same lumps
+        m_arena.reserve( arenaSizeHint() );
 
         //Entity string 
-        Q3LumpInfo curEntry = m_fileHeader.m_DirEntries[ENTITY_LUMP];
-        if (curEntry.m_Length)
+        auto entityString = GetLump<std::uint8_t>(m_mapFile, m_fileHeader, ENTITY_LUMP);
+        m_entityString.assign(std::begin(entityString), std::end(entityString));
+        //texture lump
+        CopyLump(m_mapFile, m_fileHeader, TEXTURE_LUMP, m_textureList);
+        return true;
+    }
+
+    std::size_t Q3BspFile::arenaSizeHint() const
+    {
+        auto numElements = [this](int lump, std::size_t elementSize)
+        {
+            return static_cast<std::size_t>(m_fileHeader.m_DirEntries[lump].m_Length) / elementSize;
+        };
+        std::size_t result = 0;
+        //copied & converted lumps
+        result += numElements(NODE_LUMP, sizeof(Q3BspNode))		* sizeof(Q3BspNode);
+        result += numElements(MODELS_LUMP, sizeof(Q3Model))		* sizeof(Q3Model);
+        result += numElements(EFFECTS_LUMP, sizeof(Q3Effect))	* sizeof(Q3Effect);
+        result += numElements(FACES_LUMP, sizeof(Q3Face))		* sizeof(Q3Face);
+        result += numElements(VERTEX_LUMP, sizeof(Q3Vertex))	* sizeof(Vertex);
+        //draw leafs, with at most one draw info per leaf face. Cluster lists grow the arena by blocks
+        result += numElements(LEAF_LUMP, sizeof(Q3BspLeaf))		* sizeof(Q3DrawLeaf);
+        result += numElements(LEAF_FACES_LUMP, sizeof(Q3LeafFace)) * sizeof(Q3DrawInfo);
+        if (m_hugePages.getMode() != HUGE_PAGES_OFF)
+            result += numElements(VIS_DATA_LUMP, 1);
+        return result + result / 8; //alignment & lists that grow in place
+    }
+
+    void Q3BspFile::prefetchTextures()
+    {
+        //same lookup as resolveShaders, textures of shaders without a script are named after the shader
+        StringList paths;
+        for (const auto& curTex : m_textureList)
         {
-            m_entityString.resize(curEntry.m_Length);
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_entityString[0], static_cast<int>(m_entityString.size()));
+            String name = reinterpret_cast<const char*>(curTex.m_texName);
+            auto it = m_shaderLUT.find(name);
+            if (it == std::end(m_shaderLUT))
+            {
+                auto regular = Q3ShaderRegistry::Global().findRegularShader(name);
+                if (!regular || !regular->m_loaded)
+                    paths.push_back(Q3Shader::ResolveTexturePath(name));
+                continue;
+            }
+            if (it->second->m_loaded) //cached from a previous map
+                continue;
+            auto stagePaths = it->second->getTexturePaths();
+            paths.insert(std::end(paths), std::begin(stagePaths), std::end(stagePaths));
         }
-        //texture lump
-        curEntry = m_fileHeader.m_DirEntries[TEXTURE_LUMP];
-        if (curEntry.m_Length)
+        m_texturePrefetcher = std::make_unique<Q3TexturePrefetcher>();
+        m_texturePrefetcher->prefetch(paths);
+        Q3LoadProfiler::Global().setCounter( "textures prefetched", m_texturePrefetcher->numPrefetched() );
+        Q3PostConsoleMessage(m_context, String("Textures prefetched: ") + std::to_string(m_texturePrefetcher->numPrefetched()));
+    }
+
+    std::uint64_t Q3BspFile::cookedMapKey() const
+    {
+        const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+        const std::int32_t settings[] = 
+        {
+            static_cast<std::int32_t>(COOKED_MAP_VERSION),
+            commandList.getVariable<int>("r_lightmapAtlasSize"),	//lightmap uv's are baked in
+            commandList.getVariable<int>("r_lightmapPadding"),
+            commandList.getVariable<int>("dbg_show_clusters"),
+            commandList.getVariable<int>("r_optimizeIndices")		//index order of the draw ranges
+        };
+        auto key = HashBytes( settings, sizeof(settings) );
+        auto patchError = commandList.getVariable<float>("r_patchError");	//patch tessellation
+        key = HashBytes( &patchError, sizeof(patchError), key );
+        //the lump directory only, the bsp contents are checked by the cooked map against its size & write time
+        key = HashBytes( &m_fileHeader, sizeof(m_fileHeader), key );
+
+        //sky & autosprite flags of the shaders end up in the draw info
+        for (const auto& curTex : m_textureList)
         {
-            m_textureList.resize(curEntry.m_Length / sizeof(Q3ShaderInfo));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_textureList[0], static_cast<int>(m_textureList.size()));
+            String name = reinterpret_cast<const char*>(curTex.m_texName);
+            key = HashBytes( name.data(), name.size(), key );
+            auto it = m_shaderLUT.find(name);
+            if (it == std::end(m_shaderLUT))
+            {
+                //regular shader or fallback when its image is missing
+                std::uint8_t hasImage = Q3Shader::ResolveTexturePath(name).empty() ? 0 : 1;
+                key = HashBytes( &hasImage, sizeof(hasImage), key );
+                continue;
+            }
+            auto script = m_shaderScriptHashes.find(it->second->m_path);
+            auto scriptHash = script != std::end(m_shaderScriptHashes) ? script->second : 0;
+            key = HashBytes( &scriptHash, sizeof(scriptHash), key );
         }
-        //plane data
-        curEntry = m_fileHeader.m_DirEntries[PLANE_LUMP];
-        if (curEntry.m_Length)
+        return key;
+    }
+
+    bool Q3BspFile::loadCookedClusters()
+    {
+        auto clusters	  = m_cookedMap.section<Q3CookedCluster>( COOKED_CLUSTERS );
+        auto clusterLeafs = m_cookedMap.section<Q3CookedClusterLeaf>( COOKED_CLUSTER_LEAFS );
+        if (clusters.empty())
+            return false;
+        for (const auto& cluster : clusters)
         {
-            
-            std::vector<Q3Plane>			planeList;			
-            planeList.resize(curEntry.m_Length / sizeof(Q3Plane));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&planeList[0], static_cast<int>(planeList.size()));
-            for (const auto& pl : planeList)
-                m_planeList.emplace_back(pl.m_normal[0], pl.m_normal[1], pl.m_normal[2], -pl.m_distance);
+            if (cluster.m_firstLeaf < 0 || cluster.m_numLeafs < 0 || 
+                static_cast<std::size_t>(cluster.m_firstLeaf) + cluster.m_numLeafs > clusterLeafs.size())
+                return false;
         }
-        //node data
-        curEntry = m_fileHeader.m_DirEntries[NODE_LUMP];
-        if (curEntry.m_Length)
+        for (const auto& cluster : clusters)
         {
-            m_nodeList.resize(curEntry.m_Length / sizeof(Q3BspNode));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_nodeList[0], static_cast<int>(m_nodeList.size()));
+            auto& drawCluster = m_clusterList[cluster.m_clusterId];
+            drawCluster.m_visibleClusters.reserve(cluster.m_numLeafs);
+            drawCluster.m_visibleLeafs.reserve(cluster.m_numLeafs);
+            for (auto i = cluster.m_firstLeaf; i < cluster.m_firstLeaf + cluster.m_numLeafs; ++i)
+            {
+                drawCluster.m_visibleClusters.push_back(clusterLeafs[i].m_cluster);
+                drawCluster.m_visibleLeafs.push_back(clusterLeafs[i].m_leaf);
+            }
         }
-        //leaf nodes
-        curEntry = m_fileHeader.m_DirEntries[LEAF_LUMP];
-        if (curEntry.m_Length)
+        return true;
+    }
+
+    bool Q3BspFile::loadCookedLeafs()
+    {
+        auto leafs		= m_cookedMap.section<Q3CookedLeaf>( COOKED_LEAFS );
+        auto vertices	= m_cookedMap.section<Vertex>( COOKED_VERTICES );
+        auto drawInfos	= m_cookedMap.section<Q3CookedDrawInfo>( COOKED_DRAW_INFOS );
+        auto indices	= m_cookedMap.section<std::uint32_t>( COOKED_INDICES );
+        auto meshlets	= m_cookedMap.section<Q3CookedMeshlet>( COOKED_MESHLETS );
+        auto shared		= m_cookedMap.section<std::int32_t>( COOKED_SHARED_LEAFS );
+        if (leafs.size() != m_drawLeafs.size())
+            return false;
+        for (auto leafId : shared)
         {
-           
-            std::vector<Q3BspLeaf> leafList;
-            leafList.resize(curEntry.m_Length / sizeof(Q3BspLeaf));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&leafList[0], static_cast<int>(leafList.size()));			
-            for (auto i = 0; i < leafList.size(); ++i)				
-                m_drawLeafs.emplace_back(  leafList[i], i );		
+            if (leafId < 0 || static_cast<std::size_t>(leafId) >= m_drawLeafs.size())
+                return false;
         }
-        curEntry = m_fileHeader.m_DirEntries[LEAF_FACES_LUMP];
-        if (curEntry.m_Length)
+        //validate everything up front, a bad cooked map falls back to building
+        for (const auto& leaf : leafs)
         {
-            m_leafFaceList.resize(curEntry.m_Length / sizeof(Q3LeafFace));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_leafFaceList[0], static_cast<int>(m_leafFaceList.size()));
+            if (leaf.m_firstVertex < 0 || leaf.m_numVertices < 0 || leaf.m_firstDrawInfo < 0 || leaf.m_numDrawInfos < 0 ||
+                leaf.m_firstIndex < 0 || leaf.m_numIndices < 0 || leaf.m_firstSharedLeaf < 0 || leaf.m_numSharedLeafs < 0 ||
+                static_cast<std::size_t>(leaf.m_firstSharedLeaf) + leaf.m_numSharedLeafs > shared.size() ||
+                static_cast<std::size_t>(leaf.m_firstVertex) + leaf.m_numVertices > vertices.size() ||
+                static_cast<std::size_t>(leaf.m_firstIndex) + leaf.m_numIndices > indices.size() ||
+                static_cast<std::size_t>(leaf.m_firstDrawInfo) + leaf.m_numDrawInfos > drawInfos.size())
+                return false;
+            for (auto i = leaf.m_firstIndex; i < leaf.m_firstIndex + leaf.m_numIndices; ++i)
+            {
+                if (indices[i] >= static_cast<std::uint32_t>(leaf.m_numVertices))
+                    return false;
+            }
+            for (auto i = leaf.m_firstDrawInfo; i < leaf.m_firstDrawInfo + leaf.m_numDrawInfos; ++i)
+            {
+                const auto& info = drawInfos[i];
+                if (info.m_vertexStart < 0 || info.m_vertexCount < 0 || info.m_indexStart < 0 || info.m_indexCount < 0 ||
+                    info.m_vertexStart + info.m_vertexCount > leaf.m_numVertices ||
+                    info.m_indexStart + info.m_indexCount > leaf.m_numIndices ||
+                    info.m_firstMeshlet < 0 || info.m_numMeshlets < 0 ||
+                    static_cast<std::size_t>(info.m_firstMeshlet) + info.m_numMeshlets > meshlets.size())
+                    return false;
+                for (auto j = info.m_firstMeshlet; j < info.m_firstMeshlet + info.m_numMeshlets; ++j)
+                {
+                    if (meshlets[j].m_indexStart < 0 || meshlets[j].m_indexCount < 0 ||
+                        meshlets[j].m_indexStart + meshlets[j].m_indexCount > info.m_indexCount)
+                        return false;
+                }
+            }
         }
-        curEntry = m_fileHeader.m_DirEntries[LEAF_BRUSHES_LUMP];
-        if (curEntry.m_Length)
+        for (const auto& info : drawInfos)
         {
-            m_leafBrushList.resize(curEntry.m_Length / sizeof(Q3LeafBrush));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_leafBrushList[0], static_cast<int>(m_leafBrushList.size()));
+            if (info.m_shaderId < 0 || info.m_shaderId >= static_cast<int>(m_shaders.size()) ||
+                info.m_lightMapId < 0 || info.m_lightMapId >= m_numLightmapAtlases)
+                return false;
         }
-        curEntry = m_fileHeader.m_DirEntries[MODELS_LUMP];
-        if (curEntry.m_Length)
+
+        //the vertex section already is the world buffer, only the indices are rebased onto it
+        const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+        auto worldBuffer  = commandList.getVariable<int>("r_worldBuffer") != 0;
+        auto compactVerts = commandList.getVariable<int>("r_compactVertices") != 0;
+        auto worldIndices = std::make_shared<std::vector<std::uint32_t>>();
+        if (worldBuffer)
+            worldIndices->reserve(indices.size());
+
+        for (std::size_t i = 0; i < leafs.size(); ++i)
         {
-            m_modelList.resize(curEntry.m_Length / sizeof(Q3Model));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_modelList[0], static_cast<int>(m_modelList.size()));
+            const auto& cookedLeaf = leafs[i];
+            auto& leaf = m_drawLeafs[i];
+            leaf.m_hasSky = cookedLeaf.m_hasSky != 0;
+            leaf.m_sharedLeafs.assign(shared.data() + cookedLeaf.m_firstSharedLeaf, 
+                shared.data() + cookedLeaf.m_firstSharedLeaf + cookedLeaf.m_numSharedLeafs);
+            leaf.m_baseVertex = worldBuffer ? cookedLeaf.m_firstVertex : 0;
+            leaf.m_baseIndex  = worldBuffer ? static_cast<int>(worldIndices->size()) : 0;
+            //sized up front, the arena never frees the buffers a growing list leaves behind
+            leaf.m_drawInfoList.reserve(cookedLeaf.m_numDrawInfos);
+            auto numMeshlets = 0;
+            for (auto j = cookedLeaf.m_firstDrawInfo; j < cookedLeaf.m_firstDrawInfo + cookedLeaf.m_numDrawInfos; ++j)
+                numMeshlets += drawInfos[j].m_numMeshlets;
+            leaf.m_meshlets.reserve(numMeshlets);
+            for (auto j = cookedLeaf.m_firstDrawInfo; j < cookedLeaf.m_firstDrawInfo + cookedLeaf.m_numDrawInfos; ++j)
+            {
+                const auto& info = drawInfos[j];
+                Math::BBox3f bounds;
+                bounds.setMin(Math::Vector3f(info.m_boundsMin[0], info.m_boundsMin[1], info.m_boundsMin[2]));
+                bounds.setMax(Math::Vector3f(info.m_boundsMax[0], info.m_boundsMax[1], info.m_boundsMax[2]));
+                Q3DrawInfo drawInfo(info.m_shaderId, info.m_lightMapId, info.m_leafId, 
+                    leaf.m_baseVertex + info.m_vertexStart, info.m_vertexCount, bounds);
+                drawInfo.m_indexStart	  = leaf.m_baseIndex + info.m_indexStart;
+                drawInfo.m_indexCount	  = info.m_indexCount;
+                drawInfo.m_asCenter		  = Math::Vector3f(info.m_asCenter[0], info.m_asCenter[1], info.m_asCenter[2]);
+                drawInfo.m_asWidth		  = info.m_asWidth;
+                drawInfo.m_asHeight		  = info.m_asHeight;
+                drawInfo.m_asMajorDir	  = Math::Vector3f(info.m_asMajorDir[0], info.m_asMajorDir[1], info.m_asMajorDir[2]);
+                for (int k = 0; k < 2; ++k)
+                    drawInfo.m_asVertexPos[k] = Math::Vector3f(info.m_asVertexPos[k][0], info.m_asVertexPos[k][1], info.m_asVertexPos[k][2]);
+                drawInfo.m_firstMeshlet	  = static_cast<int>(leaf.m_meshlets.size());
+                drawInfo.m_numMeshlets	  = info.m_numMeshlets;
+                for (auto k = info.m_firstMeshlet; k < info.m_firstMeshlet + info.m_numMeshlets; ++k)
+                {
+                    const auto& cooked = meshlets[k];
+                    Q3Meshlet meshlet;
+                    meshlet.m_indexStart = cooked.m_indexStart;
+                    meshlet.m_indexCount = cooked.m_indexCount;
+                    meshlet.m_bounds.setMin(Math::Vector3f(cooked.m_boundsMin[0], cooked.m_boundsMin[1], cooked.m_boundsMin[2]));
+                    meshlet.m_bounds.setMax(Math::Vector3f(cooked.m_boundsMax[0], cooked.m_boundsMax[1], cooked.m_boundsMax[2]));
+                    meshlet.m_center	 = Math::Vector3f(cooked.m_center[0], cooked.m_center[1], cooked.m_center[2]);
+                    meshlet.m_radius	 = cooked.m_radius;
+                    meshlet.m_coneAxis	 = Math::Vector3f(cooked.m_coneAxis[0], cooked.m_coneAxis[1], cooked.m_coneAxis[2]);
+                    meshlet.m_coneCutoff = cooked.m_coneCutoff;
+                    leaf.m_meshlets.push_back(meshlet);
+                }
+                leaf.m_drawInfoList.push_back(drawInfo);
+            }
+            if (worldBuffer)
+            {
+                for (auto j = cookedLeaf.m_firstIndex; j < cookedLeaf.m_firstIndex + cookedLeaf.m_numIndices; ++j)
+                    worldIndices->push_back(indices[j] + leaf.m_baseVertex);
+            }
+            //straight from the mapping to the gpu, the leaf keeps no cpu copy
+            else if (cookedLeaf.m_hasVao)
+            {
+                auto vertexData	 = vertices.data() + cookedLeaf.m_firstVertex;
+                auto numVertices = static_cast<size_t>(cookedLeaf.m_numVertices);
+                auto indexData	 = indices.data() + cookedLeaf.m_firstIndex;
+                auto numIndices	 = static_cast<size_t>(cookedLeaf.m_numIndices);
+                std::shared_ptr<CompactVertexList> compact;
+                if (compactVerts)
+                {
+                    compact = std::make_shared<CompactVertexList>(numVertices);
+                    compactLeafVertices(leaf, vertexData, compact->data());
+                }
+                enqueueGpuJob([this, i, vertexData, numVertices, indexData, numIndices, compact]()
+                {
+                    auto& leaf		   = m_drawLeafs[i];
+                    leaf.m_vaoBuffer   = CreateVAO( m_context, vertexData, numVertices, compact.get() );
+                    leaf.m_indexBuffer = CreateIndexBuffer( leaf.m_vaoBuffer, indexData, numIndices, numVertices );
+                });
+            }
         }
-        curEntry = m_fileHeader.m_DirEntries[BRUSHES_LUMP];
-        if (curEntry.m_Length)
+        if (worldBuffer && !vertices.empty())
         {
-            m_brushList.resize(curEntry.m_Length / sizeof(Q3Brush));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_brushList[0], static_cast<int>(m_brushList.size()));
+            auto vertexData	 = vertices.data();
+            auto numVertices = vertices.size();
+            std::shared_ptr<CompactVertexList> compact;
+            if (compactVerts)
+            {
+                compact = std::make_shared<CompactVertexList>(numVertices);
+                for (auto& leaf : m_drawLeafs)
+                    compactLeafVertices(leaf, vertexData, compact->data());
+            }
+            enqueueGpuJob([this, vertexData, numVertices, worldIndices, compact]()
+            {
+                m_worldVao		   = CreateVAO( m_context, vertexData, numVertices, compact.get() );
+                m_worldIndexBuffer = CreateIndexBuffer( m_worldVao, worldIndices->data(), worldIndices->size(), numVertices );
+            });
         }
-        curEntry = m_fileHeader.m_DirEntries[BRUSH_SIDES_LUMP];
-        if (curEntry.m_Length)
+        reportCompactVertices();
+        return true;
+    }
+
+    bool Q3BspFile::saveCookedMap(const String& path, std::uint64_t key) const
+    {
+        std::vector<Q3CookedLeaf>		 leafs;
+        std::vector<Vertex>				 vertices;
+        std::vector<std::uint32_t>		 indices;
+        std::vector<Q3CookedDrawInfo>	 drawInfos;
+        std::vector<Q3CookedCluster>	 clusters;
+        std::vector<Q3CookedClusterLeaf> clusterLeafs;
+        std::vector<Q3CookedMeshlet>	 meshlets;
+        std::vector<std::int32_t>		 sharedLeafs;
+
+        auto copyVec3 = [](float* dst, const Math::Vector3f& src)
+        {
+            for (int i = 0; i < 3; ++i)
+                dst[i] = src[i];
+        };
+        for (const auto& leaf : m_drawLeafs)
         {
-            m_brushSidesList.resize(curEntry.m_Length / sizeof(Q3BrushSide));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_brushSidesList[0], static_cast<int>(m_brushSidesList.size()));
+            Q3CookedLeaf cookedLeaf;
+            cookedLeaf.m_hasSky		   = leaf.m_hasSky ? 1 : 0;
+            cookedLeaf.m_hasVao		   = leaf.m_vertexList.empty() ? 0 : 1; //vaos may still be queued
+            cookedLeaf.m_firstVertex   = static_cast<std::int32_t>(vertices.size());
+            cookedLeaf.m_numVertices   = static_cast<std::int32_t>(leaf.m_vertexList.size());
+            cookedLeaf.m_firstIndex	   = static_cast<std::int32_t>(indices.size());
+            cookedLeaf.m_numIndices	   = static_cast<std::int32_t>(leaf.m_indexList.size());
+            cookedLeaf.m_firstDrawInfo = static_cast<std::int32_t>(drawInfos.size());
+            cookedLeaf.m_numDrawInfos  = static_cast<std::int32_t>(leaf.m_drawInfoList.size());
+            cookedLeaf.m_firstSharedLeaf = static_cast<std::int32_t>(sharedLeafs.size());
+            cookedLeaf.m_numSharedLeafs	 = static_cast<std::int32_t>(leaf.m_sharedLeafs.size());
+            leafs.push_back(cookedLeaf);
+            sharedLeafs.insert(std::end(sharedLeafs), std::begin(leaf.m_sharedLeafs), std::end(leaf.m_sharedLeafs));
+            vertices.insert(std::end(vertices), std::begin(leaf.m_vertexList), std::end(leaf.m_vertexList));
+            indices.insert(std::end(indices), std::begin(leaf.m_indexList), std::end(leaf.m_indexList));
+
+            const auto firstMeshlet = static_cast<std::int32_t>(meshlets.size());
+            for (const auto& meshlet : leaf.m_meshlets)
+            {
+                Q3CookedMeshlet cooked;
+                cooked.m_indexStart = meshlet.m_indexStart;
+                cooked.m_indexCount = meshlet.m_indexCount;
+                copyVec3(cooked.m_boundsMin, meshlet.m_bounds.getMin());
+                copyVec3(cooked.m_boundsMax, meshlet.m_bounds.getMax());
+                copyVec3(cooked.m_center, meshlet.m_center);
+                cooked.m_radius		= meshlet.m_radius;
+                copyVec3(cooked.m_coneAxis, meshlet.m_coneAxis);
+                cooked.m_coneCutoff = meshlet.m_coneCutoff;
+                meshlets.push_back(cooked);
+            }
+            for (const auto& drawInfo : leaf.m_drawInfoList)
+            {
+                Q3CookedDrawInfo info;
+                info.m_shaderId	   = drawInfo.m_shaderId;
+                info.m_lightMapId  = drawInfo.m_lightMapId;
+                info.m_leafId	   = drawInfo.m_leafId;
+                //cooked ranges are relative to the leaf in either layout
+                info.m_vertexStart = drawInfo.m_vertexStart - leaf.m_baseVertex;
+                info.m_vertexCount = drawInfo.m_vertexCount;
+                info.m_indexStart  = drawInfo.m_indexStart - leaf.m_baseIndex;
+                info.m_indexCount  = drawInfo.m_indexCount;
+                info.m_firstMeshlet = firstMeshlet + drawInfo.m_firstMeshlet;
+                info.m_numMeshlets	= drawInfo.m_numMeshlets;
+                copyVec3(info.m_boundsMin, drawInfo.m_bounds.getMin());
+                copyVec3(info.m_boundsMax, drawInfo.m_bounds.getMax());
+                copyVec3(info.m_asCenter, drawInfo.m_asCenter);
+                info.m_asWidth	   = drawInfo.m_asWidth;
+                info.m_asHeight	   = drawInfo.m_asHeight;
+                copyVec3(info.m_asMajorDir, drawInfo.m_asMajorDir);
+                copyVec3(info.m_asVertexPos[0], drawInfo.m_asVertexPos[0]);
+                copyVec3(info.m_asVertexPos[1], drawInfo.m_asVertexPos[1]);
+                drawInfos.push_back(info);
+            }
         }
-        curEntry = m_fileHeader.m_DirEntries[VERTEX_LUMP];
-        if (curEntry.m_Length)
+        for (const auto& it : m_clusterList)
         {
-            std::vector<Q3Vertex> vList;
-            vList.resize(curEntry.m_Length / sizeof(Q3Vertex));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&vList[0], static_cast<int>(vList.size()));
-            for (const auto& v : vList)
-                m_vertexList.push_back(convertToNativeVertex(v));
+            Q3CookedCluster cluster;
+            cluster.m_clusterId = it.first;
+            cluster.m_firstLeaf = static_cast<std::int32_t>(clusterLeafs.size());
+            cluster.m_numLeafs	= static_cast<std::int32_t>(it.second.m_visibleLeafs.size());
+            clusters.push_back(cluster);
+            for (std::size_t i = 0; i < it.second.m_visibleLeafs.size(); ++i)
+                clusterLeafs.push_back({ it.second.m_visibleClusters[i], it.second.m_visibleLeafs[i] });
         }
-        curEntry = m_fileHeader.m_DirEntries[MESH_VERTEX_LUMP];
-        if (curEntry.m_Length)
+
+        Q3CookedMap cookedMap;
+        cookedMap.addSection(COOKED_LEAFS, leafs);
+        cookedMap.addSection(COOKED_VERTICES, vertices);
+        cookedMap.addSection(COOKED_DRAW_INFOS, drawInfos);
+        cookedMap.addSection(COOKED_CLUSTERS, clusters);
+        cookedMap.addSection(COOKED_CLUSTER_LEAFS, clusterLeafs);
+        cookedMap.addSection(COOKED_INDICES, indices);
+        cookedMap.addSection(COOKED_MESHLETS, meshlets);
+        cookedMap.addSection(COOKED_SHARED_LEAFS, sharedLeafs);
+        return cookedMap.write(path, key, sizeof(Vertex), m_mapFile);
+    }
+
+    bool Q3BspFile::parseLumps(const String& fileName)
+    {
+        auto& pool		= Q3ThreadPool::Global();
+        auto planeList	= GetLump<Q3Plane>(m_mapFile, m_fileHeader, PLANE_LUMP);
+        auto leafList	= GetLump<Q3BspLeaf>(m_mapFile, m_fileHeader, LEAF_LUMP);
+        auto vList		= GetLump<Q3Vertex>(m_mapFile, m_fileHeader, VERTEX_LUMP);
+
+        //converted lumps are presized, every element is written by exactly one chunk
+        m_planeList.resize(planeList.size());
+        m_drawLeafs.resize(leafList.size());
+        m_vertexList.resize(vList.size());
+
+        //lumps are independent, decode them concurrently & split the large conversions in chunks
+        pool.parallelInvoke({
+            [&]() //plane data
+            {
+                Q3_PROFILE_SCOPE( "lump planes" );
+                pool.parallelFor(planeList.size(), CONVERT_GRAIN_SIZE, [&](std::size_t begin, std::size_t end)
+                {
+                    for (auto i = begin; i < end; ++i) {
+                        const auto& pl = planeList[i];
+                        m_planeList[i] = PlaneVector::value_type(pl.m_normal[0], pl.m_normal[1], pl.m_normal[2], -pl.m_distance);
+                    }
+                });
+            },
+            [&]() //leaf nodes
+            {
+                Q3_PROFILE_SCOPE( "lump leafs" );
+                pool.parallelFor(leafList.size(), CONVERT_GRAIN_SIZE, [&](std::size_t begin, std::size_t end)
+                {
+                    for (auto i = begin; i < end; ++i)
+                        m_drawLeafs[i] = Q3DrawLeaf( leafList[i], static_cast<int>(i) );
+                });
+            },
+            [&]() //vertices are converted straight into their final storage
+            {
+                Q3_PROFILE_SCOPE( "lump vertices" );
+                pool.parallelFor(vList.size(), CONVERT_GRAIN_SIZE, [&](std::size_t begin, std::size_t end)
+                {
+                    for (auto i = begin; i < end; ++i)
+                        m_vertexList[i] = convertToNativeVertex(vList[i]);
+                });
+            },
+            [&]() { Q3_PROFILE_SCOPE( "lump nodes" );	CopyLump(m_mapFile, m_fileHeader, NODE_LUMP, m_nodeList); },
+            [&]() { Q3_PROFILE_SCOPE( "lump models" );	CopyLump(m_mapFile, m_fileHeader, MODELS_LUMP, m_modelList); },
+            [&]() { Q3_PROFILE_SCOPE( "lump effects" );	CopyLump(m_mapFile, m_fileHeader, EFFECTS_LUMP, m_effectList); },
+            [&]() { Q3_PROFILE_SCOPE( "lump faces" );	CopyLump(m_mapFile, m_fileHeader, FACES_LUMP, m_faceList); }
+        });
+
         {
-            m_meshVertexList.resize(curEntry.m_Length / sizeof(Q3MeshVertices));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_meshVertexList[0], static_cast<int>(m_meshVertexList.size()));
+            Q3_PROFILE_SCOPE( "lump leaf faces", LumpBytes(m_fileHeader, LEAF_FACES_LUMP) );
+            m_leafFaceList = GetLump<Q3LeafFace>(m_mapFile, m_fileHeader, LEAF_FACES_LUMP);
         }
-        curEntry = m_fileHeader.m_DirEntries[EFFECTS_LUMP];
-        if (curEntry.m_Length)
         {
-            m_effectList.resize(curEntry.m_Length / sizeof(Q3Effect));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_effectList[0], static_cast<int>(m_effectList.size()));
+            Q3_PROFILE_SCOPE( "lump leaf brushes", LumpBytes(m_fileHeader, LEAF_BRUSHES_LUMP) );
+            m_leafBrushList = GetLump<Q3LeafBrush>(m_mapFile, m_fileHeader, LEAF_BRUSHES_LUMP);
         }
-        curEntry = m_fileHeader.m_DirEntries[FACES_LUMP];
-        if (curEntry.m_Length)
         {
-            m_faceList.resize(curEntry.m_Length / sizeof(Q3Face));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_faceList[0], static_cast<int>(m_faceList.size()));
+            Q3_PROFILE_SCOPE( "lump brushes", LumpBytes(m_fileHeader, BRUSHES_LUMP) );
+            m_brushList = GetLump<Q3Brush>(m_mapFile, m_fileHeader, BRUSHES_LUMP);
         }
-        curEntry = m_fileHeader.m_DirEntries[LIGHTMAP_LUMP];
-        if (curEntry.m_Length)
         {
-            std::vector<Q3LightMap>			lightmapList;
-            
-            lightmapList.resize(curEntry.m_Length / sizeof(Q3LightMap));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&lightmapList[0], static_cast<int>(lightmapList.size()));
-            
-            for (auto& lm : lightmapList)
-                lm.rescale(lightmapScale);
-
-            //convert lightmaps 
+            Q3_PROFILE_SCOPE( "lump brush sides", LumpBytes(m_fileHeader, BRUSH_SIDES_LUMP) );
+            m_brushSidesList = GetLump<Q3BrushSide>(m_mapFile, m_fileHeader, BRUSH_SIDES_LUMP);
+        }
+        {
+            Q3_PROFILE_SCOPE( "lump mesh vertices", LumpBytes(m_fileHeader, MESH_VERTEX_LUMP) );
+            m_meshVertexList = GetLump<Q3MeshVertices>(m_mapFile, m_fileHeader, MESH_VERTEX_LUMP);
+        }
+        //convert lightmaps, rescaled in the atlas. Without any there is one white atlas, draw infos & the
+        //cooked leafs always reference atlas 0 or above
+        auto lightmapList = GetLump<Q3LightMap>(m_mapFile, m_fileHeader, LIGHTMAP_LUMP);
+        {
+            Q3_PROFILE_SCOPE( "lightmap atlas", LumpBytes(m_fileHeader, LIGHTMAP_LUMP) );
             loadLightMaps(lightmapList);
-
+            enqueueGpuJob([this]() { uploadLightMaps(); });
         }
-        curEntry = m_fileHeader.m_DirEntries[LIGHTVOLS_LUMP];
-        if (curEntry.m_Length)
         {
-            m_lightVolumeList.resize(curEntry.m_Length / sizeof(Q3LightVolume));
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_lightVolumeList[0], static_cast<int>(m_lightVolumeList.size()));
+            Q3_PROFILE_SCOPE( "lump light volumes", LumpBytes(m_fileHeader, LIGHTVOLS_LUMP) );
+            m_lightVolumeList = GetLump<Q3LightVolume>(m_mapFile, m_fileHeader, LIGHTVOLS_LUMP);
         }
-        curEntry = m_fileHeader.m_DirEntries[VIS_DATA_LUMP];
-        if (curEntry.m_Length)
+        const auto& visEntry = m_fileHeader.m_DirEntries[VIS_DATA_LUMP];
+        if (visEntry.m_Length >= 2 * static_cast<int>(sizeof(int)))
         {
-            ifs.setOffset(curEntry.m_Offset);
-            ifs.read(&m_numVisClusters, 1 );
-            ifs.read(&m_bytesPerVisCluster, 1);
-            m_visData.resize(m_numVisClusters * m_bytesPerVisCluster);
-            ifs.read(&m_visData[0], static_cast<int>(m_visData.size()));
+            Q3_PROFILE_SCOPE( "lump vis data", LumpBytes(m_fileHeader, VIS_DATA_LUMP) );
+            auto visHeader = m_mapFile.data() + visEntry.m_Offset;
+            std::memcpy(&m_numVisClusters, visHeader, sizeof(int));
+            std::memcpy(&m_bytesPerVisCluster, visHeader + sizeof(int), sizeof(int));
+            auto visSize = static_cast<std::size_t>(m_numVisClusters) * m_bytesPerVisCluster;
+            if (m_numVisClusters < 0 || m_bytesPerVisCluster < 0 || 
+                visSize > static_cast<std::size_t>(visEntry.m_Length) - 2 * sizeof(int)) {
+                return false;
+            }
+            auto visBits = visHeader + 2 * sizeof(int);
+            if (m_hugePages.getMode() != HUGE_PAGES_OFF)
+            {
+                //clusterVisible reads it randomly, the arena copy can get huge pages, the file mapping can't
+                m_visStorage.assign(visBits, visBits + visSize);
+                visBits = m_visStorage.data();
+            }
+            m_visData = Q3LumpView<std::uint8_t>(visBits, visSize);
         }
 
         m_fileName  = fileName;
-        m_loaded	= true;
-        return m_loaded;
+        return true;
     }
 
     TriangleList Q3BspFile::triangulateFace(int faceId) const
@@ -1143,25 +2409,29 @@ namespace Misc
         const auto& face = m_faceList[faceId];
         if (face.m_faceType == POLYFACE)
         {
+            Q3_PROFILE_SCOPE( "poly face" );
             result = parsePolyFace(face, faceId);
             m_numPolyFaces++;
         }
         else if (face.m_faceType == PATCHFACE) {
+            Q3_PROFILE_SCOPE( "patch face" );
             result = parsePatchFace(face, faceId);
             m_numPatches++;
         }
         else if (face.m_faceType == MESHFACE)
         {
+            Q3_PROFILE_SCOPE( "mesh face" );
             result = parseMeshFace(face, faceId);
             m_numMeshFaces++;
         }
         else if (face.m_faceType == BILLBOARD)
         {
+            Q3_PROFILE_SCOPE( "billboard face" );
             result = parseBillBoardFace(face, faceId);
             m_numBillBoards++;
         }
         else
-            AddConsoleMessage(m_context, "Unknown face id " + std::to_string(face.m_faceType), App::LOG_LEVEL_WARNING);
+            Q3PostConsoleMessage(m_context, "Unknown face id " + std::to_string(face.m_faceType), true);
         
         adjustLightmapCoords(result);
         return result;
@@ -1224,6 +2494,7 @@ namespace Misc
                 curEntity += curChar;
             }		
         }
+        m_entityList.reserve(splitEntities.size());
         for (auto& splitEntity : splitEntities) 
         {
             auto keyPairs = parseEntity(splitEntity);
@@ -1242,39 +2513,53 @@ namespace Misc
         return true;
     }
 
-    bool Q3BspFile::parseShaderDirectory()
+    Q3BspFile::ShaderScriptReads Q3BspFile::beginShaderDirectoryRead() const
     {
-        auto files = App::getFilesInFolder( Q3GetShaderPath().c_str(), { "*.shader" });				
+        auto files = App::getFilesInFolder( Q3GetShaderPath().c_str(), { "*.shader" });
         
+        ShaderScriptReads result;
         for (auto file : files) {
+            auto path = Q3GetShaderPath() + file.toStdString();
+            result.emplace_back( path, Q3AsyncReader::Global().submit( path ) );
+        }
+        return result;
+    }
+
+    bool Q3BspFile::parseShaderDirectory( const ShaderScriptReads& scripts )
+    {
+        //parse in directory order so duplicate shaders resolve the same way every load
+        auto& registry = Q3ShaderRegistry::Global();
+        for (const auto& script : scripts) {
             
-            Q3ParseShader parseShader( m_context, Q3GetShaderPath() + file.toStdString());
-            if( parseShader.parseShaderFile() )
+            auto scriptFile = Q3AsyncReader::Global().wait( script.second );
+            if (!scriptFile.m_succes)
+                continue;
+            auto hash = HashBytes( scriptFile.m_data.data(), scriptFile.m_data.size() );
+            m_shaderScriptHashes[script.first] = hash;
+            //only parsed when the script is new or changed since an earlier map
+            auto shaders = registry.getScriptShaders( m_context, script.first, scriptFile.m_data.data(), scriptFile.m_data.size(), hash );
+            //add shaders to LUT 
+            for( auto& shader: shaders )
             {
-                //add shaders to LUT 
-                for( const auto& shader: parseShader.m_shaders )
+                const auto& shaderName = shader->m_name;
+                if ( m_shaderLUT.find( shaderName ) != std::end(m_shaderLUT)) 
                 {
-                    const auto& shaderName = shader->m_name;
-                    if ( m_shaderLUT.find( shaderName ) != std::end(m_shaderLUT)) 
-                    {
-                        AddConsoleMessage( m_context, String( "Duplicate Shader: " ) + shaderName, App::LOG_LEVEL_WARNING );
-                        continue;
-                    }
-                    m_shaderLUT[shaderName] = std::move(shader);
+                    Q3PostConsoleMessage( m_context, String( "Duplicate Shader: " ) + shaderName, true );
+                    continue;
                 }
+                m_shaderLUT[shaderName] = std::move(shader);
             }
         }
         
-        AddConsoleMessage( m_context, String( "Num shaders parsed: " ) + 
-            std::to_string( m_shaderLUT.size() ), App::LOG_LEVEL_WARNING );
+        Q3PostConsoleMessage( m_context, String( "Num shaders parsed: " ) + 
+            std::to_string( m_shaderLUT.size() ), true );
         
         return true;
     }
 
 
-    bool Q3BspFile::loadShaders()
+    bool Q3BspFile::resolveShaders(const Q3ShaderPtr& fallbackShader)
     {
-        auto fallbackShader = Q3Shader::CreateFallBackShader(m_context); //create a fallback shader
         std::vector<Q3ShaderPtr> curMapShaders;	
         //iterate though shader list
         for( const auto& curTex : m_textureList )
@@ -1282,104 +2567,430 @@ namespace Misc
             String name = reinterpret_cast<const char*>(curTex.m_texName);			
             if( std::end( m_shaderLUT ) == m_shaderLUT.find(name) )  //not found in shader scripts, use regular shader
             {
-                auto result = Q3Shader::CreateRegularShader(m_context, name);
+                auto result = Q3ShaderRegistry::Global().getRegularShader(m_context, name);
                 m_shaderLUT[name] = result ? result : fallbackShader;				
                 curMapShaders.push_back(m_shaderLUT[name]);
                 continue;
             }		
             curMapShaders.push_back(m_shaderLUT[name]);
         }
+        //keeps shaders shared with the previous map loaded
+        Q3ShaderRegistry::Global().acquire(curMapShaders);
+        m_shaders = curMapShaders;
+        //copied before uploadShaders, the load thread doesn't touch shaders with gpu jobs
+        m_shaderFlags.resize(m_shaders.size());
+        for (std::size_t i = 0; i < m_shaders.size(); ++i)
+        {
+            m_shaderFlags[i].m_surfaceFlags = m_shaders[i]->m_sufaceFlags;
+            m_shaderFlags[i].m_autoSprite	= m_shaders[i]->hasAutoSprite();
+            m_shaderFlags[i].m_vertexDeform = m_shaders[i]->hasVertexDeform();
+        }
+        return true;
+    }
 
+    void Q3BspFile::uploadShaders()
+    {
+        struct UploadStats
         {
-            int numShadersLoaded = 0;
-            int numGLSLGenerated = 0;
-            int numGLSLErrors    = 0;
-            
-            for (auto it : curMapShaders ) //load textures & generate glsl code
+            int m_numShadersLoaded = 0;
+            int m_numGLSLGenerated = 0;
+            int m_numGLSLErrors	   = 0;
+            int m_numCached		   = 0;
+        };
+        auto stats = std::make_shared<UploadStats>();
+
+        enqueueGpuJob([this]()
+        {
+            const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+            if (commandList.getVariable<int>("r_streamTextures") != 0)
+            {
+                m_textureStreamer = std::make_unique<Q3TextureStreamer>(m_context);
+            }
+        });
+        
+        //a job per shader, texture loads & GLSL compiles are spread over frames
+        for (auto shader : m_shaders)
+        {
+            enqueueGpuJob([this, shader, stats]() mutable
             {
-                it->beginLoad();
-                if ( it->getStatus() == App::RESOURCE_LOADED ) 
+                shader->loadTextures(m_textureStreamer.get());
+                if ( shader->getStatus() == App::RESOURCE_LOADED ) 
                 {
-                    for (auto& stage : it->m_shaderStages) //set lightmap
+                    stats->m_numShadersLoaded++;
+                    if (shader->m_gpuShader) //compiled for an earlier map
+                        stats->m_numCached++;
+                    else 
                     {
-                        if (stage.m_lightmap) {//add lightmap
-                            stage.m_textureList.push_back(m_lightmap);
+                        Q3_PROFILE_SCOPE( "generate GLSL", shader->m_name );
+                        if (shader->generateGLSL())
+                            stats->m_numGLSLGenerated++;					
+                        else {
+                            stats->m_numGLSLErrors++;
+                            AddConsoleMessage(m_context, String("Error compiling shader: ") + shader->m_name, App::LOG_LEVEL_WARNING);
                         }
                     }
-                    numShadersLoaded++;
-                    if (it->generateGLSL()) 
-                        numGLSLGenerated++;					
-                    else {
-                        numGLSLErrors++;
-                        AddConsoleMessage(m_context, String("Error compiling shader: ") + it->m_name, App::LOG_LEVEL_WARNING);
-                    }
                 }			
-                if (eQ3SurfaceParam::SURFACE_SKY & it->m_sufaceFlags)
+                if (eQ3SurfaceParam::SURFACE_SKY & shader->m_sufaceFlags)
                 {
                     if (!m_skyBox)
-                        m_skyBox = std::make_shared<Q3DrawSky>( m_context, it );
+                        m_skyBox = std::make_shared<Q3DrawSky>( m_context, shader );
                 }
-            }		
-            
-            AddConsoleMessage( m_context, String( "Map shaders found: " )      +	std::to_string( curMapShaders.size() ) );
-            AddConsoleMessage( m_context, String( "Map shaders loaded: " )     +	std::to_string( numShadersLoaded ) );
-            AddConsoleMessage( m_context, String( "#Compiled shaders(GLSL): ") +	std::to_string( numGLSLGenerated ) );
-            AddConsoleMessage( m_context, String( "#Error shaders(GLSL): ") +		std::to_string( numGLSLErrors ), App::LOG_LEVEL_WARNING);
-        }   
-        m_shaders = curMapShaders;
-        return true;
+            });
+        }
+
+        enqueueGpuJob([this, stats]()
+        {
+            AddConsoleMessage( m_context, String( "Map shaders found: " )      +	std::to_string( m_shaders.size() ) );
+            AddConsoleMessage( m_context, String( "Map shaders loaded: " )     +	std::to_string( stats->m_numShadersLoaded ) );
+            AddConsoleMessage( m_context, String( "#Compiled shaders(GLSL): ") +	std::to_string( stats->m_numGLSLGenerated ) );
+            AddConsoleMessage( m_context, String( "#Cached shaders(GLSL): ") +	std::to_string( stats->m_numCached ) );
+            AddConsoleMessage( m_context, String( "#Error shaders(GLSL): ") +		std::to_string( stats->m_numGLSLErrors ), App::LOG_LEVEL_WARNING);
+            auto& profiler = Q3LoadProfiler::Global();
+            profiler.setCounter( "shaders", static_cast<std::int64_t>(m_shaders.size()) );
+            profiler.setCounter( "shaders loaded", stats->m_numShadersLoaded );
+            profiler.setCounter( "shaders compiled", stats->m_numGLSLGenerated );
+            profiler.setCounter( "shaders cached", stats->m_numCached );
+            profiler.setCounter( "shader errors", stats->m_numGLSLErrors );
+            //every texture was read or requested, the prefetcher holds no data but its read ahead may still run
+            m_texturePrefetcher = nullptr;
+        });
     }
 
   
 
-    bool Q3BspFile::loadLightMaps( const std::vector<Q3LightMap>& lightmaps )
+    bool Q3BspFile::loadLightMaps( const Q3LumpView<Q3LightMap>& lightmaps )
     {
-		//lambda to avoid code copy pasting
+		//lambda to avoid code copy pasting, no atlas images make uploadLightMaps use a white lightmap
 		auto SetWhiteLightmap = [this](const String& errorMsg)-> bool
 		{
-			const auto rMan = getContext()->getSystem<ResManager>();
-			App::AddConsoleMessage(m_context, errorMsg, App::LOG_LEVEL_WARNING);
-			m_lightmap = rMan->getResourceSafe<Texture>("DefaultWhiteTexture");
+			Q3PostConsoleMessage(m_context, errorMsg, true);
+			m_lightmapImages.clear();
+			m_lightmapPages.clear();
+			m_numLightmapAtlases = 1;
 			return errorMsg.empty();
 		};
 
-	    int width = static_cast<int>(lightmaps.size()) * 128;		
-		if (!width) 
+		const auto numLightmaps = static_cast<int>(lightmaps.size());
+		if (!numLightmaps) 
 			return SetWhiteLightmap("File contains no lightmaps");
-		//resize new lightmap texture to a power of two
-	    width = Math::IsPowerOfTwo(width) ? width : Math::NextPowerOfTwo( width );        
-		Common::Image newImg;
-        if (!newImg.loadFromMemory(nullptr, Common::IMAGE_FORMAT_RGB8_UI, width, 128))
-      		return SetWhiteLightmap("Error creating light map atlas");
-       
-        newImg.m_data.assign(newImg.m_data.size(), (std::uint8_t)255);
-        for (auto i = 0; i < static_cast<int>(lightmaps.size()); ++i)
-        {
-            const auto& lm = lightmaps[i];
-            Common::Image lmImg;
-			bool succes = true;
-            succes &= lmImg.loadFromMemory(lm.m_lightmapData, Common::IMAGE_FORMAT_RGB8_UI, 128, 128);
-            succes &= newImg.setSubImage(i * 128, 0, lmImg);
-			if (!succes)
+
+		const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+		auto maxAtlasSize = commandList.getVariable<int>("r_lightmapAtlasSize");
+		auto padding	  = commandList.getVariable<int>("r_lightmapPadding");
+		auto lightmapScale = commandList.getVariable<float>("r_lightmapScale");
+		maxAtlasSize = maxAtlasSize > 0 ? maxAtlasSize : LIGHTMAP_ATLAS_SIZE;
+		padding		 = padding >= 0 ? padding : LIGHTMAP_PADDING;
+		maxAtlasSize = Math::IsPowerOfTwo(maxAtlasSize) ? maxAtlasSize : Math::NextPowerOfTwo(maxAtlasSize);
+		maxAtlasSize = std::max(maxAtlasSize, LIGHTMAP_SIZE);
+		padding		 = Math::Clamp(0, (maxAtlasSize - LIGHTMAP_SIZE) / 2, padding);
+		//a mip texel has to stay within one cell & bilinear filtering may not reach past the border, which
+		//holds down to the level whose texels are as wide as the padding. Lower levels aren't built
+		int mipLevels = 0;
+		while (padding && (padding % (2 << mipLevels)) == 0)
+			mipLevels++;
+	
+		//every page gets a border of replicated texels so mips don't bleed into neighbours
+		const auto cellSize		 = LIGHTMAP_SIZE + padding * 2;
+		const auto cellsPerAxis	 = maxAtlasSize / cellSize;
+		const auto pagesPerAtlas = cellsPerAxis * cellsPerAxis;
+		const auto numAtlases	 = (numLightmaps + pagesPerAtlas - 1) / pagesPerAtlas;
+		if (numAtlases > 1)
+			Q3PostConsoleMessage(m_context, "Lightmaps exceed r_lightmapAtlasSize, using " + 
+				std::to_string(numAtlases) + " atlases", true);
+
+		m_lightmapImages.clear();
+		m_lightmapPages.resize(numLightmaps);
+		std::size_t usedTexels  = 0;
+		std::size_t totalTexels = 0;
+		for (int atlas = 0; atlas < numAtlases; ++atlas)
+		{
+			const auto firstPage = atlas * pagesPerAtlas;
+			const auto numPages  = std::min(pagesPerAtlas, numLightmaps - firstPage);
+
+			//smallest power of two atlas that fits, never more than 2:1 
+			int width  = Math::IsPowerOfTwo(cellSize) ? cellSize : Math::NextPowerOfTwo(cellSize);
+			int height = width;
+			while ((width / cellSize) * (height / cellSize) < numPages)
+			{
+				if (width == height)
+					width *= 2;
+				else
+					height *= 2;
+			}
+			
+			Common::Image newImg;
+			if (!newImg.loadFromMemory(nullptr, Common::IMAGE_FORMAT_RGB8_UI, width, height))
+				return SetWhiteLightmap("Error creating light map atlas");
+			newImg.m_data.assign(newImg.m_data.size(), (std::uint8_t)255);
+
+			//pages & their borders own disjoint cells, fill them in parallel
+			const auto columns = width / cellSize;
+			std::atomic<bool> blitFailed(false);
+			Q3ThreadPool::Global().parallelFor(numPages, 4, [&](std::size_t begin, std::size_t end)
+			{
+				for (auto i = static_cast<int>(begin); i < static_cast<int>(end); ++i)
+				{
+					const auto x = (i % columns) * cellSize + padding;
+					const auto y = (i / columns) * cellSize + padding;
+					//copy straight into the atlas, no intermediate image per lightmap
+					const auto& lm = lightmaps[firstPage + i];
+					if (!BlitSubImage(newImg.m_data.data(), width, height, x, y, &lm.m_lightmapData[0][0][0], LIGHTMAP_SIZE, LIGHTMAP_SIZE, 3))
+						blitFailed = true;
+					PadSubImageEdges(newImg.m_data.data(), width, height, x, y, LIGHTMAP_SIZE, LIGHTMAP_SIZE, padding, 3);
+
+					auto& page	  = m_lightmapPages[firstPage + i];
+					page.m_atlas  = atlas;
+					page.m_offset = Math::Vector2f(static_cast<float>(x) / width, static_cast<float>(y) / height);
+					page.m_scale  = Math::Vector2f(static_cast<float>(LIGHTMAP_SIZE) / width, static_cast<float>(LIGHTMAP_SIZE) / height);
+				}
+			});
+			if (blitFailed)
 				return SetWhiteLightmap("Error inserting image into atlas");
+			usedTexels  += static_cast<std::size_t>(numPages) * LIGHTMAP_SIZE * LIGHTMAP_SIZE;
+			totalTexels += static_cast<std::size_t>(width) * height;
+
+			//pages are rescaled in place, the mapped lump is read-only. Per texel, so rows can be split up
+			const auto rowBytes = static_cast<std::size_t>(width) * 3;
+			Q3ThreadPool::Global().parallelFor(height, 64, [&](std::size_t begin, std::size_t end)
+			{
+				RescaleOverbright(newImg.m_data.data() + begin * rowBytes, (end - begin) * rowBytes, lightmapScale);
+			});
+			GenerateBoxMipmaps(newImg, mipLevels);
+			m_lightmapImages.push_back(std::move(newImg));
+
+			Q3PostConsoleMessage(m_context, "Lightmap atlas " + std::to_string(atlas) + ": " + std::to_string(width) + 
+				"x" + std::to_string(height) + ", " + std::to_string(numPages) + " pages, " + std::to_string(mipLevels) + " mip levels");
 		}
-       
-        m_lightmap = std::make_shared<App::Texture>(m_context);
-        m_lightmap->m_params.m_clampMode_S = GL_CLAMP_TO_EDGE;
-        m_lightmap->m_params.m_clampMode_T = GL_CLAMP_TO_EDGE;
-
-		Common::MipMapPixelFilter filter;
-		newImg.generateMipmaps(&filter);
-        if (!m_lightmap->setFromImage(newImg))
-   			return SetWhiteLightmap("Error creating gpu-texture for lightmap");
-             
+		m_numLightmapAtlases = numAtlases;
+
+		Q3PostConsoleMessage(m_context, "Lightmap atlas utilisation: " + 
+			std::to_string(static_cast<int>(100.0 * usedTexels / totalTexels)) + "%, " + 
+			std::to_string(totalTexels * 3 / 1024) + " KB" );
 		return true;
     }
 
+    void Q3BspFile::uploadLightMaps()
+    {
+		const auto rMan  = getContext()->getSystem<ResManager>();
+		auto whiteLightmap = rMan->getResourceSafe<Texture>("DefaultWhiteTexture");
+		m_lightmaps.clear();
+		for (const auto& image : m_lightmapImages)
+		{
+			auto lightmap = std::make_shared<App::Texture>(m_context);
+			lightmap->m_params.m_clampMode_S = GL_CLAMP_TO_EDGE;
+			lightmap->m_params.m_clampMode_T = GL_CLAMP_TO_EDGE;
+			if (!lightmap->setFromImage(image))
+			{
+				//geometry is built against the atlas ids, keep them valid
+				App::AddConsoleMessage(m_context, "Error creating gpu-texture for lightmap", App::LOG_LEVEL_WARNING);
+				lightmap = whiteLightmap;
+			}
+			m_lightmaps.push_back(lightmap);
+		}
+		m_lightmapImages.clear();
+		if (m_lightmaps.empty())
+			m_lightmaps = { whiteLightmap };
+    }
+
+
+    IntVector Q3BspFile::assignFaceOwners()
+    {
+        Q3_PROFILE_SCOPE( "assign face owners" );
+        IntVector result(m_faceList.size(), -1);
+        //autosprites are kept with the leaf they're centered in, referencing leafs give unwanted results
+        for (int i = 0; i < static_cast<int>(m_faceList.size()); ++i)
+        {
+            if (m_shaderFlags[m_faceList[i].m_texIndex].m_autoSprite)
+                result[i] = leafNodeForPosition(GetFaceCenter(this, i));
+        }
+        //collected in scratch & copied once, the arena never frees outgrown buffers
+        IntVector sharedLeafs;
+        for (auto& leaf : m_drawLeafs)
+        {
+            sharedLeafs.clear();
+            for (int i = leaf.m_firstFace; i < leaf.m_firstFace + leaf.m_numFaces; ++i)
+            {
+                auto faceId = m_leafFaceList[i].m_faceIndex;
+                auto& owner = result[faceId];
+                if (owner == -1)
+                    owner = leaf.m_leafId;
+                if (owner != leaf.m_leafId)
+                    sharedLeafs.push_back(owner);
+                //sky faces have no geometry, every leaf that sees them still draws the sky
+                leaf.m_hasSky |= (m_shaderFlags[m_faceList[faceId].m_texIndex].m_surfaceFlags & eQ3SurfaceParam::SURFACE_SKY) != 0;
+            }
+            Common::SortUnique(sharedLeafs, true);
+            leaf.m_sharedLeafs.assign(std::begin(sharedLeafs), std::end(sharedLeafs));
+        }
+        return result;
+    }
 
-    void Q3BspFile::buildVAOForLeafs()
+    void Q3BspFile::computePatchLevels( float maxError )
     {
-        auto AddVertices = [this](TriangleList& triangeList, Q3DrawLeaf& leaf )
+        Q3_PROFILE_SCOPE( "patch levels" );
+        m_patchLevels.assign(m_faceList.size(), Q3PatchLevels());
+        if (maxError <= 0.0f)
+            return;
+
+        //outer curves of the patches, keyed by their control points starting at the smaller end
+        using EdgeKey = std::array<float, 9>;
+        std::vector<std::pair<EdgeKey, int*>> edges;
+        auto addEdge = [&edges](const Math::Vector3f& p0, const Math::Vector3f& p1, const Math::Vector3f& p2, int& level)
+        {
+            EdgeKey key, reversed;
+            for (int i = 0; i < 3; ++i)
+            {
+                key[i] = reversed[6 + i] = p0[i];
+                key[3 + i] = reversed[3 + i] = p1[i];
+                key[6 + i] = reversed[i] = p2[i];
+            }
+            if (p0.distanceSquared(p1) == 0.0f && p1.distanceSquared(p2) == 0.0f) //collapsed, shared by unrelated patches
+                return;
+            edges.emplace_back(std::min(key, reversed), &level);
+        };
+
+        for (int i = 0; i < static_cast<int>(m_faceList.size()); ++i)
+        {
+            const auto& face = m_faceList[i];
+            auto width	= face.m_patchSize[0];
+            auto height = face.m_patchSize[1];
+            auto numX	= (width - 1) / 2;
+            auto numY	= (height - 1) / 2;
+            if (face.m_faceType != PATCHFACE || numX <= 0 || numY <= 0)
+                continue;
+            auto point = [&](int row, int col) -> const Math::Vector3f&
+            {
+                return m_vertexList[face.m_vertex + row * width + col].m_worldCoord;
+            };
+
+            //a column is as fine as its most bent control row, rows likewise for the control columns
+            auto& levels = m_patchLevels[i];
+            levels.m_levelsX.assign(numX, 1);
+            levels.m_levelsY.assign(numY, 1);
+            for (int x = 0; x < numX; ++x)
+            {
+                auto& level = levels.m_levelsX[x];
+                for (int row = 0; row < height; ++row)
+                    level = std::max(level, Q3BiQuadPatch::TessLevel(point(row, 2 * x), point(row, 2 * x + 1), point(row, 2 * x + 2), maxError));
+                addEdge(point(0, 2 * x), point(0, 2 * x + 1), point(0, 2 * x + 2), level);
+                addEdge(point(height - 1, 2 * x), point(height - 1, 2 * x + 1), point(height - 1, 2 * x + 2), level);
+            }
+            for (int y = 0; y < numY; ++y)
+            {
+                auto& level = levels.m_levelsY[y];
+                for (int col = 0; col < width; ++col)
+                    level = std::max(level, Q3BiQuadPatch::TessLevel(point(2 * y, col), point(2 * y + 1, col), point(2 * y + 2, col), maxError));
+                addEdge(point(2 * y, 0), point(2 * y + 1, 0), point(2 * y + 2, 0), level);
+                addEdge(point(2 * y, width - 1), point(2 * y + 1, width - 1), point(2 * y + 2, width - 1), level);
+            }
+        }
+
+        //raising a column also raises its opposite edge, repeat until all shared edges agree
+        std::map<EdgeKey, int> edgeLevels;
+        for (bool changed = true; changed; )
+        {
+            changed = false;
+            edgeLevels.clear();
+            for (const auto& edge : edges)
+            {
+                auto& level = edgeLevels[edge.first];
+                level = std::max(level, *edge.second);
+            }
+            for (const auto& edge : edges)
+            {
+                auto level = edgeLevels[edge.first];
+                if (*edge.second < level)
+                {
+                    *edge.second = level;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    void Q3BspFile::smoothPatchSeams( const IntVector& faceOwners )
+    {
+        Q3_PROFILE_SCOPE( "patch seams" );
+        for (int faceId = 0; faceId < static_cast<int>(m_faceList.size()); ++faceId)
+        {
+            const auto& face = m_faceList[faceId];
+            if (face.m_faceType != PATCHFACE || faceOwners[faceId] == -1)
+                continue;
+            tesselatePatchFace(face, faceId);
+        }
+        if (m_trimmed) //nothing was cached to smooth
+            return;
+
+        std::vector<Vertex*> verts;
+        std::vector<int> shaderIds;
+        for (auto& patch : m_facePatches)
+            for (auto& vert : patch.m_vertices)
+            {
+                verts.push_back(&vert);
+                shaderIds.push_back(patch.m_shaderId);
+            }
+        //vertices of a face already share their normal, this only changes the ones on a seam between
+        //patches of the same shader that do not meet at a crease
+        SmoothWeldedNormals(verts, shaderIds);
+    }
+
+    void Q3BspFile::buildVAOForLeafs( const IntVector& faceOwners )
+    {
+        //shared patch edges are matched across faces before any of them is tessellated
+        computePatchLevels( m_context->getSystem<App::CommandStack>()->getCommandList().getVariable<float>("r_patchError") );
+        smoothPatchSeams( faceOwners );
+
+        //draw ranges are reordered for the post transform cache & then overdraw, ACMR is kept for the stats
+        const auto optimizeIndices = m_context->getSystem<App::CommandStack>()->getCommandList().getVariable<int>("r_optimizeIndices") != 0;
+        //draw infos & meshlets of a leaf are built in scratch lists & copied to the arena once the leaf is done,
+        //the arena never frees the buffers a growing list leaves behind
+        std::vector<Q3DrawInfo> leafDrawInfos;
+        std::vector<Q3Meshlet>	leafMeshlets;
+        auto OptimizeRange = [this, optimizeIndices, &leafMeshlets](Q3DrawLeaf& leaf, Q3DrawInfo& info, bool buildMeshlets)
+        {
+            Q3_PROFILE_SCOPE( "optimize indices" );
+            auto* indices	= leaf.m_indexList.data() + info.m_indexStart;
+            auto* vertices	= leaf.m_vertexList.data() + info.m_vertexStart;
+            auto indexCount = info.m_indexCount;
+            auto startVert	= info.m_vertexStart;
+            auto vertCount	= info.m_vertexCount;
+            for (int i = 0; i < indexCount; ++i)
+                indices[i] -= startVert;
+            m_cacheMissesBefore += VertexCacheMisses(indices, indexCount, vertCount);
+
+            //meshlets are cut first, the cache & overdraw order is kept within each of them
+            std::vector<Q3Meshlet> meshlets;
+            if (buildMeshlets)
+                BuildMeshlets(indices, indexCount, vertices, vertCount, meshlets);
+            if (optimizeIndices)
+            {
+                auto optimize = [vertices, vertCount](std::uint32_t* first, int count)
+                {
+                    OptimizeVertexCache(first, count, vertCount);
+                    OptimizeOverdraw(first, count, vertices, vertCount);
+                };
+                if (meshlets.empty())
+                    optimize(indices, indexCount);
+                for (const auto& meshlet : meshlets)
+                    optimize(indices + meshlet.m_indexStart, meshlet.m_indexCount);
+            }
+            info.m_firstMeshlet = static_cast<int>(leafMeshlets.size());
+            info.m_numMeshlets	= static_cast<int>(meshlets.size());
+            leafMeshlets.insert(std::end(leafMeshlets), std::begin(meshlets), std::end(meshlets));
+            m_cacheMissesAfter += VertexCacheMisses(indices, indexCount, vertCount);
+            m_cacheTriangles   += indexCount / 3;
+            for (int i = 0; i < indexCount; ++i)
+                indices[i] += startVert;
+        };
+
+        //patch faces enter the leaf as their tessellated lattice, already indexed
+        struct LeafPatch
+        {
+            const Q3Patch*	m_patch;
+            int				m_faceId;
+            int				m_atlasId;
+        };
+        auto AddVertices = [this, &OptimizeRange, &leafDrawInfos](TriangleList& triangeList, const LeafPatch* patches, int numPatches, Q3DrawLeaf& leaf )
         {
             std::sort(std::begin(triangeList), std::end(triangeList),
                 [](const Q3Triangle& a, const Q3Triangle& b)
@@ -1387,22 +2998,20 @@ namespace Misc
                 return a.m_faceid < b.m_faceid;
             });
 
-            auto addDrawInfo = [this]( Q3DrawInfo& di, int faceId ) -> bool
+            auto addDrawInfo = [this, &leafDrawInfos]( Q3DrawInfo& di, int faceId ) -> bool
             {
                 auto AUTO_SPRITE	= static_cast<int>(eQ3VertexDeformFunc::VD_AUTOSPRITE);
                 auto AUTO_SPRITE2	= static_cast<int>(eQ3VertexDeformFunc::VD_AUTOSPRITE2);
-                auto shader			= m_shaders[di.m_shaderId];
+                const auto& shader	= m_shaderFlags[di.m_shaderId];
                 auto& vertices		= m_drawLeafs[di.m_leafId].m_vertexList;
-                
-                if ( !shader->bind() )
-                    return false;		
 
                 bool succes = true;
-                if (auto flags = shader->hasAutoSprite())
+                if (auto flags = shader.m_autoSprite)
                 {
+                    Q3_PROFILE_SCOPE( "autosprite face" );
                     if (this->m_faceList[faceId].m_numVerts != 4) 
                     {
-                        App::AddConsoleMessage(this->getContext(), "Invalid autoSprite face", App::LOG_LEVEL_WARNING);
+                        Q3PostConsoleMessage(this->getContext(), "Invalid autoSprite face", true);
                         succes = false;
                     }
                     if (succes) 
@@ -1416,56 +3025,106 @@ namespace Misc
                     }
                 }
                 if (succes)
-                    m_drawLeafs[di.m_leafId].m_drawInfoList.push_back(di);
-                
-                shader->unBind();
+                    leafDrawInfos.push_back(di);
                 return succes;
             };
 
             const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
             auto dbgShowLeafs = commandList.getVariable<int>("dbg_show_clusters") != 0;
             
-            auto& startTriangle	= triangeList[0];			
-            auto shaderId		= startTriangle.m_shaderId;
-            auto shader			= m_shaders[shaderId];
+            //triangles & patches of a group share their shader & lightmap atlas, either may be empty
+            auto shaderId		= triangeList.empty() ? patches[0].m_patch->m_shaderId : triangeList[0].m_shaderId;
+            const auto& shader	= m_shaderFlags[shaderId];
             auto leafId			= leaf.m_leafId;
-            auto lightMapId		= 0;			
+            auto lightMapId		= std::max(0, triangeList.empty() ? patches[0].m_atlasId : triangeList[0].m_lightmapId); //atlas id
             auto startVert		= static_cast<int>(leaf.m_vertexList.size());
             auto vertCount		= 0;		
-            auto isSkyShader    = shader->hasSurfaceFlag(static_cast<int>(eQ3SurfaceParam::SURFACE_SKY));
+            auto startIndex		= static_cast<int>(leaf.m_indexList.size());
+            auto indexCount		= 0;
+            //faces of a draw info share their vertices, each draw info keeps a contiguous vertex range.
+            //welded by their bytes instead of taken from the meshverts, faces arrive here as triangles & patches
+            //& billboards have no meshverts. Meshvert faces end up with the same sharing
+            Q3VertexWelder vertexIds(0.0f, triangeList.size() * 3);
+            auto sameVertex = [&leaf](const Vertex& vert)
+            {
+                return [&leaf, &vert](int id) { return SameVertexBytes(leaf.m_vertexList[id], vert); };
+            };
+            auto isSkyShader    = (shader.m_surfaceFlags & eQ3SurfaceParam::SURFACE_SKY) != 0;
             //tag leaf as having sky
             leaf.m_hasSky |= isSkyShader;
 
             if (!isSkyShader) //ignore triangles with sky shaders
             {
                 BBox3f	bounds;
-                auto lastFaceId = startTriangle.m_faceid;
+                auto lastFaceId = triangeList.empty() ? patches[0].m_faceId : triangeList[0].m_faceid;
                 auto curFaceId = lastFaceId;
                 for (auto& triangle : triangeList)
                 {
                     curFaceId = triangle.m_faceid;
-                    if (shader->hasAutoSprite() && (lastFaceId != curFaceId)) //new face found
+                    if (shader.m_autoSprite && (lastFaceId != curFaceId)) //new face found
                     {
                         Q3DrawInfo info(shaderId, lightMapId, leafId, startVert, vertCount, bounds);
+                        info.m_indexStart = startIndex;
+                        info.m_indexCount = indexCount;
                         addDrawInfo(info, lastFaceId);
 
                         lastFaceId = curFaceId;
                         bounds.clearBounds();
                         startVert += vertCount;
                         vertCount = 0;
+                        startIndex += indexCount;
+                        indexCount = 0;
                     }
                     for (auto vert : triangle.m_vertices)
                     {
                         if( dbgShowLeafs && leaf.m_cluster != -1 )
                             vert.m_normalTangent.setW(leaf.m_cluster & 255 );					
-                        leaf.m_vertexList.push_back(vert);
-                        bounds.updateBounds(vert.m_worldCoord);
-                        vertCount++;
+                        auto vertexId = static_cast<std::uint32_t>(leaf.m_vertexList.size());
+                        //autosprites are expanded from gl_VertexID, their vertices stay in triangle order
+                        if (!shader.m_autoSprite)
+                            vertexId = static_cast<std::uint32_t>(vertexIds.weld(vert.m_worldCoord, static_cast<int>(vertexId), sameVertex(vert)));
+                        if (vertexId == leaf.m_vertexList.size())
+                        {
+                            leaf.m_vertexList.push_back(vert);
+                            bounds.updateBounds(vert.m_worldCoord);
+                            vertCount++;
+                        }
+                        leaf.m_indexList.push_back(vertexId);
+                        indexCount++;
+                    }
+                }
+                for (int i = 0; i < numPatches; ++i)
+                {
+                    if (shader.m_autoSprite) //autosprites are 4 vertex faces
+                    {
+                        Q3PostConsoleMessage(this->getContext(), "Invalid autoSprite face", true);
+                        continue;
                     }
+                    const auto& patch = *patches[i].m_patch;
+                    curFaceId = patches[i].m_faceId;
+                    auto baseVertex = static_cast<std::uint32_t>(leaf.m_vertexList.size());
+                    leaf.m_vertexList.insert(std::end(leaf.m_vertexList), std::begin(patch.m_vertices), std::end(patch.m_vertices));
+                    auto* vertices = leaf.m_vertexList.data() + baseVertex;
+                    adjustLightmapCoords(patch.m_lightmapId, vertices, patch.m_vertices.size());
+                    for (std::size_t j = 0; j < patch.m_vertices.size(); ++j)
+                    {
+                        if( dbgShowLeafs && leaf.m_cluster != -1 )
+                            vertices[j].m_normalTangent.setW(leaf.m_cluster & 255 );
+                        bounds.updateBounds(vertices[j].m_worldCoord);
+                    }
+                    for (auto index : patch.m_indices)
+                        leaf.m_indexList.push_back(baseVertex + index);
+                    vertCount  += static_cast<int>(patch.m_vertices.size());
+                    indexCount += static_cast<int>(patch.m_indices.size());
                 }
-                if (vertCount)
+                if (indexCount)
                 {
                     Q3DrawInfo info(shaderId, lightMapId, leafId, startVert, vertCount, bounds);
+                    info.m_indexStart = startIndex;
+                    info.m_indexCount = indexCount;
+                    //deformed vertices leave the meshlet bounds
+                    if (!shader.m_autoSprite)
+                        OptimizeRange(leaf, info, !shader.m_vertexDeform);
                     addDrawInfo(info, curFaceId);
                 }
             }
@@ -1476,32 +3135,177 @@ namespace Misc
         
 
 
+        //faces grouped by their owning leaf in one pass, in face order
+        IntVector ownedFaces(faceOwners.size());
+        IntVector ownedStart(m_drawLeafs.size() + 1, 0);
+        for (auto owner : faceOwners)
+            if (owner != -1)
+                ownedStart[owner + 1]++;
+        for (std::size_t i = 1; i < ownedStart.size(); ++i)
+            ownedStart[i] += ownedStart[i - 1];
+        {
+            auto next = ownedStart;
+            for (int i = 0; i < static_cast<int>(faceOwners.size()); ++i)
+                if (faceOwners[i] != -1)
+                    ownedFaces[next[faceOwners[i]]++] = i;
+        }
+
+        const auto& commandList = m_context->getSystem<App::CommandStack>()->getCommandList();
+        auto worldBuffer  = commandList.getVariable<int>("r_worldBuffer") != 0;
+        auto compactVerts = commandList.getVariable<int>("r_compactVertices") != 0;
+        auto TriangleKey = [](const Q3Triangle& triangle) { return std::make_pair(triangle.m_shaderId, triangle.m_lightmapId); };
+        auto PatchKey	 = [](const LeafPatch& patch) { return std::make_pair(patch.m_patch->m_shaderId, patch.m_atlasId); };
+        IntVector leafFaces;
+        std::vector<LeafPatch> leafPatches;
         for (auto& leaf : m_drawLeafs )
         {
-            TriangleList triangeList = GetTrianglesForLeaf( this, leaf.m_leafId, 0 ); //triangles sorted by shader id
-            if (triangeList.empty())
+            if (loadCancelled())
+                return;
+            auto firstOwned = ownedStart[leaf.m_leafId];
+            auto numOwned	= ownedStart[leaf.m_leafId + 1] - firstOwned;
+            leafFaces.clear();
+            leafPatches.clear();
+            for (int i = firstOwned; i < firstOwned + numOwned; ++i)
+            {
+                auto faceId			= ownedFaces[i];
+                const auto& face	= m_faceList[faceId];
+                const auto* patch	= face.m_faceType == PATCHFACE ? tesselatePatchFace(face, faceId) : nullptr;
+                if (!patch)
+                {
+                    leafFaces.push_back(faceId);
+                    continue;
+                }
+                //no vertices, only the atlas id
+                leafPatches.push_back({ patch, faceId, adjustLightmapCoords(patch->m_lightmapId, nullptr, 0) });
+                m_numPatches++;
+            }
+            std::sort(std::begin(leafPatches), std::end(leafPatches), [&PatchKey](const LeafPatch& a, const LeafPatch& b)
+            {
+                return PatchKey(a) < PatchKey(b);
+            });
+            TriangleList triangeList = GetTrianglesForLeaf( this, leafFaces.data(), static_cast<int>(leafFaces.size()), 0 ); //triangles sorted by shader id
+            if (triangeList.empty() && leafPatches.empty())
                 continue;
 
+            //both lists are sorted by shader & atlas, each group of either or both becomes a draw range
             TriangleList faceList;
-            auto lastShaderId = triangeList[0].m_shaderId;
-            for (const auto& triangle : triangeList ) 
+            std::size_t nextTriangle = 0;
+            std::size_t nextPatch	 = 0;
+            while (nextTriangle < triangeList.size() || nextPatch < leafPatches.size())
             {
-                auto  curShaderId = triangle.m_shaderId;				
-                if (lastShaderId != curShaderId)
-                {
-                    AddVertices( faceList, leaf ); //sort by triangles face id
-                    lastShaderId = curShaderId;				
-                }
-                faceList.push_back(triangle);
+                auto key = nextTriangle < triangeList.size() ? TriangleKey(triangeList[nextTriangle]) : PatchKey(leafPatches[nextPatch]);
+                if (nextPatch < leafPatches.size())
+                    key = std::min(key, PatchKey(leafPatches[nextPatch]));
+                while (nextTriangle < triangeList.size() && TriangleKey(triangeList[nextTriangle]) == key)
+                    faceList.push_back(triangeList[nextTriangle++]);
+                auto firstPatch = nextPatch;
+                while (nextPatch < leafPatches.size() && PatchKey(leafPatches[nextPatch]) == key)
+                    ++nextPatch;
+                AddVertices(faceList, leafPatches.data() + firstPatch, static_cast<int>(nextPatch - firstPatch), leaf); //sort by triangles face id
             }
-            if ( !faceList.empty() )
+            leaf.m_drawInfoList.assign(std::begin(leafDrawInfos), std::end(leafDrawInfos));
+            leaf.m_meshlets.assign(std::begin(leafMeshlets), std::end(leafMeshlets));
+            leafDrawInfos.clear();
+            leafMeshlets.clear();
+            if (leaf.m_vertexList.empty() || worldBuffer) //sky only
+                continue;
+
+            //the leaf is done, its vertices don't change anymore
+            auto drawLeaf = &leaf;
+            std::shared_ptr<CompactVertexList> compact;
+            if (compactVerts)
             {
-                AddVertices(faceList, leaf);
-            }	
-            
-            
-            leaf.m_vaoBuffer = CreateVAO( m_context, leaf.m_vertexList.data(), leaf.m_vertexList.size());
+                compact = std::make_shared<CompactVertexList>(leaf.m_vertexList.size());
+                compactLeafVertices(leaf, leaf.m_vertexList.data(), compact->data());
+            }
+            enqueueGpuJob([this, drawLeaf, compact]()
+            {
+                drawLeaf->m_vaoBuffer	= CreateVAO( m_context, drawLeaf->m_vertexList.data(), drawLeaf->m_vertexList.size(), compact.get() );
+                drawLeaf->m_indexBuffer = CreateIndexBuffer( drawLeaf->m_vaoBuffer, drawLeaf->m_indexList.data(), 
+                    drawLeaf->m_indexList.size(), drawLeaf->m_vertexList.size() );
+            });
         }				
+        if (m_cacheTriangles)
+        {
+            std::ostringstream acmr;
+            acmr << "Index ACMR: " << static_cast<float>(m_cacheMissesBefore) / m_cacheTriangles
+                << " -> " << static_cast<float>(m_cacheMissesAfter) / m_cacheTriangles;
+            Q3PostConsoleMessage( m_context, acmr.str() );
+        }
+        if (worldBuffer)
+            buildWorldBuffer( compactVerts );
+        reportCompactVertices();
+    }
+
+    void Q3BspFile::compactLeafVertices( Q3DrawLeaf& leaf, const Vertex* vertices, Q3CompactVertex* result )
+    {
+        Q3_PROFILE_SCOPE( "compact vertices" );
+        //one position grid for the whole map, a position shared by ranges of any leafs quantizes the same.
+        //the world bounds hold every vertex, patches stay within their control points
+        const auto positions = ComputePositionDecode(m_worldBounds.getMin(), m_worldBounds.getMax());
+        for (auto& info : leaf.m_drawInfoList)
+        {
+            const auto* first = vertices + info.m_vertexStart;
+            info.m_decode = ComputeVertexDecode(positions, first, info.m_vertexCount);
+            EncodeCompactVertices(first, info.m_vertexCount, info.m_decode, result + info.m_vertexStart, m_compactError);
+            m_numCompactVertices += info.m_vertexCount;
+        }
+    }
+
+    void Q3BspFile::reportCompactVertices() const
+    {
+        if (!m_numCompactVertices)
+            return;
+        const auto positions = ComputePositionDecode(m_worldBounds.getMin(), m_worldBounds.getMax());
+        std::ostringstream report;
+        report << "Compact vertices: " << m_numCompactVertices << ", position step " << positions.m_posScale / 65535.0f
+            << ", max error position " << m_compactError.m_position << " st " << m_compactError.m_st << " lightmap " << m_compactError.m_uv;
+        Q3PostConsoleMessage( m_context, report.str() );
+    }
+
+    void Q3BspFile::buildWorldBuffer( bool compactVerts )
+    {
+        Q3_PROFILE_SCOPE( "build world buffer" );
+        std::size_t numVertices = 0;
+        std::size_t numIndices	= 0;
+        for (const auto& leaf : m_drawLeafs)
+        {
+            numVertices += leaf.m_vertexList.size();
+            numIndices	+= leaf.m_indexList.size();
+        }
+        if (numVertices == 0)
+            return;
+
+        //leafs stay back to back in leaf order, the same layout as the cooked map
+        auto vertices = std::make_shared<std::vector<Vertex>>();
+        auto indices  = std::make_shared<std::vector<std::uint32_t>>();
+        vertices->reserve(numVertices);
+        indices->reserve(numIndices);
+        for (auto& leaf : m_drawLeafs)
+        {
+            leaf.m_baseVertex = static_cast<int>(vertices->size());
+            leaf.m_baseIndex  = static_cast<int>(indices->size());
+            vertices->insert(std::end(*vertices), std::begin(leaf.m_vertexList), std::end(leaf.m_vertexList));
+            for (auto index : leaf.m_indexList)
+                indices->push_back(index + leaf.m_baseVertex);
+            for (auto& info : leaf.m_drawInfoList)
+            {
+                info.m_vertexStart += leaf.m_baseVertex;
+                info.m_indexStart  += leaf.m_baseIndex;
+            }
+        }
+        std::shared_ptr<CompactVertexList> compact;
+        if (compactVerts)
+        {
+            compact = std::make_shared<CompactVertexList>(vertices->size());
+            for (auto& leaf : m_drawLeafs)
+                compactLeafVertices(leaf, vertices->data(), compact->data());
+        }
+        enqueueGpuJob([this, vertices, indices, compact]()
+        {
+            m_worldVao		   = CreateVAO( m_context, vertices->data(), vertices->size(), compact.get() );
+            m_worldIndexBuffer = CreateIndexBuffer( m_worldVao, indices->data(), indices->size(), vertices->size() );
+        });
     }
 
     
@@ -1530,8 +3334,29 @@ namespace Misc
 
     TriangleList Q3BspFile::parsePatchFace(const Q3Face& face, int origFaceIdx) const
     {
-        
-        
+        if (const auto* patch = tesselatePatchFace(face, origFaceIdx))
+            return patch->getTriangles(origFaceIdx);
+        //queries after a trim don't grow it again
+        return buildFacePatch(face, origFaceIdx).getTriangles(origFaceIdx);
+    }
+
+    const Q3Patch* Q3BspFile::tesselatePatchFace(const Q3Face& face, int origFaceIdx) const
+    {
+        //faces are tessellated once, every leaf/query after that gets the same lattice
+        if (origFaceIdx < static_cast<int>(m_facePatchIndex.size()) && m_facePatchIndex[origFaceIdx] != -1)
+            return &m_facePatches[m_facePatchIndex[origFaceIdx]];
+        if (m_trimmed)
+            return nullptr;
+
+        if (m_facePatchIndex.size() < m_faceList.size())
+            m_facePatchIndex.resize(m_faceList.size(), -1);
+        m_facePatchIndex[origFaceIdx] = static_cast<int>(m_facePatches.size());
+        m_facePatches.push_back(buildFacePatch(face, origFaceIdx));
+        return &m_facePatches.back();
+    }
+
+    Q3Patch Q3BspFile::buildFacePatch(const Q3Face& face, int origFaceIdx) const
+    {
         Q3Patch newPatch;
         newPatch.m_shaderId		= face.m_texIndex;
         newPatch.m_lightmapId	= face.m_lightmap;
@@ -1540,6 +3365,9 @@ namespace Misc
 
         auto numPatchesX = (newPatch.m_width - 1) / 2;
         auto numPatchesY = (newPatch.m_height - 1) / 2;
+        //faces tessellated outside the leaf build( or with r_patchError 0 ) use the fixed level
+        const auto* levels = origFaceIdx < static_cast<int>(m_patchLevels.size()) && !m_patchLevels[origFaceIdx].m_levelsX.empty() ?
+            &m_patchLevels[origFaceIdx] : nullptr;
 
         newPatch.m_patches.resize(numPatchesX * numPatchesY);
 
@@ -1555,15 +3383,12 @@ namespace Misc
                         cPoint[row * 3 + point] = m_vertexList[vIndex];
                     }
                 }
-                auto tmpTris = newPatch.m_patches[y * numPatchesX + x].tesselate( face, origFaceIdx );	
-                newPatch.m_triangles.insert(newPatch.m_triangles.end(), tmpTris.begin(), tmpTris.end());
-              //  newPatch.calcBounds();			
             }
         }	
+        newPatch.tesselate(levels);
         newPatch.calcBounds();
         newPatch.smoothPatchNormals();
-        m_facePatches.push_back(newPatch);	
-        return newPatch.m_triangles;    
+        return newPatch;
     }
     
     TriangleList Q3BspFile::parseMeshFace(const Q3Face& face, int origFaceIdx) const
@@ -1591,7 +3416,14 @@ namespace Misc
 
     }
 
-    Q3DrawLeaf::Q3DrawLeaf(int leaf, int cluster, int firstBrush, int numBrushes, int firstFace, int numFaces)
+    Q3DrawLeaf::Q3DrawLeaf(const allocator_type& allocator)
+        : Q3DrawLeaf(-1, -1, -1, -1, -1, -1, allocator)
+    {
+
+    }
+
+    Q3DrawLeaf::Q3DrawLeaf(int leaf, int cluster, int firstBrush, int numBrushes, int firstFace, int numFaces, 
+        const allocator_type& allocator)
         : m_leafId(leaf)
         , m_cluster(cluster)
         , m_firstBrush(firstBrush)
@@ -1599,10 +3431,28 @@ namespace Misc
         , m_firstFace(firstFace)
         , m_numFaces(numFaces)
         , m_hasSky(false)
+        , m_baseVertex(0)
+        , m_baseIndex(0)
+        , m_drawInfoList(allocator)
+        , m_sharedLeafs(allocator)
+        , m_meshlets(allocator)
     {
 
     }
 
+    //assignment keeps the allocator of the target, the lists end up in 'allocator'
+    Q3DrawLeaf::Q3DrawLeaf(const Q3DrawLeaf& other, const allocator_type& allocator)
+        : Q3DrawLeaf(allocator)
+    {
+        *this = other;
+    }
+
+    Q3DrawLeaf::Q3DrawLeaf(Q3DrawLeaf&& other, const allocator_type& allocator)
+        : Q3DrawLeaf(allocator)
+    {
+        *this = std::move(other);
+    }
+
     Q3DrawLeaf::Q3DrawLeaf(const Q3BspLeaf& leafNode, int leafId) : m_leafId(leafId)
         , m_cluster(leafNode.m_visCluster)
         , m_firstBrush(leafNode.m_firstLeafBrush)
@@ -1610,6 +3460,8 @@ namespace Misc
         , m_firstFace(leafNode.m_firstLeafFace)
         , m_numFaces(leafNode.m_numLeafFaces)
         , m_hasSky(false)
+        , m_baseVertex(0)
+        , m_baseIndex(0)
     {
         m_bounds.setMin(Math::Vector3f(leafNode.m_min[0], leafNode.m_min[1], leafNode.m_min[2]));
         m_bounds.setMax(Math::Vector3f(leafNode.m_max[0], leafNode.m_max[1], leafNode.m_max[2]));
@@ -1619,6 +3471,12 @@ namespace Misc
     {
 
     }
+
+    Q3IndexBuffer::~Q3IndexBuffer()
+    {
+        if (m_buffer)
+            glDeleteBuffers(1, &m_buffer);
+    }
         
     Q3DrawSky::Q3DrawSky(App::EngineContext* context, Q3ShaderPtr& shader, float width, float height )
         : m_context( context )
@@ -1715,11 +3573,35 @@ namespace Misc
         ResourceWrapper<VertexArrayObject>  vao(m_vaoBuffer);
 
 		 shader->m_useSkyBox.setData(1);
+		//the sky box is never compacted, the decode of the last world draw would move it
+		const Q3VertexDecode identity;
+		shader->m_posOffset.setData(identity.m_posOffset);
+		shader->m_posScale.setData(identity.m_posScale);
+		shader->m_stOffset.setData(identity.m_stOffset);
 
 		vao->setDrawInformation( GL_TRIANGLES, 0, 30, false );
 		vao->draw();
     }
 
+	Q3DrawCluster::Q3DrawCluster(const allocator_type& allocator)
+		: m_visibleClusters(allocator)
+		, m_visibleLeafs(allocator)
+	{
+
+	}
+
+	Q3DrawCluster::Q3DrawCluster(const Q3DrawCluster& other, const allocator_type& allocator)
+		: Q3DrawCluster(allocator)
+	{
+		*this = other;
+	}
+
+	Q3DrawCluster::Q3DrawCluster(Q3DrawCluster&& other, const allocator_type& allocator)
+		: Q3DrawCluster(allocator)
+	{
+		*this = std::move(other);
+	}
+
 	bool Q3DrawCluster::containsLeaf(int leafIdx) const
 	{
 		return std::find(std::begin(m_visibleLeafs), std::end(m_visibleLeafs), leafIdx) != std::end(m_visibleLeafs);
@@ -1,14 +1,27 @@
 #pragma once
 #include <map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
 #include <Resource/IResource.hpp>
 #include <Engine/RootObject.hpp>
 #include <App/AppTypeDefs.h>
+#include <Common/Image.h>
 
 #include <App/AppCommon.h>
 #include <Graphics/RenderUniforms.h>
 #include <Misc/Q3BspTypes.h>
 #include <Misc/Q3BSPShader.h>
 #include <Misc/Q3Entities.h>
+#include <Misc/Q3AsyncIO.h>
+#include <Misc/Q3MappedFile.h>
+#include <Misc/Q3CookedMap.h>
+#include <Misc/Q3MapArena.h>
+#include <Misc/Q3HugePages.h>
+#include <Misc/Q3Meshlets.h>
 
 namespace App
 {
@@ -26,27 +39,83 @@ namespace Misc
 {
 	struct Q3DrawInfo;
 	struct Q3DrawCluster;	
+	class Q3TextureStreamer;
+	class Q3TexturePrefetcher;
 	
 	using PortalView	  = std::shared_ptr<App::IView>;
-	using DrawList		  = std::vector<Q3DrawInfo>;	
+	using DrawList		  = Q3ArenaVector<Q3DrawInfo>;	
 	using DrawListPtr	  = std::vector<Q3DrawInfo*>;
 	using EntityList	  = std::vector<Q3EntityPtr>;	
 	using Q3ShaderList    = std::vector<Q3ShaderPtr>;
 	using ShaderCache	  = std::map<String, Q3ShaderPtr>;
-	using ClusterCache	  = std::map<int, Q3DrawCluster >;
+	using ClusterCache	  = Q3ArenaMap<int, Q3DrawCluster >;
+
+	/*
+		@brief: Stages of a map load, in order. Parsing, shaders & geometry run on the load thread,
+		gpu work is queued for the main thread while they run
+	*/
+	enum eQ3LoadStage
+	{
+		LOAD_STAGE_IDLE = 0,
+		LOAD_STAGE_PARSING,		//header, shader scripts, lumps & lightmap atlases
+		LOAD_STAGE_SHADERS,		//shaders used by this map
+		LOAD_STAGE_GEOMETRY,	//clusters, entities & leaf triangles
+		LOAD_STAGE_UPLOAD,		//cpu work done, waiting for the remaining gpu jobs
+		LOAD_STAGE_DONE,
+		LOAD_STAGE_FAILED,
+		LOAD_STAGE_CANCELLED
+	};
+
+	/*
+		@brief: Element buffer of a leaf, bound to the leaf vao. Leafs below 64k vertices use 16 bit indices
+	*/
+	struct Q3IndexBuffer
+	{
+		Q3IndexBuffer() = default;
+		Q3IndexBuffer( const Q3IndexBuffer& ) = delete;
+		Q3IndexBuffer& operator = ( const Q3IndexBuffer& ) = delete;
+		~Q3IndexBuffer();
+
+		unsigned				m_buffer	= 0;
+		unsigned				m_indexType = 0;	//GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		unsigned				m_indexSize = 0;
+	};
+	using Q3IndexBufferPtr = std::shared_ptr<Q3IndexBuffer>;
+
+	/*
+		@brief: Shader properties the geometry is built from, copied from the shaders before their gpu jobs are queued
+	*/
+	struct Q3ShaderFlags
+	{
+		std::uint32_t			m_surfaceFlags = 0;
+		std::uint32_t			m_autoSprite   = 0;		//VD_AUTOSPRITE & VD_AUTOSPRITE2 bits
+		bool					m_vertexDeform = false;
+	};
 
 	/*
 		@brief: Quake III Leaf node
 	*/
 	struct Q3DrawLeaf
 	{
+		//draw lists come from the map arena when the leaf is stored in an arena vector
+		using allocator_type = std::pmr::polymorphic_allocator<char>;
 		
 		Q3DrawLeaf();
 
+		explicit Q3DrawLeaf( const allocator_type& allocator );
+
 		explicit Q3DrawLeaf(const Q3BspLeaf& leafNode, int leafId );
 
 		explicit Q3DrawLeaf( int leaf, int cluster, int firstBrush, 
-							 int numBrushes, int firstFace, int numFaces );
+							 int numBrushes, int firstFace, int numFaces,
+							 const allocator_type& allocator = allocator_type() );
+
+		Q3DrawLeaf( const Q3DrawLeaf& other, const allocator_type& allocator );
+		Q3DrawLeaf( Q3DrawLeaf&& other, const allocator_type& allocator );
+		Q3DrawLeaf( const Q3DrawLeaf& ) = default;
+		Q3DrawLeaf( Q3DrawLeaf&& ) = default;
+		Q3DrawLeaf& operator = ( const Q3DrawLeaf& ) = default;
+		Q3DrawLeaf& operator = ( Q3DrawLeaf&& ) = default;
 
 		~Q3DrawLeaf();	
 		
@@ -61,9 +130,15 @@ namespace Misc
 		bool					m_hasSky;
 
 		Math::BBox3f			m_bounds;		
-		VaoBuffer				m_vaoBuffer;
+		int						m_baseVertex;	//offset of this leaf in the world buffer
+		int						m_baseIndex;
+		VaoBuffer				m_vaoBuffer;	//per leaf layout only
+		Q3IndexBufferPtr		m_indexBuffer;
 		DrawList				m_drawInfoList;
-		VertexVector				m_vertexList;	
+		Q3ArenaVector<int>		m_sharedLeafs;	//owners of faces this leaf references but doesn't own
+		Q3ArenaVector<Q3Meshlet>	m_meshlets;		//of the draw infos, culled one by one( r_cullMeshlets )
+		VertexVector				m_vertexList;	//heap, released by trimLoadData
+		std::vector<std::uint32_t>	m_indexList;	//heap, released by trimLoadData
 
 	private:	
 
@@ -124,15 +199,24 @@ namespace Misc
 	*/
 	struct Q3DrawCluster
 	{
+		//visibility lists come from the map arena when the cluster is stored in the cluster cache
+		using allocator_type = std::pmr::polymorphic_allocator<char>;
 		
 		Q3DrawCluster() = default;
+		explicit Q3DrawCluster( const allocator_type& allocator );
+		Q3DrawCluster( const Q3DrawCluster& other, const allocator_type& allocator );
+		Q3DrawCluster( Q3DrawCluster&& other, const allocator_type& allocator );
+		Q3DrawCluster( const Q3DrawCluster& ) = default;
+		Q3DrawCluster( Q3DrawCluster&& ) = default;
+		Q3DrawCluster& operator = ( const Q3DrawCluster& ) = default;
+		Q3DrawCluster& operator = ( Q3DrawCluster&& ) = default;
 
 		bool				containsLeaf(int leafIdx) const;
 		
 		Math::BBox3f		m_clusterBounds;
 		EntityList			m_staticEntities;
-		IntVector			m_visibleClusters;
-		IntVector			m_visibleLeafs;
+		Q3ArenaVector<int>	m_visibleClusters;
+		Q3ArenaVector<int>	m_visibleLeafs;
 
 	};
 		
@@ -145,7 +229,7 @@ namespace Misc
 	
 	public:
 		using DrawSkyPtr	= std::shared_ptr<Q3DrawSky>;		
-		using DrawLeafNodes = std::vector<Q3DrawLeaf>;
+		using DrawLeafNodes = Q3ArenaVector<Q3DrawLeaf>;
 		
 
 		explicit Q3BspFile				( App::EngineContext* context );
@@ -153,12 +237,39 @@ namespace Misc
 
 
 		bool							isLoaded() const;
+		/*
+			@brief: True when a load got to( or past ) 'stage', state built by earlier stages can be used
+		*/
+		bool							isLoaded( eQ3LoadStage stage ) const;
+		eQ3LoadStage					getLoadStage() const { return m_loadStage; }
+		/*
+			@brief: Rough progress of the current load in [0,1]
+		*/
+		float							getLoadProgress() const;
 		String							getMapName() const { return m_fileName; }
 
 		/*
-		*@brief: Opens a Quake III file 
+		*@brief: Opens a Quake III file, blocks until the map is loaded. Runs the async load & its
+		* gpu jobs until it's done
 		*/
 		bool							loadFile(const String& mapName);
+
+		/*
+		*@brief: Start loading a Quake III file on a background thread, call updateLoad every frame
+		* until it returns true. Posts MAP_LOAD_PROGRESS when the stage changes & MAP_INITIALIZED when done
+		*/
+		bool							beginLoadAsync(const String& mapName);
+
+		/*
+		*@brief: Run queued gpu work( lightmaps, textures, shaders & vaos ) for 'budgetMs' on the render
+		* thread, at least one job per call. Returns true when the load is done, failed or was cancelled
+		*/
+		bool							updateLoad( float budgetMs );
+
+		/*
+		*@brief: Stop a load in flight & clear what was loaded so far
+		*/
+		void							cancelLoad();
 		static bool						MapExist( ContextPointer context, const String& mapName);
 		
 		/*
@@ -241,43 +352,87 @@ namespace Misc
 		*/
 		Q3DrawCluster&					getVisibleClusters(int clusterId);
 
+		/*
+			Visible leafs of a cluster that's already cached, nullptr otherwise. Never adds to the cache
+		*/
+		const Q3DrawCluster*			findVisibleClusters(int clusterId) const;
+
 				
 		/*
 		*  @brief: Returns a description/stats of this map
 		*/
 		String							toString() const;
 
+		/*
+		*  @brief: Release what only the load needed( leaf vertices, patches, entity string, .. ) & compact
+		*  what the face queries & portals still use, returns the released bytes. Done after every load
+		*  when r_trimMapData is set
+		*/
+		std::size_t						trimLoadData();
+
+		/*
+		*  @brief: Bytes held by the cpu side of this map, per container
+		*/
+		String							memoryReport() const;
+
+		/*
+		*  @brief: Time leaf lookups, cluster visibility & leaf culling for 'numQueries' random positions
+		*  & count their data TLB misses where perf events are available. Compares page modes( r_hugePages )
+		*  between loads of the same map, runs after a load with dbg_benchmarkQueries set
+		*/
+		String							benchmarkQueries( int numQueries );
+
+		/*
+		*  @brief: Tessellate every patch block of this map 'numRuns' times with the per vertex reference,
+		*  the triangles of the grid tessellator & the SoA grids alone. Runs after a load with dbg_benchmarkPatches set
+		*/
+		String							benchmarkPatches( int numRuns );
 
+		/*
+		*  @brief: Run the image kernels( SIMD & scalar ) 'numRuns' times over the lightmap pages of this map
+		*  & check that both paths agree. Runs after a load with dbg_benchmarkImageKernels set
+		*/
+		String							benchmarkImageKernels( int numRuns );
+
+
+		Q3HugePageResource				m_hugePages;	//backs the arena blocks, mode set per load( r_hugePages )
+		Q3MapArena						m_arena;		//map lifetime containers below, declared first so it outlives them
 		Math::BBox3f					m_worldBounds;
 		DrawLeafNodes					m_drawLeafs;	//all the leaf nodes that can be drawn	
+		VaoBuffer						m_worldVao;		//geometry of all leafs with r_worldBuffer, leafs have no vao then
+		Q3IndexBufferPtr				m_worldIndexBuffer;
 		EntityList						m_entityList;	//entities found for this map
 		Q3ShaderList					m_shaders;		//active & compiled shaders
+		std::vector<Q3ShaderFlags>		m_shaderFlags;	//of m_shaders, for the load thread
 		DrawSkyPtr						m_skyBox;		//skybox if any
-		ShaderCache						m_shaderLUT;	//shader cache todo make this global?		
-		TexturePtr						m_lightmap;		//single lightmap texture
+		ShaderCache						m_shaderLUT;	//name lookup for this map, shaders live in Q3ShaderRegistry		
+		TexturePtrVector				m_lightmaps;	//all lightmap atlases
+		std::vector<Q3LightmapPage>		m_lightmapPages;//atlas location for each bsp lightmap
 		PlaneVector						m_planeList;
 		ClusterCache					m_clusterList;				
 
 		String							m_fileName;
 		Q3Header						m_fileHeader;
+		Q3MappedFile					m_mapFile;		//backs the read-only lump views below
 		
 		int								m_numVisClusters;
 		int								m_bytesPerVisCluster;
 
-		std::vector<std::uint8_t>				m_visData;
+		Q3LumpView<std::uint8_t>		m_visData;
+		Q3ArenaVector<std::uint8_t>		m_visStorage;	//copy of the vis data that m_visData points to with r_hugePages
 		std::vector<std::uint8_t>				m_entityString;		
 		std::vector<Q3ShaderInfo>		m_textureList;
-		std::vector<Q3BspNode>			m_nodeList;		
-		std::vector<Q3LeafFace>			m_leafFaceList;
-		std::vector<Q3LeafBrush>		m_leafBrushList;
-		std::vector<Q3Model>			m_modelList;
-		std::vector<Q3Brush>			m_brushList;
-		std::vector<Q3BrushSide>		m_brushSidesList;
-		std::vector<Q3MeshVertices>		m_meshVertexList;
-		std::vector<Q3Effect>			m_effectList;
-		std::vector<Q3Face>				m_faceList;		
-		std::vector<Q3LightVolume>		m_lightVolumeList;
-		std::vector<Vertex>				m_vertexList;		
+		Q3ArenaVector<Q3BspNode>		m_nodeList;		
+		Q3LumpView<Q3LeafFace>			m_leafFaceList;
+		Q3LumpView<Q3LeafBrush>			m_leafBrushList;
+		Q3ArenaVector<Q3Model>			m_modelList;
+		Q3LumpView<Q3Brush>				m_brushList;
+		Q3LumpView<Q3BrushSide>			m_brushSidesList;
+		Q3LumpView<Q3MeshVertices>		m_meshVertexList;
+		Q3ArenaVector<Q3Effect>			m_effectList;
+		Q3ArenaVector<Q3Face>			m_faceList;		
+		Q3LumpView<Q3LightVolume>		m_lightVolumeList;
+		Q3ArenaVector<Vertex>			m_vertexList;		
 		std::vector<Q3Triangle>			m_faceTriangles;
 	
 	private:
@@ -301,14 +456,56 @@ namespace Misc
 
 		/*
 		@brief: Build a vao-buffer for input leafs, also tries to merge shaders/triangles
-		into a bigger group.
+		into a bigger group. Leafs only triangulate the faces they own( 'faceOwners' )
+		*/
+		void							buildVAOForLeafs( const IntVector& faceOwners );	
+
+		/*
+		@brief: Give every face one owning leaf, the first leaf that references it. Autosprites go to
+		the leaf of their center. Other leafs referencing a face get its owner as shared leaf, returns
+		the owner per face( -1 if no leaf draws it )
 		*/
-		void							buildVAOForLeafs();	
+		IntVector						assignFaceOwners();
+
+		/*
+		@brief: Pick the tessellation level of each patch column/row so its chords stay within 'maxError'
+		world units of the curve( r_patchError ). Patch edges shared with other patches are raised to the
+		highest level on either side so they don't crack, 0 tessellates every patch at the fixed level
+		*/
+		void							computePatchLevels( float maxError );
+
+		/*
+		@brief: Tessellate the patch faces drawn by a leaf & weld their normals across the seams between
+		faces, the leafs pick the cached triangles up afterwards
+		*/
+		void							smoothPatchSeams( const IntVector& faceOwners );
+
+		/*
+		@brief: Move the leaf draw infos onto one map wide vertex & index buffer( r_worldBuffer ),
+		their ranges become absolute. The leafs keep their own lists for the cooked map, 'compactVerts'
+		uploads the compact vertex layout
+		*/
+		void							buildWorldBuffer( bool compactVerts );
+
+		/*
+		@brief: Compact copy of a leaf's vertices for r_compactVertices. Positions of the map share one grid,
+		texture coordinates are offset per draw info range, 'vertices' & 'result' are indexed like the draw infos
+		*/
+		void							compactLeafVertices( Q3DrawLeaf& leaf, const Vertex* vertices, Q3CompactVertex* result );
+
+		/*
+		@brief: Console report of the compact vertex precision
+		*/
+		void							reportCompactVertices() const;
 	
 		/*
 		 * @Update lightmap coordinates
 		 */
 		void							adjustLightmapCoords( TriangleList& triangles ) const;
+		/*
+		 * @brief: Move 'vertices' of lightmap 'lightmapId' into its atlas, returns the atlas id
+		 */
+		int								adjustLightmapCoords( int lightmapId, Vertex* vertices, std::size_t numVertices ) const;
 		/*
 		 * @brief: Triangulate poly face
 		 */
@@ -318,6 +515,14 @@ namespace Misc
 		*/
 		TriangleList					parsePatchFace( const Q3Face& face, int origFaceIdx) const;
 		/*
+		* @brief: Curved face tessellated into its vertex lattice, not cached
+		*/
+		Q3Patch							buildFacePatch( const Q3Face& face, int origFaceIdx ) const;
+		/*
+		* @brief: Curved face tessellated once & kept in m_facePatches, null once the load data is trimmed
+		*/
+		const Q3Patch*					tesselatePatchFace( const Q3Face& face, int origFaceIdx ) const;
+		/*
 		* @brief: Parse model face
 		*/
 		TriangleList					parseMeshFace(const Q3Face& face, int origFaceIdx) const;		
@@ -326,13 +531,45 @@ namespace Misc
 		*/
 		TriangleList					parseBillBoardFace(const Q3Face& face, int origFaceIdx) const;
 
+		/*
+		*	@brief: Cpu side of a load, runs on the load thread for both kinds of loads, false when the
+		*	map is invalid or the load was cancelled
+		*/
+		bool							runLoadStages( const String& fileName, const Q3ShaderPtr& fallbackShader );
+
+		void							setLoadStage( eQ3LoadStage stage );
+		bool							loadCancelled() const { return m_cancelLoad; }
+
+		/*
+		*	@brief: Queue work that needs the gpu/main thread, jobs run in order from updateLoad
+		*/
+		void							enqueueGpuJob( std::function<void()> job );
+
+		/*
+		*	@brief: Record the load with the load profiler( dbg_profileLoad ), the report is written
+		*	next to the map as <map>.load.json & <map>.trace.json( chrome://tracing ) when it finishes
+		*/
+		void							beginLoadProfile( const String& fileName );
+		void							endLoadProfile();
+
+		/*
+		*	@brief: Run 'job' on the main thread & wait for it, used for entities which hook into the event
+		*	system. Always queued, loadFile runs the queue while it waits on the load thread
+		*/
+		bool							runOnMainThread( std::function<void()> job );
+
 		/*
 		*	@brief: Offset map so that it's min bounds are at the origin(0,0,0)
 		*/
 		void							offsetMap( const Math::Vector3f& offset );
 		
 		/*
-		*	@brief: parse Quake III lumps, returns false upon failure
+		*	@brief: parse the header, entity & texture lumps of the mapped file, returns false upon failure
+		*/
+		bool							parseTextureLumps();
+
+		/*
+		*	@brief: parse the remaining Quake III lumps from the mapped file, returns false upon failure
 		*/
 		bool							parseLumps( const String& fileName );
 		
@@ -346,32 +583,105 @@ namespace Misc
 		*/
 		bool							parseEntityString();
 
+		/*
+		* @brief: Start reading all shader scripts in the background
+		*/
+		using ShaderScriptReads = std::vector<std::pair<String, Q3AsyncReader::Ticket>>;
+		ShaderScriptReads				beginShaderDirectoryRead() const;
+
 		/*
 		* @brief: Cache shader directory e.g. loads all shaders, but doesn't load textures
-		* or generate GLSL code
+		* or generate GLSL code. Scripts are parsed in order as their reads complete
 		*/
-		bool							parseShaderDirectory();			
+		bool							parseShaderDirectory( const ShaderScriptReads& scripts );
 
 		/*
-		 * @brief: Load&compile shaders found in this map, return
-		 * the succesfully loaded shadrs
+		* @brief: Resolve the textures used by this map through the shader LUT & start reading them
+		*/
+		void							prefetchTextures();
+
+		/*
+		* @brief: Hash of everything the cooked map is derived from: the bsp header, the shaders it
+		* references & the settings that change the generated geometry. The bsp itself is matched by the
+		* cooked map( Q3CookedSource )
+		*/
+		std::uint64_t					cookedMapKey() const;
+
+		/*
+		* @brief: Fill the cluster cache/draw leafs from the opened cooked map, false if it's inconsistent
+		*/
+		bool							loadCookedClusters();
+		bool							loadCookedLeafs();
+
+		/*
+		* @brief: Write clusters, leaf vertices & draw info to a cooked map at 'path'
+		*/
+		bool							saveCookedMap( const String& path, std::uint64_t key ) const;
+
+		/*
+		 * @brief: Find the shaders used by this map in the shader LUT, falls back to
+		 * regular shaders( or 'fallbackShader' ) for textures without a script
 		 */
-		bool							loadShaders();					
+		bool							resolveShaders( const Q3ShaderPtr& fallbackShader );
 
 		/*
-		 * @brief: Load the lightmaps from this map file & combine them 
-		 * into single texture
+		 * @brief: Queue texture loading & GLSL generation for the shaders of this map
 		 */
-		bool							loadLightMaps( const std::vector<Q3LightMap>& lightmaps );		
+		void							uploadShaders();
 
+		/*
+		 * @brief: Load the lightmaps from this map file & pack them into one or more
+		 * near square atlases( r_lightmapAtlasSize, r_lightmapPadding ), atlases are uploaded by a gpu job.
+		 * A negative padding uses the default, the mip chain ends at the level the padding still covers
+		 */
+		bool							loadLightMaps( const Q3LumpView<Q3LightMap>& lightmaps );		
 
-		bool							m_loaded;		
+		/*
+		 * @brief: Bytes the map arena needs for this map, from the lump sizes in the header
+		 */
+		std::size_t						arenaSizeHint() const;
+		void							uploadLightMaps();
+
+		using MemoryUsage = std::vector<std::pair<String, std::size_t>>;
+		MemoryUsage						memoryUsage() const;
+
+
+		std::atomic<bool>				m_loaded;		
 		mutable int						m_numPolyFaces;
 		mutable int						m_numPatches;
 		mutable int						m_numMeshFaces;
 		mutable int						m_numBillBoards;
-
-		mutable std::vector<Q3Patch>	m_facePatches;
+		std::size_t						m_cacheTriangles;		//draw range triangles, ACMR of the leaf build( r_optimizeIndices )
+		std::size_t						m_cacheMissesBefore;
+		std::size_t						m_cacheMissesAfter;
+		std::size_t						m_numCompactVertices;	//uploaded in the compact layout( r_compactVertices )
+		Q3CompactError					m_compactError;
+
+		mutable std::vector<Q3Patch>	m_facePatches;			//one per tessellated patch face
+		mutable IntVector				m_facePatchIndex;		//face id -> m_facePatches, -1 when not tessellated yet
+		std::vector<Q3PatchLevels>		m_patchLevels;			//per face, empty for the fixed level
+		bool							m_trimmed;				//load only data was released, see trimLoadData
+		std::vector<std::uint32_t>		m_leafDrawFrame;		//last draw a leaf was added to the draw lists
+		std::uint32_t					m_drawFrame;
+		std::deque<Q3DrawInfo>			m_meshletDraws;			//visible meshlet runs of the current draw, deque keeps them in place
+		int								m_culledTriangles;		//by meshlet culling in the last draw
+
+		std::unique_ptr<Q3TextureStreamer>	m_textureStreamer;	//background texture loading( r_streamTextures )
+		std::unique_ptr<Q3TexturePrefetcher> m_texturePrefetcher;	//texture reads started before the shaders are uploaded
+		std::map<String, std::uint64_t>	m_shaderScriptHashes;	//contents hash per shader script, keys cooked maps
+		Q3CookedMap						m_cookedMap;
+
+		std::vector<Common::Image>		m_lightmapImages;		//atlases waiting for upload
+		int								m_numLightmapAtlases;
+
+		std::thread						m_loadThread;
+		std::atomic<eQ3LoadStage>		m_loadStage;
+		eQ3LoadStage					m_postedStage;			//last stage listeners were told about
+		std::atomic<bool>				m_cancelLoad;
+		std::mutex						m_gpuJobMutex;
+		std::deque<std::function<void()>> m_gpuJobs;
+		std::atomic<int>				m_numGpuJobs;
+		std::atomic<int>				m_numGpuJobsDone;
 		
 	};
 
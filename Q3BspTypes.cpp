@@ -1,7 +1,56 @@
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+#include <IO/EngineFileStream.hpp>
+#include <ConsoleIncludes.h>
+#include <Misc/Q3ImageKernels.h>
+#include <Misc/Q3PatchKernels.h>
+#include <Misc/Q3VertexWeld.h>
 #include <Misc/Q3BspTypes.h>
 
 namespace Misc
 {
+	static_assert(Q3BiQuadPatch::MAX_TESS_LEVEL <= MAX_PATCH_LEVEL, "Patch levels past the SIMD basis fall back to scalar");
+
+	bool Q3ReadFile(App::EngineContext* context, const String& path, std::vector<std::uint8_t>& data)
+	{
+		App::FileInputStream ifs(context);
+		if (!ifs.open(path.c_str(), App::FILE_TYPE_BINARY))
+			return false;
+		data.resize(static_cast<std::size_t>(ifs.getSize()));
+		if (!data.empty())
+			ifs.read(data.data(), static_cast<int>(data.size()));
+		return true;
+	}
+
+	namespace
+	{
+		struct Q3ConsoleMessage
+		{
+			App::EngineContext*	m_context;
+			String				m_message;
+			bool				m_warning;
+		};
+		std::mutex						g_consoleMutex;
+		std::vector<Q3ConsoleMessage>	g_consoleMessages;
+	}
+
+	void Q3PostConsoleMessage(App::EngineContext* context, const String& message, bool warning)
+	{
+		std::lock_guard<std::mutex> lock(g_consoleMutex);
+		g_consoleMessages.push_back({ context, message, warning });
+	}
+
+	void Q3FlushConsoleMessages()
+	{
+		std::vector<Q3ConsoleMessage> messages;
+		{
+			std::lock_guard<std::mutex> lock(g_consoleMutex);
+			messages.swap(g_consoleMessages);
+		}
+		for (const auto& msg : messages)
+			App::AddConsoleMessage(msg.m_context, msg.m_message, msg.m_warning ? App::LOG_LEVEL_WARNING : App::LOG_LEVEL_INFO);
+	}
 
 	void Q3Header::clear()
 	{
@@ -9,6 +58,21 @@ namespace Misc
 		m_Version = 0;
 	}
 
+	bool Q3Header::lumpsInBounds(std::size_t fileSize) const
+	{
+		for (const auto& entry : m_DirEntries)
+		{
+			if (entry.m_Offset < 0 || entry.m_Length < 0)
+				return false;
+			//empty lumps are never viewed, valid maps leave their offsets unaligned
+			if (entry.m_Length && (entry.m_Offset & 3))
+				return false;
+			if (static_cast<std::size_t>(entry.m_Offset) + static_cast<std::size_t>(entry.m_Length) > fileSize)
+				return false;
+		}
+		return true;
+	}
+
 	bool Q3Header::valid() const
 	{
 		return (
@@ -19,43 +83,44 @@ namespace Misc
 	}
 
 
-	TriangleList Q3BiQuadPatch::tesselate(const Q3Face& face, int faceId, int L )
+	TriangleList Q3BiQuadPatch::tesselateReference(const Q3Face& face, int faceId, int LX, int LY )
 	{
 		TriangleList result;
 		
-		const auto L1 = L + 1;
-		const auto step = 1.0f / static_cast<float>(L);
+		const auto L1 = LY + 1;
+		const auto stepX = 1.0f / static_cast<float>(LX);
+		const auto stepY = 1.0f / static_cast<float>(LY);
 	
-		std::vector<App::MeshVertex> vertices(L1 * L1);
+		std::vector<App::MeshVertex> vertices((LX + 1) * L1);
 
 		int i;
-		for (i = 0; i <= TESS_LEVEL; ++i)
-			vertices[i] = Math::evaluateQuadricPatch(m_controls[0], m_controls[3], m_controls[6], i * step);
+		for (i = 0; i <= LY; ++i)
+			vertices[i] = Math::evaluateQuadricPatch(m_controls[0], m_controls[3], m_controls[6], i * stepY);
 
-		for (i = 1; i <= L; ++i)
+		for (i = 1; i <= LX; ++i)
 		{
 			Vertex tmp[3];
 			int j;
 			for (j = 0; j < 3; ++j)
 			{
 				auto k = 3 * j;
-				tmp[j] = Math::evaluateQuadricPatch(m_controls[k + 0], m_controls[k + 1], m_controls[k + 2], i * step);
+				tmp[j] = Math::evaluateQuadricPatch(m_controls[k + 0], m_controls[k + 1], m_controls[k + 2], i * stepX);
 			}
-			for (j = 0; j <= L; ++j)
-				vertices[i * L1 + j] = Math::evaluateQuadricPatch(tmp[0], tmp[1], tmp[2], j * step);
+			for (j = 0; j <= LY; ++j)
+				vertices[i * L1 + j] = Math::evaluateQuadricPatch(tmp[0], tmp[1], tmp[2], j * stepY);
 		}
 
-		std::vector<int> indices(L * L1 * 2);
-		for (auto row = 0; row < L; ++row)
-			for (auto col = 0; col <= L; ++col)
+		std::vector<int> indices(LX * L1 * 2);
+		for (auto row = 0; row < LX; ++row)
+			for (auto col = 0; col <= LY; ++col)
 			{
 				auto offset = row * L1 + col;
 				indices[offset * 2 + 1] = row * L1 + col;
 				indices[offset * 2 + 0] = (row + 1) * L1 + col;
 			}
 
-		auto triPerRow = L * 2;
-		for (auto row = 0; row < L; ++row)
+		auto triPerRow = LY * 2;
+		for (auto row = 0; row < LX; ++row)
 		{
 			auto  startOffset = row * L1 * 2;
 			for (auto verts = 0; verts < triPerRow; verts++)
@@ -77,38 +142,84 @@ namespace Misc
 		return result;
 	}
 
+	int Q3BiQuadPatch::TessLevel(const Math::Vector3f& p0, const Math::Vector3f& p1, const Math::Vector3f& p2, float maxError)
+	{
+		//chords of 1/L of the curve are at most |p0 - 2p1 + p2| / (4L^2) away from it
+		auto bend  = (p0 - p1 * 2.0f + p2).length();
+		auto level = static_cast<int>(std::ceil(std::sqrt(bend / (4.0f * maxError))));
+		return std::min(std::max(level, 1), MAX_TESS_LEVEL);
+	}
+
+	void Q3Patch::tesselate(const Q3PatchLevels* levels)
+	{
+		const auto numX = (m_width - 1) / 2;
+		const auto numY = (m_height - 1) / 2;
+		auto levelX = [levels](int x) { return levels ? levels->m_levelsX[x] : Q3BiQuadPatch::TESS_LEVEL; };
+		auto levelY = [levels](int y) { return levels ? levels->m_levelsY[y] : Q3BiQuadPatch::TESS_LEVEL; };
+		auto latticeX = 1;
+		auto latticeY = 1;
+		for (int x = 0; x < numX; ++x)
+			latticeX += levelX(x);
+		for (int y = 0; y < numY; ++y)
+			latticeY += levelY(y);
+		m_vertices.resize(static_cast<std::size_t>(latticeX) * latticeY);
+		m_indices.clear();
+		m_indices.reserve(static_cast<std::size_t>(latticeX - 1) * (latticeY - 1) * 6);
+
+		//channels keep their capacity from block to block
+		thread_local Q3PatchGrid grid;
+		auto offsetY = 0;
+		for (int y = 0; y < numY; ++y)
+		{
+			auto offsetX = 0;
+			for (int x = 0; x < numX; ++x)
+			{
+				TessellatePatchGrid(m_patches[y * numX + x].m_controls, levelX(x), levelY(y), grid);
+				//block vertex (i, j) is lattice vertex (offsetX + i, offsetY + j), the winding stays the same
+				const auto L1 = static_cast<std::uint32_t>(grid.m_levelY + 1);
+				auto latticeIndex = [=](std::uint32_t index)
+				{
+					return (offsetX + index / L1) * latticeY + offsetY + index % L1;
+				};
+				for (int i = 0; i < grid.numVertices(); ++i)
+					m_vertices[latticeIndex(i)] = grid.getVertex(i);
+				for (auto index : grid.m_indices)
+					m_indices.push_back(latticeIndex(index));
+				offsetX += grid.m_levelX;
+			}
+			offsetY += levelY(y);
+		}
+	}
+
+	TriangleList Q3Patch::getTriangles(int faceId) const
+	{
+		TriangleList result;
+		result.reserve(m_indices.size() / 3);
+		for (std::size_t i = 0; i < m_indices.size(); i += 3)
+		{
+			Q3Triangle newTriangle(m_vertices[m_indices[i]].getNormal(), faceId, m_shaderId, m_lightmapId);
+			newTriangle.m_faceType = PATCHFACE;
+			for (auto j = 0; j < 3; ++j)
+				newTriangle.m_vertices[j] = m_vertices[m_indices[i + j]];
+			result.push_back(newTriangle);
+		}
+		return result;
+	}
+
 	void Q3Patch::calcBounds()
 	{
 		m_bounds.clearBounds();
-		//for (const auto& patch : m_patches)
-		for (const auto& tris :m_triangles)
-		for (const auto& verts : tris.m_vertices)
-			m_bounds.updateBounds(verts.m_worldCoord);
+		for (const auto& vert : m_vertices)
+			m_bounds.updateBounds(vert.m_worldCoord);
 	}
 
 	void Q3Patch::smoothPatchNormals()
 	{
-		static const float EPS = 0.00125f;
 		std::vector<Vertex*> verts;
-		//for (auto& patch : m_patches)
-		for (auto& tris : m_triangles)
-		for (auto& vert : tris.m_vertices)
+		for (auto& vert : m_vertices)
 			verts.push_back(&vert);
-
-		std::vector<Math::Vector3f> normals;		
-		//todo speed up
-		for (auto curVert : verts)
-		{
-			auto normal = curVert->getNormal();
-			for (auto loopVert : verts)
-				if (loopVert->m_worldCoord.distanceSquared( curVert->m_worldCoord) < EPS)
-					normal += loopVert->getNormal();
-			normals.push_back(normal.getNormalized());			
-		}
-		
-		int count = 0;
-		for (auto loopVert : verts)
-			loopVert->setNormal(normals[count++]);
+		//a single patch, every vertex has its shader
+		SmoothWeldedNormals(verts, std::vector<int>(verts.size(), m_shaderId));
 	}
 
 	Misc::Q3Triangle::Q3Triangle()
@@ -155,15 +266,7 @@ namespace Misc
 
 	void Q3LightMap::rescale(float factor)
 	{
-		for (int i = 0; i < 128 * 128 * 3; ++i)
-		{
-			auto val = (&m_lightmapData[0][0][0] + i);
-			float curVal = static_cast<float>(*val) / 255.0f;
-
-			curVal *= factor;
-			curVal = Math::Clamp(0.0f, 1.0f, curVal);
-			*val = static_cast<std::uint8_t>(curVal * 255.0f);
-		}
+		RescaleOverbright(&m_lightmapData[0][0][0], sizeof(m_lightmapData), factor);
 	}
 
 }
\ No newline at end of file
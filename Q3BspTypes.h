@@ -18,6 +18,9 @@ namespace Misc
 	const int			MAX_ENTITIES		= 1 << ENTITY_BITS;
 	const int			MAX_PORTAL_SURFACES = 8;	//max portal surfaces per map
 	const int				PORTAL_FACE_ID		= -666;
+	const int			LIGHTMAP_SIZE		= 128;	//width & height of a single bsp lightmap
+	const int			LIGHTMAP_ATLAS_SIZE = 4096;	//default max lightmap atlas width/height
+	const int			LIGHTMAP_PADDING	= 4;	//default border around each lightmap in the atlas, keeps 2 mip levels
 	
 	
    
@@ -54,6 +57,18 @@ namespace Misc
         return App::getDataPath() + BASE_PATH + MODEL_PATH;
     }
 
+    /*
+        @brief: Read the whole file at 'path' through the engine file stream, false if it can't be opened
+    */
+    bool Q3ReadFile( App::EngineContext* context, const String& path, std::vector<std::uint8_t>& data );
+
+    /*
+        @brief: Console output for code that runs off the main thread( load thread, pool jobs ), the
+        message is queued until the main thread flushes it( Q3BspFile::updateLoad )
+    */
+    void Q3PostConsoleMessage( App::EngineContext* context, const String& message, bool warning = false );
+    void Q3FlushConsoleMessages();
+
 
     enum class eQ3WaveFunc
     {
@@ -243,8 +258,36 @@ namespace Misc
 
         void			clear();
         bool			valid() const;
+
+        /*
+        *@brief: true if all lumps lie within a file of 'fileSize' bytes & lumps with data are 4 byte aligned
+        */
+        bool			lumpsInBounds( std::size_t fileSize ) const;
     };
 
+	/*
+	*@brief: Read-only typed view on lump data in a mapped bsp file
+	*/
+	template<typename T>
+	class Q3LumpView
+	{
+	public:
+		Q3LumpView() : m_data(nullptr), m_size(0) {}
+		Q3LumpView(const T* data, std::size_t size) : m_data(data), m_size(size) {}
+
+		const T*		begin() const						{ return m_data; }
+		const T*		end() const							{ return m_data + m_size; }
+		const T*		data() const						{ return m_data; }
+		std::size_t		size() const						{ return m_size; }
+		bool			empty() const						{ return m_size == 0; }
+		const T&		operator[] (std::size_t idx) const	{ return m_data[idx]; }
+		void			clear()								{ m_data = nullptr; m_size = 0; }
+
+	private:
+		const T*		m_data;
+		std::size_t		m_size;
+	};
+
 
 	/*
 	*@brief: Native quake 3 vertex as found in a bsp file
@@ -386,6 +429,16 @@ namespace Misc
 		void		rescale( float factor );
     };
 
+	/*
+		@brief: Location of a single lightmap inside one of the lightmap atlases
+	*/
+	struct Q3LightmapPage
+	{
+		int				m_atlas;		//index of the atlas texture
+		Math::Vector2f	m_offset;		//uv offset of the page
+		Math::Vector2f	m_scale;		//uv scale of the page
+	};
+
     struct Q3LightVolume
     {
         std::uint8_t		m_rgb[3];
@@ -413,9 +466,19 @@ namespace Misc
     //////////////////////////////////////////////////////////////////////////
     struct Q3BiQuadPatch
     {
-        const static int TESS_LEVEL = 7;
+        const static int TESS_LEVEL		= 7;	//fixed level, used when r_patchError is 0
+        const static int MAX_TESS_LEVEL = 16;
+
+		/*
+			@brief: Triangles of a grid of 'levelX' by 'levelY' quads evaluated a vertex at a time, x runs along
+			the control rows. Reference for TessellatePatchGrid in dbg_benchmarkPatches
+		*/
+		TriangleList				tesselateReference(const Q3Face& face, int faceId, int levelX = TESS_LEVEL, int levelY = TESS_LEVEL);
 
-		TriangleList				tesselate(const Q3Face& face, int faceId, int level = TESS_LEVEL);
+		/*
+			@brief: Quads needed along a quadratic curve so the chords stay within 'maxError' of it
+		*/
+		static int					TessLevel(const Math::Vector3f& p0, const Math::Vector3f& p1, const Math::Vector3f& p2, float maxError);
 
         App::MeshVertex				m_controls[9];
       //  std::vector<Q3Triangle>		m_triangles;
@@ -425,8 +488,30 @@ namespace Misc
     //////////////////////////////////////////////////////////////////////////
     //\Q3BspPatch 
     //////////////////////////////////////////////////////////////////////////
+    /*
+        @brief: Tessellation level per column( x ) & row( y ) of 3x3 blocks of a patch face. Blocks in the same
+        column/row share their edges, so their levels match along them
+    */
+    struct Q3PatchLevels
+    {
+        std::vector<int>				m_levelsX;
+        std::vector<int>				m_levelsY;
+    };
+
     struct Q3Patch
     {
+		/*
+			@brief: Tessellate every block of 'm_patches' into one indexed vertex lattice, block columns( x ) &
+			rows( y ) at 'levels', the fixed level when it's empty. Blocks write the vertices of their shared
+			edges to the same lattice entries. The block grid is scratch storage of the calling thread
+		*/
+		void							tesselate( const Q3PatchLevels* levels );
+
+		/*
+			@brief: The lattice as triangles of 'faceId', for the queries that work on triangles
+		*/
+		TriangleList					getTriangles( int faceId ) const;
+
         void							calcBounds();
 		void							smoothPatchNormals();
         int								m_shaderId;
@@ -434,7 +519,8 @@ namespace Misc
         int								m_width, m_height;
         Math::BBox3f					m_bounds;
         std::vector<Q3BiQuadPatch>		m_patches;
-		TriangleList					m_triangles;
+		std::vector<Vertex>				m_vertices;		//lattice, x major like Q3PatchGrid
+		std::vector<std::uint32_t>		m_indices;
     };
 }//namespace
 
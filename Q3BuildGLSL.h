@@ -78,7 +78,9 @@ namespace Misc
 		"uniform vec3 asMajorDir;	                             \n"
 		"uniform vec3 asCenter;		                             \n"
 		"uniform int  asStartIdx;						         \n"
-		"                                                        \n"
+		"uniform vec3  posOffset   = vec3( 0.0 );                \n" //compact vertex decode
+		"uniform float posScale    = 1.0;                        \n"
+		"uniform vec2  stOffset    = vec2( 0.0 );                \n"
 		"                                                        \n"
 		"layout( std140) uniform Quake3Param                     \n"
 		"{                                                       \n"
@@ -108,7 +110,7 @@ namespace Misc
 		"    mat4 worldToClip = useSkyBox == 1 ? m_skyMatrix : m_wvpMatrix; \n"
 		"    vec3 normalTemp =   unpack_normal_octahedron(normalIn.xy); \n"		
 		"    rgba		   = rgbaIn;                             \n"
-		"    st			   = stIn;                               \n"
+		"    st			   = stOffset + stIn;                    \n"
 		"    uv			   = uvIn;                               \n"
 		"    normal.xyz    = normalTemp;						 \n"
 		"    world		   = getWorld( normalTemp );				 \n"
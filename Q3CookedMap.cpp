@@ -0,0 +1,127 @@
+#include <cstring>
+#include <cstdio>
+#include <Misc/Q3CookedMap.h>
+
+namespace Misc
+{
+	namespace
+	{
+		const std::uint8_t COOKED_MAGIC[4] = { 'Q', '3', 'C', 'M' };
+		const std::size_t  SECTION_ALIGNMENT = 16;
+
+		std::size_t AlignUp(std::size_t value)
+		{
+			return (value + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+		}
+
+		bool SourceMatches(const Q3CookedSource& cooked, const Q3MappedFile& source)
+		{
+			if (cooked.m_size != source.size())
+				return false;
+			//unchanged since it was cooked, skip reading the whole bsp
+			if (source.modifiedTime() != 0 && cooked.m_modifiedTime == source.modifiedTime())
+				return true;
+			return cooked.m_contentHash == HashBytes(source.data(), source.size());
+		}
+	}
+
+	std::uint64_t HashBytes(const void* data, std::size_t size, std::uint64_t seed)
+	{
+		auto bytes = static_cast<const std::uint8_t*>(data);
+		auto hash  = seed;
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool Q3CookedMap::open(const String& path, std::uint64_t sourceKey, std::size_t vertexSize, const Q3MappedFile& source)
+	{
+		close();
+		if (!m_file.open(path))
+			return false;
+
+		Q3CookedHeader header;
+		const auto headerSize = sizeof(Q3CookedHeader) + sizeof(m_sections);
+		if (m_file.size() < headerSize)
+		{
+			close();
+			return false;
+		}
+		std::memcpy(&header, m_file.data(), sizeof(header));
+		std::memcpy(m_sections, m_file.data() + sizeof(header), sizeof(m_sections));
+
+		bool valid = std::memcmp(header.m_magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) == 0 &&
+			header.m_version	 == COOKED_MAP_VERSION &&
+			header.m_sourceKey	 == sourceKey &&
+			header.m_vertexSize	 == vertexSize &&
+			header.m_numSections == NUM_COOKED_SECTIONS;
+		for (const auto& entry : m_sections)
+		{
+			valid &= (entry.m_offset % SECTION_ALIGNMENT) == 0;
+			valid &= entry.m_offset <= m_file.size() && entry.m_size <= m_file.size() - entry.m_offset;
+		}
+		valid = valid && SourceMatches(header.m_source, source);
+		if (!valid)
+			close();
+		return valid;
+	}
+
+	void Q3CookedMap::close()
+	{
+		m_file.close();
+		std::memset(m_sections, 0, sizeof(m_sections));
+	}
+
+	bool Q3CookedMap::write(const String& path, std::uint64_t sourceKey, std::size_t vertexSize, const Q3MappedFile& source)
+	{
+		Q3CookedHeader header;
+		std::memcpy(header.m_magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+		header.m_version	 = COOKED_MAP_VERSION;
+		header.m_sourceKey	 = sourceKey;
+		header.m_source.m_size		   = source.size();
+		header.m_source.m_modifiedTime = source.modifiedTime();
+		header.m_source.m_contentHash  = HashBytes(source.data(), source.size());
+		header.m_vertexSize	 = static_cast<std::uint32_t>(vertexSize);
+		header.m_numSections = NUM_COOKED_SECTIONS;
+
+		Q3CookedSection sections[NUM_COOKED_SECTIONS];
+		auto offset = AlignUp(sizeof(header) + sizeof(sections));
+		for (int i = 0; i < NUM_COOKED_SECTIONS; ++i)
+		{
+			sections[i].m_offset = offset;
+			sections[i].m_size	 = m_pending[i].size();
+			offset = AlignUp(offset + m_pending[i].size());
+		}
+
+		//write to a temporary first, a half written cooked map must never be picked up
+		auto tmpPath = path + ".tmp";
+		auto file	 = std::fopen(tmpPath.c_str(), "wb");
+		if (!file)
+			return false;
+		const std::uint8_t zeros[SECTION_ALIGNMENT] = {};
+		bool succes = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+			std::fwrite(sections, sizeof(sections), 1, file) == 1;
+		auto written = sizeof(header) + sizeof(sections);
+		for (int i = 0; succes && i < NUM_COOKED_SECTIONS; ++i)
+		{
+			auto padding = static_cast<std::size_t>(sections[i].m_offset) - written;
+			succes &= padding == 0 || std::fwrite(zeros, padding, 1, file) == 1;
+			succes &= m_pending[i].empty() || std::fwrite(m_pending[i].data(), m_pending[i].size(), 1, file) == 1;
+			written = static_cast<std::size_t>(sections[i].m_offset + sections[i].m_size);
+		}
+		succes &= std::fclose(file) == 0;
+		for (auto& pending : m_pending)
+			pending = std::vector<std::uint8_t>();
+
+		std::remove(path.c_str());
+		if (!succes || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+		{
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+		return true;
+	}
+}
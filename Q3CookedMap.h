@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <App/AppTypeDefs.h>
+#include <Misc/Q3BspTypes.h>
+#include <Misc/Q3MappedFile.h>
+
+namespace Misc
+{
+	const std::uint32_t	COOKED_MAP_VERSION		= 7;
+	const String		COOKED_MAP_EXTENSION	= ".q3c";
+
+	/*
+		@brief: 64 bit FNV-1a hash, used to key cooked maps to their sources
+	*/
+	std::uint64_t		HashBytes( const void* data, std::size_t size, std::uint64_t seed = 14695981039346656037ull );
+
+	enum eCookedSection : std::uint32_t
+	{
+		COOKED_LEAFS			= 0,	//Q3CookedLeaf per draw leaf
+		COOKED_VERTICES			= 1,	//vertex buffers of all leafs, back to back
+		COOKED_DRAW_INFOS		= 2,	//Q3CookedDrawInfo
+		COOKED_CLUSTERS			= 3,	//Q3CookedCluster
+		COOKED_CLUSTER_LEAFS	= 4,	//Q3CookedClusterLeaf, ranges referenced by the clusters
+		COOKED_INDICES			= 5,	//32 bit index buffers of all leafs, relative to their leaf vertices
+		COOKED_MESHLETS			= 6,	//Q3CookedMeshlet, ranges referenced by the draw infos
+		COOKED_SHARED_LEAFS		= 7,	//leaf ids, owners of faces referenced by the leafs( Q3DrawLeaf::m_sharedLeafs )
+		NUM_COOKED_SECTIONS
+	};
+
+	/*
+		@brief: Identifies the bsp a cooked map was built from without reading all of it,
+		the contents are only hashed when the file was touched since
+	*/
+	struct Q3CookedSource
+	{
+		std::uint64_t		m_size;
+		std::int64_t		m_modifiedTime;
+		std::uint64_t		m_contentHash;
+	};
+
+	struct Q3CookedHeader
+	{
+		std::uint8_t		m_magic[4];		//'Q','3','C','M'
+		std::uint32_t		m_version;
+		std::uint64_t		m_sourceKey;	//bsp header, shaders & settings it was cooked from
+		Q3CookedSource		m_source;
+		std::uint32_t		m_vertexSize;
+		std::uint32_t		m_numSections;
+	};
+
+	struct Q3CookedSection
+	{
+		std::uint64_t		m_offset;
+		std::uint64_t		m_size;
+	};
+
+	struct Q3CookedLeaf
+	{
+		std::int32_t		m_hasSky;
+		std::int32_t		m_hasVao;		//leafs without triangles get no vertex array
+		std::int32_t		m_firstVertex;
+		std::int32_t		m_numVertices;
+		std::int32_t		m_firstIndex;
+		std::int32_t		m_numIndices;
+		std::int32_t		m_firstDrawInfo;
+		std::int32_t		m_numDrawInfos;
+		std::int32_t		m_firstSharedLeaf;
+		std::int32_t		m_numSharedLeafs;
+	};
+
+	/*
+		@brief: Flat copy of a Q3DrawInfo, including the autosprite centre & axes
+	*/
+	struct Q3CookedDrawInfo
+	{
+		std::int32_t		m_shaderId;
+		std::int32_t		m_lightMapId;
+		std::int32_t		m_leafId;
+		std::int32_t		m_vertexStart;
+		std::int32_t		m_vertexCount;
+		std::int32_t		m_indexStart;
+		std::int32_t		m_indexCount;
+		std::int32_t		m_firstMeshlet;
+		std::int32_t		m_numMeshlets;
+		float				m_boundsMin[3];
+		float				m_boundsMax[3];
+		float				m_asCenter[3];
+		float				m_asWidth;
+		float				m_asHeight;
+		float				m_asMajorDir[3];
+		float				m_asVertexPos[2][3];
+	};
+
+	/*
+		@brief: Flat copy of a Q3Meshlet
+	*/
+	struct Q3CookedMeshlet
+	{
+		std::int32_t		m_indexStart;
+		std::int32_t		m_indexCount;
+		float				m_boundsMin[3];
+		float				m_boundsMax[3];
+		float				m_center[3];
+		float				m_radius;
+		float				m_coneAxis[3];
+		float				m_coneCutoff;
+	};
+
+	struct Q3CookedCluster
+	{
+		std::int32_t		m_clusterId;
+		std::int32_t		m_firstLeaf;
+		std::int32_t		m_numLeafs;
+	};
+
+	struct Q3CookedClusterLeaf
+	{
+		std::int32_t		m_cluster;
+		std::int32_t		m_leaf;
+	};
+
+	/*
+		@brief: Runtime map data derived from a bsp, read with a single mapping
+	*/
+	class Q3CookedMap
+	{
+	public:
+		/*
+			@brief: Map 'path', fails if it's not a cooked map of 'source' for 'sourceKey' & 'vertexSize'
+		*/
+		bool						open( const String& path, std::uint64_t sourceKey, std::size_t vertexSize, const Q3MappedFile& source );
+		void						close();
+		bool						isOpen() const { return m_file.isOpen(); }
+
+		template<typename T>
+		Q3LumpView<T>				section( eCookedSection type ) const
+		{
+			const auto& entry = m_sections[type];
+			return Q3LumpView<T>(reinterpret_cast<const T*>(m_file.data() + entry.m_offset), 
+				static_cast<std::size_t>(entry.m_size / sizeof(T)));
+		}
+
+		/*
+			@brief: Add the data of a section, sections are written in order of their type
+		*/
+		template<typename T>
+		void						addSection( eCookedSection type, const std::vector<T>& data )
+		{
+			auto bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+			m_pending[type].assign(bytes, bytes + data.size() * sizeof(T));
+		}
+
+		/*
+			@brief: Write all added sections to 'path', returns false upon failure
+		*/
+		bool						write( const String& path, std::uint64_t sourceKey, std::size_t vertexSize, const Q3MappedFile& source );
+
+	private:
+		Q3MappedFile				m_file;
+		Q3CookedSection				m_sections[NUM_COOKED_SECTIONS] = {};
+		std::vector<std::uint8_t>	m_pending[NUM_COOKED_SECTIONS];
+	};
+}
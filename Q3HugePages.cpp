@@ -0,0 +1,174 @@
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <cstring>
+#include <Misc/Q3HugePages.h>
+
+namespace Misc
+{
+	namespace
+	{
+		std::size_t RoundUp(std::size_t value, std::size_t multiple)
+		{
+			return (value + multiple - 1) / multiple * multiple;
+		}
+	}
+
+	Q3HugePageResource::Q3HugePageResource(std::pmr::memory_resource* upstream)
+		: m_upstream(upstream)
+		, m_mode(HUGE_PAGES_OFF)
+	{
+
+	}
+
+	Q3HugePageResource::~Q3HugePageResource()
+	{
+#if defined(__linux__)
+		for (const auto& it : m_mappings)
+			munmap(it.first, it.second.m_size);
+#endif
+	}
+
+	void Q3HugePageResource::setMode(eQ3HugePageMode mode)
+	{
+		m_mode = mode;
+	}
+
+	std::size_t Q3HugePageResource::bytesMapped() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::size_t result = 0;
+		for (const auto& it : m_mappings)
+			result += it.second.m_size;
+		return result;
+	}
+
+	void* Q3HugePageResource::do_allocate(std::size_t bytes, std::size_t alignment)
+	{
+		auto mode = m_mode.load();
+		if (mode != HUGE_PAGES_OFF && bytes >= MIN_HUGE_ALLOCATION && alignment <= HUGE_PAGE_SIZE)
+		{
+			auto size = RoundUp(bytes, HUGE_PAGE_SIZE);
+			auto explicitPages = mode == HUGE_PAGES_EXPLICIT;
+			auto ptr = explicitPages ? mapHugePages(size, true) : nullptr;
+			if (!ptr)
+			{
+				explicitPages = false;
+				ptr = mapHugePages(size, false);
+			}
+			if (ptr)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_mappings[ptr] = { size, explicitPages };
+				return ptr;
+			}
+		}
+		return m_upstream->allocate(bytes, alignment);
+	}
+
+	void Q3HugePageResource::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_mappings.find(ptr);
+			if (it != std::end(m_mappings))
+			{
+#if defined(__linux__)
+				munmap(ptr, it->second.m_size);
+#endif
+				m_mappings.erase(it);
+				return;
+			}
+		}
+		m_upstream->deallocate(ptr, bytes, alignment);
+	}
+
+	bool Q3HugePageResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+	{
+		return this == &other;
+	}
+
+	void* Q3HugePageResource::mapHugePages(std::size_t size, bool explicitPages)
+	{
+#if defined(__linux__)
+		if (explicitPages)
+		{
+			auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			return ptr != MAP_FAILED ? ptr : nullptr;
+		}
+		//over allocate & cut to a huge page boundary, the kernel only uses huge pages for aligned ranges
+		auto mapSize = size + HUGE_PAGE_SIZE;
+		auto ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+		auto address = reinterpret_cast<std::uintptr_t>(ptr);
+		auto aligned = RoundUp(address, HUGE_PAGE_SIZE);
+		if (aligned > address)
+			munmap(ptr, aligned - address);
+		auto tail = address + mapSize - (aligned + size);
+		if (tail)
+			munmap(reinterpret_cast<void*>(aligned + size), tail);
+		//a hint, without THP support( or 'never' ) the range just keeps normal pages
+		madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+		return reinterpret_cast<void*>(aligned);
+#else
+		(void)size;
+		(void)explicitPages;
+		return nullptr;
+#endif
+	}
+
+	Q3TlbMissCounter::Q3TlbMissCounter()
+		: m_fd(-1)
+	{
+#if defined(__linux__)
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.type			= PERF_TYPE_HW_CACHE;
+		attr.size			= sizeof(attr);
+		attr.config			= PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled		= 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv		= 1;
+		m_fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+	}
+
+	Q3TlbMissCounter::~Q3TlbMissCounter()
+	{
+#if defined(__linux__)
+		if (m_fd >= 0)
+			close(m_fd);
+#endif
+	}
+
+	void Q3TlbMissCounter::start()
+	{
+#if defined(__linux__)
+		if (m_fd < 0)
+			return;
+		ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+	}
+
+	std::int64_t Q3TlbMissCounter::stop()
+	{
+#if defined(__linux__)
+		if (m_fd < 0)
+			return -1;
+		ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+		std::int64_t count = 0;
+		if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+			return -1;
+		return count;
+#else
+		return -1;
+#endif
+	}
+}
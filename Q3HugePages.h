@@ -0,0 +1,86 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+
+namespace Misc
+{
+	/*
+		@brief: How large map arrays are backed( r_hugePages )
+	*/
+	enum eQ3HugePageMode
+	{
+		HUGE_PAGES_OFF = 0,
+		HUGE_PAGES_TRANSPARENT,		//anonymous mapping, madvise(MADV_HUGEPAGE)
+		HUGE_PAGES_EXPLICIT			//MAP_HUGETLB from the hugetlbfs pool, transparent when the pool is empty
+	};
+
+	/*
+		@brief: Backs large allocations with huge pages so random lookups over them( bsp nodes, leafs,
+		vis data ) need fewer TLB entries. Linux only, small allocations, other platforms & failed
+		mappings use normal pages from the upstream resource. Each map arena takes its blocks from its own
+		resource, so the mode of one map never changes under another
+	*/
+	class Q3HugePageResource : public std::pmr::memory_resource
+	{
+	public:
+		static const std::size_t	HUGE_PAGE_SIZE		  = 2 * 1024 * 1024;
+		static const std::size_t	MIN_HUGE_ALLOCATION = HUGE_PAGE_SIZE / 2;	//smaller ones would waste most of a page
+
+		explicit Q3HugePageResource( std::pmr::memory_resource* upstream = std::pmr::new_delete_resource() );
+		~Q3HugePageResource();
+
+		/*
+			@brief: Used for allocations from now on, earlier ones are freed the way they were made
+		*/
+		void						setMode( eQ3HugePageMode mode );
+		eQ3HugePageMode				getMode() const { return m_mode; }
+
+		std::size_t					bytesMapped() const;	//currently in huge page mappings
+
+	private:
+		struct Mapping
+		{
+			std::size_t				m_size;
+			bool					m_explicit;
+		};
+
+		void*						do_allocate( std::size_t bytes, std::size_t alignment ) override;
+		void						do_deallocate( void* ptr, std::size_t bytes, std::size_t alignment ) override;
+		bool						do_is_equal( const std::pmr::memory_resource& other ) const noexcept override;
+
+		void*						mapHugePages( std::size_t size, bool explicitPages );
+
+		std::pmr::memory_resource*	m_upstream;
+		std::atomic<eQ3HugePageMode> m_mode;
+		mutable std::mutex			m_mutex;
+		std::map<void*, Mapping>	m_mappings;
+	};
+
+	/*
+		@brief: Data TLB read misses of the calling thread( Linux perf events ), for benchmarking
+		the page size. Not available on other platforms or without perf permissions
+	*/
+	class Q3TlbMissCounter
+	{
+	public:
+		Q3TlbMissCounter();
+		~Q3TlbMissCounter();
+
+		Q3TlbMissCounter( const Q3TlbMissCounter& ) = delete;
+		Q3TlbMissCounter& operator = ( const Q3TlbMissCounter& ) = delete;
+
+		bool						available() const { return m_fd >= 0; }
+		void						start();
+		/*
+			@brief: Misses since start, -1 when not available
+		*/
+		std::int64_t				stop();
+
+	private:
+		int							m_fd;
+	};
+}
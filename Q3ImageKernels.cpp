@@ -0,0 +1,232 @@
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include <Math/GenMath.h>
+#include <Misc/Q3ImageKernels.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define Q3_KERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(Q3_KERNELS_SSE2) && (defined(__SSSE3__) || defined(__AVX__))
+#define Q3_KERNELS_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+namespace Misc
+{
+	bool ImageKernelsSIMD()
+	{
+#if Q3_KERNELS_SSE2
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void RescaleOverbrightScalar(std::uint8_t* data, std::size_t count, float factor)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			float curVal = static_cast<float>(data[i]) / 255.0f;
+			curVal *= factor;
+			curVal = Math::Clamp(0.0f, 1.0f, curVal);
+			data[i] = static_cast<std::uint8_t>(curVal * 255.0f);
+		}
+	}
+
+	void RescaleOverbright(std::uint8_t* data, std::size_t count, float factor)
+	{
+		std::size_t i = 0;
+#if Q3_KERNELS_SSE2
+		const __m128i zero		= _mm_setzero_si128();
+		const __m128  c255		= _mm_set1_ps(255.0f);
+		const __m128  cZero		= _mm_setzero_ps();
+		const __m128  cOne		= _mm_set1_ps(1.0f);
+		const __m128  cFactor	= _mm_set1_ps(factor);
+
+		//same operations & order as the scalar version so results are identical
+		auto rescale4 = [&](__m128i v) -> __m128i
+		{
+			__m128 f = _mm_cvtepi32_ps(v);
+			f = _mm_div_ps(f, c255);
+			f = _mm_mul_ps(f, cFactor);
+			f = _mm_min_ps(_mm_max_ps(f, cZero), cOne);
+			f = _mm_mul_ps(f, c255);
+			return _mm_cvttps_epi32(f);
+		};
+
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i px   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i lo16 = _mm_unpacklo_epi8(px, zero);
+			__m128i hi16 = _mm_unpackhi_epi8(px, zero);
+
+			__m128i r0 = rescale4(_mm_unpacklo_epi16(lo16, zero));
+			__m128i r1 = rescale4(_mm_unpackhi_epi16(lo16, zero));
+			__m128i r2 = rescale4(_mm_unpacklo_epi16(hi16, zero));
+			__m128i r3 = rescale4(_mm_unpackhi_epi16(hi16, zero));
+
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), packed);
+		}
+#endif
+		RescaleOverbrightScalar(data + i, count - i, factor);
+	}
+
+	void ExpandRGBToRGBAScalar(const std::uint8_t* src, std::uint8_t* dst, std::size_t numPixels, std::uint8_t alpha)
+	{
+		for (std::size_t i = 0; i < numPixels; ++i)
+		{
+			dst[i * 4 + 0] = src[i * 3 + 0];
+			dst[i * 4 + 1] = src[i * 3 + 1];
+			dst[i * 4 + 2] = src[i * 3 + 2];
+			dst[i * 4 + 3] = alpha;
+		}
+	}
+
+	void ExpandRGBToRGBA(const std::uint8_t* src, std::uint8_t* dst, std::size_t numPixels, std::uint8_t alpha)
+	{
+		std::size_t i = 0;
+#if Q3_KERNELS_SSSE3
+		const __m128i shuffle	= _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(alpha) << 24));
+		//a 16 byte load covers 5.33 pixels, only 4 are used so stay 6 pixels away from the end
+		for (; i + 6 <= numPixels; i += 4)
+		{
+			__m128i rgb  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+			__m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alphaMask);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), rgba);
+		}
+#endif
+		ExpandRGBToRGBAScalar(src + i * 3, dst + i * 4, numPixels - i, alpha);
+	}
+
+	void FlipImageVertical(std::uint8_t* data, int width, int height, int bytesPerPixel)
+	{
+		const auto rowSize = static_cast<std::size_t>(width) * bytesPerPixel;
+		std::vector<std::uint8_t> tmpRow(rowSize);
+		for (int y = 0; y < height / 2; ++y)
+		{
+			auto* top	 = data + rowSize * y;
+			auto* bottom = data + rowSize * (height - 1 - y);
+			std::memcpy(tmpRow.data(), top, rowSize);
+			std::memcpy(top, bottom, rowSize);
+			std::memcpy(bottom, tmpRow.data(), rowSize);
+		}
+	}
+
+	bool BlitSubImage(std::uint8_t* dst, int dstWidth, int dstHeight, int x, int y,
+					  const std::uint8_t* src, int srcWidth, int srcHeight, int bytesPerPixel)
+	{
+		if (x < 0 || y < 0 || (x + srcWidth) > dstWidth || (y + srcHeight) > dstHeight)
+			return false;
+
+		const auto srcRow = static_cast<std::size_t>(srcWidth) * bytesPerPixel;
+		const auto dstRow = static_cast<std::size_t>(dstWidth) * bytesPerPixel;
+		auto* dstPtr = dst + dstRow * y + static_cast<std::size_t>(x) * bytesPerPixel;
+		for (int row = 0; row < srcHeight; ++row)
+			std::memcpy(dstPtr + dstRow * row, src + srcRow * row, srcRow);
+		return true;
+	}
+
+	void PadSubImageEdges(std::uint8_t* data, int width, int height, int x, int y,
+						  int w, int h, int pad, int bytesPerPixel)
+	{
+		if (pad <= 0 || x < pad || y < pad || (x + w + pad) > width || (y + h + pad) > height)
+			return;
+
+		const auto rowSize = static_cast<std::size_t>(width) * bytesPerPixel;
+		//extend each row to the left & right
+		for (int row = y; row < y + h; ++row)
+		{
+			auto* rowPtr = data + rowSize * row;
+			const auto* first = rowPtr + static_cast<std::size_t>(x) * bytesPerPixel;
+			const auto* last  = rowPtr + static_cast<std::size_t>(x + w - 1) * bytesPerPixel;
+			for (int i = 1; i <= pad; ++i)
+			{
+				std::memcpy(rowPtr + static_cast<std::size_t>(x - i) * bytesPerPixel, first, bytesPerPixel);
+				std::memcpy(rowPtr + static_cast<std::size_t>(x + w - 1 + i) * bytesPerPixel, last, bytesPerPixel);
+			}
+		}
+		//then copy the extended first & last rows up & down, this fills the corners as well
+		const auto spanOffset = static_cast<std::size_t>(x - pad) * bytesPerPixel;
+		const auto spanSize   = static_cast<std::size_t>(w + pad * 2) * bytesPerPixel;
+		for (int i = 1; i <= pad; ++i)
+		{
+			std::memcpy(data + rowSize * (y - i) + spanOffset, data + rowSize * y + spanOffset, spanSize);
+			std::memcpy(data + rowSize * (y + h - 1 + i) + spanOffset, data + rowSize * (y + h - 1) + spanOffset, spanSize);
+		}
+	}
+
+	void BoxFilterDownsampleScalar(const std::uint8_t* src, int width, int height, int bytesPerPixel, std::uint8_t* dst)
+	{
+		const int outWidth  = std::max(1, width / 2);
+		const int outHeight = std::max(1, height / 2);
+		const auto rowSize  = static_cast<std::size_t>(width) * bytesPerPixel;
+		for (int y = 0; y < outHeight; ++y)
+		{
+			const auto* row0 = src + rowSize * std::min(y * 2, height - 1);
+			const auto* row1 = src + rowSize * std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < outWidth; ++x)
+			{
+				const int x0 = std::min(x * 2, width - 1) * bytesPerPixel;
+				const int x1 = std::min(x * 2 + 1, width - 1) * bytesPerPixel;
+				auto* out = dst + (static_cast<std::size_t>(y) * outWidth + x) * bytesPerPixel;
+				for (int c = 0; c < bytesPerPixel; ++c)
+				{
+					int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+					out[c] = static_cast<std::uint8_t>((sum + 2) >> 2);
+				}
+			}
+		}
+	}
+
+	void BoxFilterDownsample(const std::uint8_t* src, int width, int height, int bytesPerPixel, std::uint8_t* dst)
+	{
+#if Q3_KERNELS_SSE2
+		//fast path: rgba, even dimensions, 2 output texels per iteration
+		if (bytesPerPixel == 4 && width >= 2 && height >= 2 && !(width & 1) && !(height & 1))
+		{
+			const int outWidth  = width / 2;
+			const int outHeight = height / 2;
+			const auto rowSize  = static_cast<std::size_t>(width) * 4;
+			const __m128i zero  = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+			for (int y = 0; y < outHeight; ++y)
+			{
+				const auto* row0 = src + rowSize * (y * 2);
+				const auto* row1 = row0 + rowSize;
+				auto* out = dst + static_cast<std::size_t>(y) * outWidth * 4;
+				int x = 0;
+				for (; x + 2 <= outWidth; x += 2)
+				{
+					__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+					__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+					//vertical sums, lo = texels 0,1 hi = texels 2,3
+					__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+					__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+					//horizontal sums
+					lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+					hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+					__m128i sum = _mm_unpacklo_epi64(lo, hi);
+					sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, zero));
+				}
+				for (; x < outWidth; ++x)
+				{
+					for (int c = 0; c < 4; ++c)
+					{
+						int sum = row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c];
+						out[x * 4 + c] = static_cast<std::uint8_t>((sum + 2) >> 2);
+					}
+				}
+			}
+			return;
+		}
+#endif
+		BoxFilterDownsampleScalar(src, width, height, bytesPerPixel, dst);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Misc
+{
+	/*
+		@brief: Returns true if the kernels below run their SIMD(SSE2/SSSE3) path
+	*/
+	bool			ImageKernelsSIMD();
+
+	/*
+		@brief: Overbright rescale, val = clamp( val / 255 * factor, 0, 1 ) * 255.
+		Matches the scalar Q3LightMap::rescale bit for bit
+	*/
+	void			RescaleOverbright( std::uint8_t* data, std::size_t count, float factor );
+
+	/*
+		@brief: Expand tightly packed RGB8 pixels to RGBA8 with a constant alpha, src & dst may not overlap
+	*/
+	void			ExpandRGBToRGBA( const std::uint8_t* src, std::uint8_t* dst, std::size_t numPixels, std::uint8_t alpha );
+
+	/*
+		@brief: Flip image rows in place
+	*/
+	void			FlipImageVertical( std::uint8_t* data, int width, int height, int bytesPerPixel );
+
+	/*
+		@brief: Copy src into dst at (x, y), returns false if src doesn't fit
+	*/
+	bool			BlitSubImage( std::uint8_t* dst, int dstWidth, int dstHeight, int x, int y,
+								  const std::uint8_t* src, int srcWidth, int srcHeight, int bytesPerPixel );
+
+	/*
+		@brief: Replicate the border texels of the w*h block at (x, y) into a frame of 'pad' texels
+		around it, keeps bilinear filtering & lower mips from bleeding between atlas pages
+	*/
+	void			PadSubImageEdges( std::uint8_t* data, int width, int height, int x, int y,
+									  int w, int h, int pad, int bytesPerPixel );
+
+	/*
+		@brief: 2x2 box filter, writes the next mip level( max(1, w/2) * max(1, h/2) ) to dst,
+		each output texel is ( a + b + c + d + 2 ) / 4
+	*/
+	void			BoxFilterDownsample( const std::uint8_t* src, int width, int height, int bytesPerPixel, std::uint8_t* dst );
+
+	/*
+		@brief: Scalar reference implementations, used as fallback & to validate the SIMD paths
+	*/
+	void			RescaleOverbrightScalar( std::uint8_t* data, std::size_t count, float factor );
+	void			ExpandRGBToRGBAScalar( const std::uint8_t* src, std::uint8_t* dst, std::size_t numPixels, std::uint8_t alpha );
+	void			BoxFilterDownsampleScalar( const std::uint8_t* src, int width, int height, int bytesPerPixel, std::uint8_t* dst );
+}
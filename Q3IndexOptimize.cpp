@@ -0,0 +1,305 @@
+#include <cmath>
+#include <algorithm>
+#include <Misc/Q3IndexOptimize.h>
+
+namespace Misc
+{
+	namespace
+	{
+		const int	FORSYTH_CACHE_SIZE	= 32;
+
+		float VertexScore(int cachePosition, int activeTriangles)
+		{
+			if (activeTriangles == 0) //no triangles left to emit with it
+				return -1.0f;
+			float result = 0.0f;
+			if (cachePosition >= 0)
+			{
+				//the last triangle's vertices score the same, whichever order they're emitted in
+				if (cachePosition < 3)
+					result = 0.75f;
+				else
+					result = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+			}
+			//prefer vertices with few triangles left, they would otherwise be loaded again later
+			return result + 2.0f / std::sqrt(static_cast<float>(activeTriangles));
+		}
+
+		/*
+			@brief: Fifo cache replay, restarted by 'reset'
+		*/
+		struct FifoCache
+		{
+			FifoCache(std::size_t numVertices, int cacheSize)
+				: m_timeStamps(numVertices, 0)
+				, m_cacheSize(static_cast<std::uint32_t>(cacheSize))
+				, m_time(static_cast<std::uint32_t>(cacheSize) + 1)
+			{
+			}
+
+			//misses of drawing 'triangle'
+			int draw(const std::uint32_t* triangle)
+			{
+				int misses = 0;
+				for (int k = 0; k < 3; ++k)
+				{
+					auto& stamp = m_timeStamps[triangle[k]];
+					if (m_time - stamp > m_cacheSize)
+					{
+						stamp = m_time++;
+						misses++;
+					}
+				}
+				return misses;
+			}
+
+			void reset()
+			{
+				m_time += m_cacheSize + 1;
+			}
+
+			std::vector<std::uint32_t>	m_timeStamps;
+			std::uint32_t				m_cacheSize;
+			std::uint32_t				m_time;
+		};
+
+		Math::Vector3f Sub(const Math::Vector3f& a, const Math::Vector3f& b)
+		{
+			return Math::Vector3f(a[0] - b[0], a[1] - b[1], a[2] - b[2]);
+		}
+
+		float TriangleArea(const Math::Vector3f& p0, const Math::Vector3f& p1, const Math::Vector3f& p2)
+		{
+			auto e0 = Sub(p1, p0);
+			auto e1 = Sub(p2, p0);
+			auto x  = e0[1] * e1[2] - e0[2] * e1[1];
+			auto y  = e0[2] * e1[0] - e0[0] * e1[2];
+			auto z  = e0[0] * e1[1] - e0[1] * e1[0];
+			return 0.5f * std::sqrt(x * x + y * y + z * z);
+		}
+	}
+
+	std::size_t VertexCacheMisses(const std::uint32_t* indices, std::size_t numIndices, std::size_t numVertices, int cacheSize)
+	{
+		FifoCache cache(numVertices, cacheSize);
+		std::size_t result = 0;
+		for (std::size_t i = 0; i + 2 < numIndices; i += 3)
+			result += cache.draw(indices + i);
+		return result;
+	}
+
+	void OptimizeVertexCache(std::uint32_t* indices, std::size_t numIndices, std::size_t numVertices)
+	{
+		const auto numTriangles = numIndices / 3;
+		if (numTriangles < 2)
+			return;
+
+		//triangles of each vertex, the ones not emitted yet are kept at the front
+		std::vector<std::uint32_t> triangleStart(numVertices + 1, 0);
+		std::vector<int> activeTriangles(numVertices, 0);
+		for (std::size_t i = 0; i < numTriangles * 3; ++i)
+			activeTriangles[indices[i]]++;
+		for (std::size_t v = 0; v < numVertices; ++v)
+			triangleStart[v + 1] = triangleStart[v] + activeTriangles[v];
+		std::vector<std::uint32_t> vertexTriangles(triangleStart[numVertices]);
+		{
+			auto next = triangleStart;
+			for (std::size_t i = 0; i < numTriangles * 3; ++i)
+				vertexTriangles[next[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+		}
+
+		std::vector<int> cachePosition(numVertices, -1);
+		std::vector<float> vertexScore(numVertices);
+		for (std::size_t v = 0; v < numVertices; ++v)
+			vertexScore[v] = VertexScore(-1, activeTriangles[v]);
+
+		std::vector<float> triangleScore(numTriangles);
+		std::vector<bool> emitted(numTriangles, false);
+		for (std::size_t t = 0; t < numTriangles; ++t)
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+		std::vector<std::uint32_t> result;
+		result.reserve(numTriangles * 3);
+		std::vector<std::uint32_t> cache, newCache;
+		cache.reserve(FORSYTH_CACHE_SIZE + 3);
+		newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+		std::size_t cursor	= 0;	//first triangle that may not be emitted, when the cache has none left
+		std::size_t best	= 0;
+		for (std::size_t t = 1; t < numTriangles; ++t)
+			if (triangleScore[t] > triangleScore[best])
+				best = t;
+
+		for (std::size_t n = 0; n < numTriangles; ++n)
+		{
+			const auto* triangle = indices + best * 3;
+			emitted[best] = true;
+			result.insert(std::end(result), triangle, triangle + 3);
+
+			//emitted triangle moves to the back of each of its vertices' lists
+			for (int k = 0; k < 3; ++k)
+			{
+				auto v		= triangle[k];
+				auto* first = vertexTriangles.data() + triangleStart[v];
+				auto* last	= first + activeTriangles[v];
+				auto it		= std::find(first, last, static_cast<std::uint32_t>(best));
+				if (it != last)
+				{
+					std::swap(*it, *(last - 1));
+					activeTriangles[v]--;
+				}
+			}
+
+			//lru: the triangle's vertices go to the front
+			newCache.clear();
+			for (int k = 0; k < 3; ++k)
+				if (std::find(std::begin(newCache), std::end(newCache), triangle[k]) == std::end(newCache))
+					newCache.push_back(triangle[k]);
+			for (auto v : cache)
+				if (std::find(std::begin(newCache), std::end(newCache), v) == std::end(newCache))
+					newCache.push_back(v);
+			for (std::size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); ++i)
+			{
+				cachePosition[newCache[i]] = -1;
+				vertexScore[newCache[i]]   = VertexScore(-1, activeTriangles[newCache[i]]);
+			}
+			if (newCache.size() > FORSYTH_CACHE_SIZE)
+				newCache.resize(FORSYTH_CACHE_SIZE);
+			std::swap(cache, newCache);
+
+			for (std::size_t i = 0; i < cache.size(); ++i)
+			{
+				cachePosition[cache[i]] = static_cast<int>(i);
+				vertexScore[cache[i]]	= VertexScore(static_cast<int>(i), activeTriangles[cache[i]]);
+			}
+
+			//only the triangles of cached vertices changed score, the best next one is among them
+			float bestScore = -1.0f;
+			for (auto v : cache)
+			{
+				for (auto i = triangleStart[v]; i < triangleStart[v] + activeTriangles[v]; ++i)
+				{
+					auto t	   = vertexTriangles[i];
+					auto score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best	  = t;
+					}
+				}
+			}
+			if (bestScore < 0.0f)
+			{
+				while (cursor < numTriangles && emitted[cursor])
+					cursor++;
+				best = cursor;
+			}
+		}
+		std::copy(std::begin(result), std::end(result), indices);
+	}
+
+	void OptimizeOverdraw(std::uint32_t* indices, std::size_t numIndices, const App::MeshVertex* vertices, std::size_t numVertices, float threshold)
+	{
+		const auto numTriangles = numIndices / 3;
+		if (numTriangles < 2)
+			return;
+
+		//clusters start where the whole triangle missed the cache, the draw order restarts there anyway
+		std::vector<std::size_t> clusters;
+		FifoCache cache(numVertices, VERTEX_CACHE_SIZE);
+		std::vector<int> misses(numTriangles);
+		for (std::size_t t = 0; t < numTriangles; ++t)
+		{
+			misses[t] = cache.draw(indices + t * 3);
+			if (t == 0 || misses[t] == 3)
+				clusters.push_back(t);
+		}
+		clusters.push_back(numTriangles);
+
+		//and split further as long as a cut doesn't cost more than 'threshold' of the cluster's ACMR
+		std::vector<std::size_t> splitClusters;
+		for (std::size_t c = 0; c + 1 < clusters.size(); ++c)
+		{
+			const auto start = clusters[c];
+			const auto end	 = clusters[c + 1];
+			std::size_t clusterMisses = 0;
+			for (auto t = start; t < end; ++t)
+				clusterMisses += misses[t];
+			const auto maxAcmr = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+			cache.reset();
+			std::size_t subStart = start, subMisses = 0;
+			splitClusters.push_back(start);
+			for (auto t = start; t < end; ++t)
+			{
+				subMisses += cache.draw(indices + t * 3);
+				if (t + 1 < end && static_cast<float>(subMisses) <= maxAcmr * static_cast<float>(t + 1 - subStart))
+				{
+					splitClusters.push_back(t + 1);
+					cache.reset();
+					subStart  = t + 1;
+					subMisses = 0;
+				}
+			}
+		}
+		splitClusters.push_back(numTriangles);
+
+		//area weighted centre & normal of each cluster
+		const auto numClusters = splitClusters.size() - 1;
+		std::vector<Math::Vector3f> centres(numClusters), normals(numClusters);
+		std::vector<float> areas(numClusters, 0.0f);
+		float centre[3] = { 0.0f, 0.0f, 0.0f };
+		float totalArea = 0.0f;
+		for (std::size_t c = 0; c < numClusters; ++c)
+		{
+			float clusterCentre[3] = { 0.0f, 0.0f, 0.0f }, clusterNormal[3] = { 0.0f, 0.0f, 0.0f };
+			for (auto t = splitClusters[c]; t < splitClusters[c + 1]; ++t)
+			{
+				const auto& v0 = vertices[indices[t * 3]];
+				const auto& v1 = vertices[indices[t * 3 + 1]];
+				const auto& v2 = vertices[indices[t * 3 + 2]];
+				const auto area = TriangleArea(v0.m_worldCoord, v1.m_worldCoord, v2.m_worldCoord);
+				const auto n0 = v0.getNormal(), n1 = v1.getNormal(), n2 = v2.getNormal();
+				for (int k = 0; k < 3; ++k)
+				{
+					clusterCentre[k] += area * (v0.m_worldCoord[k] + v1.m_worldCoord[k] + v2.m_worldCoord[k]) / 3.0f;
+					clusterNormal[k] += area * (n0[k] + n1[k] + n2[k]);
+				}
+				areas[c] += area;
+			}
+			for (int k = 0; k < 3; ++k)
+				centre[k] += clusterCentre[k];
+			totalArea += areas[c];
+			const auto scale = areas[c] > 0.0f ? 1.0f / areas[c] : 0.0f;
+			centres[c] = Math::Vector3f(clusterCentre[0] * scale, clusterCentre[1] * scale, clusterCentre[2] * scale);
+			normals[c] = Math::Vector3f(clusterNormal[0], clusterNormal[1], clusterNormal[2]);
+		}
+		if (totalArea <= 0.0f)
+			return;
+
+		std::vector<float> sortKeys(numClusters, 0.0f);
+		for (std::size_t c = 0; c < numClusters; ++c)
+		{
+			const auto& n	= normals[c];
+			const auto len	= std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (areas[c] <= 0.0f || len <= 0.0f)
+				continue;
+			for (int k = 0; k < 3; ++k)
+				sortKeys[c] += (centres[c][k] - centre[k] / totalArea) * n[k] / len;
+		}
+
+		std::vector<std::size_t> order(numClusters);
+		for (std::size_t c = 0; c < numClusters; ++c)
+			order[c] = c;
+		std::stable_sort(std::begin(order), std::end(order), [&sortKeys](std::size_t a, std::size_t b)
+		{
+			return sortKeys[a] > sortKeys[b];
+		});
+
+		std::vector<std::uint32_t> result;
+		result.reserve(numTriangles * 3);
+		for (auto c : order)
+			result.insert(std::end(result), indices + splitClusters[c] * 3, indices + splitClusters[c + 1] * 3);
+		std::copy(std::begin(result), std::end(result), indices);
+	}
+}
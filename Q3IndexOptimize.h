@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <Graphics/MeshVertex.h>
+
+namespace Misc
+{
+	static const int	VERTEX_CACHE_SIZE	= 16;	//fifo entries ACMR is measured with
+
+	/*
+		@brief: Cache misses of drawing 'indices' through a 'cacheSize' entry fifo post transform cache,
+		ACMR is this over the number of triangles
+	*/
+	std::size_t		VertexCacheMisses( const std::uint32_t* indices, std::size_t numIndices, std::size_t numVertices, int cacheSize = VERTEX_CACHE_SIZE );
+
+	/*
+		@brief: Reorder the triangles of 'indices' for post transform cache reuse( Forsyth, linear speed vertex
+		cache optimisation ). Vertices scored by their lru cache position & the triangles left using them
+	*/
+	void			OptimizeVertexCache( std::uint32_t* indices, std::size_t numIndices, std::size_t numVertices );
+
+	/*
+		@brief: Reorder cache optimized 'indices' to draw outward facing parts first( Sander et al., Tipsy ).
+		The triangles are cut into clusters where the ACMR stays within 'threshold' of the unclustered one, the
+		clusters are sorted by how far they face away from the centre of the range
+	*/
+	void			OptimizeOverdraw( std::uint32_t* indices, std::size_t numIndices, const App::MeshVertex* vertices, std::size_t numVertices, float threshold = 1.05f );
+}
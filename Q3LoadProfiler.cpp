@@ -0,0 +1,333 @@
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <Misc/Q3LoadProfiler.h>
+
+namespace Misc
+{
+	namespace
+	{
+		thread_local std::int64_t	t_numAllocs	  = 0;
+		thread_local std::int64_t	t_allocBytes  = 0;
+		thread_local int			t_bufferIndex = -1;
+
+		String EscapeJson(const String& str)
+		{
+			String result;
+			result.reserve(str.size());
+			for (auto c : str)
+			{
+				switch (c)
+				{
+				case '"':  result += "\\\""; break;
+				case '\\': result += "\\\\"; break;
+				case '\n': result += "\\n";	 break;
+				case '\r': result += "\\r";	 break;
+				case '\t': result += "\\t";	 break;
+				default:
+					if (static_cast<unsigned char>(c) >= 0x20)
+						result += c;
+				}
+			}
+			return result;
+		}
+	}
+
+	Q3LoadProfiler& Q3LoadProfiler::Global()
+	{
+		static Q3LoadProfiler profiler;
+		return profiler;
+	}
+
+	void Q3LoadProfiler::beginSession(const String& name)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& buffer : m_buffers)
+		{
+			std::lock_guard<std::mutex> bufferLock(buffer->m_mutex);
+			buffer->m_events.clear();
+		}
+		m_counters.clear();
+		m_sessionName  = name;
+		m_sessionStart = Clock::now();
+		m_enabled	   = true;
+	}
+
+	void Q3LoadProfiler::endSession()
+	{
+		m_enabled = false;
+	}
+
+	Q3LoadProfiler::ThreadBuffer& Q3LoadProfiler::threadBuffer()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (t_bufferIndex < 0)
+		{
+			t_bufferIndex = static_cast<int>(m_buffers.size());
+			m_buffers.push_back(std::make_unique<ThreadBuffer>());
+			m_buffers.back()->m_threadIndex = t_bufferIndex;
+		}
+		return *m_buffers[t_bufferIndex];
+	}
+
+	void Q3LoadProfiler::addEvent(Event&& event)
+	{
+		if (!m_enabled)
+			return;
+		auto& buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock(buffer.m_mutex);
+		buffer.m_events.push_back(std::move(event));
+	}
+
+	void Q3LoadProfiler::addCounter(const String& name, std::int64_t value)
+	{
+		if (!m_enabled)
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_counters[name] += value;
+	}
+
+	void Q3LoadProfiler::setCounter(const String& name, std::int64_t value)
+	{
+		if (!m_enabled)
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_counters[name] = value;
+	}
+
+	std::int64_t Q3LoadProfiler::sinceStartUs(Clock::time_point time) const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(time - m_sessionStart).count();
+	}
+
+	bool Q3LoadProfiler::writeJson(const String& path) const
+	{
+		struct Summary
+		{
+			std::int64_t m_count	  = 0;
+			std::int64_t m_wallUs	  = 0;
+			std::int64_t m_maxWallUs  = 0;
+			std::int64_t m_cpuUs	  = 0;
+			std::int64_t m_numAllocs  = 0;
+			std::int64_t m_allocBytes = 0;
+		};
+		std::map<String, Summary> summaries;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& buffer : m_buffers)
+		{
+			std::lock_guard<std::mutex> bufferLock(buffer->m_mutex);
+			for (const auto& event : buffer->m_events)
+			{
+				auto& summary = summaries[event.m_name];
+				summary.m_count++;
+				summary.m_wallUs	 += event.m_wallUs;
+				summary.m_maxWallUs	  = std::max(summary.m_maxWallUs, event.m_wallUs);
+				summary.m_cpuUs		 += event.m_cpuUs;
+				summary.m_numAllocs	 += event.m_numAllocs;
+				summary.m_allocBytes += event.m_allocBytes;
+			}
+		}
+
+		std::ostringstream out;
+		out << "{\n  \"session\": \"" << EscapeJson(m_sessionName) << "\",\n  \"scopes\": {";
+		bool first = true;
+		for (const auto& it : summaries)
+		{
+			const auto& summary = it.second;
+			out << (first ? "\n" : ",\n") << "    \"" << EscapeJson(it.first) << "\": { "
+				<< "\"count\": " << summary.m_count << ", "
+				<< "\"wallMs\": " << summary.m_wallUs / 1000.0 << ", "
+				<< "\"maxWallMs\": " << summary.m_maxWallUs / 1000.0 << ", "
+				<< "\"cpuMs\": " << summary.m_cpuUs / 1000.0 << ", "
+				<< "\"allocs\": " << summary.m_numAllocs << ", "
+				<< "\"allocBytes\": " << summary.m_allocBytes << " }";
+			first = false;
+		}
+		out << "\n  },\n  \"counters\": {";
+		first = true;
+		for (const auto& it : m_counters)
+		{
+			out << (first ? "\n" : ",\n") << "    \"" << EscapeJson(it.first) << "\": " << it.second;
+			first = false;
+		}
+		out << "\n  }\n}\n";
+
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file << out.str();
+		return file.good();
+	}
+
+	bool Q3LoadProfiler::writeChromeTrace(const String& path) const
+	{
+		std::ostringstream out;
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& buffer : m_buffers)
+		{
+			std::lock_guard<std::mutex> bufferLock(buffer->m_mutex);
+			if (buffer->m_events.empty())
+				continue;
+			//name the rows, the thread that started the session isn't necessarily the first one
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->m_threadIndex
+				<< ",\"args\":{\"name\":\"thread " << buffer->m_threadIndex << "\"}}";
+			first = false;
+			for (const auto& event : buffer->m_events)
+			{
+				out << ",\n{\"name\":\"" << EscapeJson(event.m_name) << "\",\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":" 
+					<< buffer->m_threadIndex << ",\"ts\":" << event.m_startUs << ",\"dur\":" << event.m_wallUs
+					<< ",\"args\":{\"cpuUs\":" << event.m_cpuUs << ",\"allocs\":" << event.m_numAllocs 
+					<< ",\"allocBytes\":" << event.m_allocBytes;
+				if (!event.m_detail.empty())
+					out << ",\"detail\":\"" << EscapeJson(event.m_detail) << "\"";
+				out << "}}";
+			}
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file << out.str();
+		return file.good();
+	}
+
+	std::int64_t Q3LoadProfiler::ThreadCpuTimeUs()
+	{
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+			return 0;
+		auto toUs = [](const FILETIME& time)
+		{
+			return static_cast<std::int64_t>((static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10;
+		};
+		return toUs(kernel) + toUs(user);
+#else
+		struct timespec time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+			return 0;
+		return static_cast<std::int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#endif
+	}
+
+	void Q3LoadProfiler::ThreadAllocations(std::int64_t& count, std::int64_t& bytes)
+	{
+		count = t_numAllocs;
+		bytes = t_allocBytes;
+	}
+
+	Q3ProfileScope::Q3ProfileScope(const char* name, const String& detail)
+		: m_active(Q3LoadProfiler::Global().enabled())
+	{
+		if (!m_active)
+			return;
+		m_event.m_name	 = name;
+		m_event.m_detail = detail;
+		begin();
+	}
+
+	Q3ProfileScope::Q3ProfileScope(const String& name, const String& detail)
+		: m_active(Q3LoadProfiler::Global().enabled())
+	{
+		if (!m_active)
+			return;
+		m_event.m_name	 = name;
+		m_event.m_detail = detail;
+		begin();
+	}
+
+	void Q3ProfileScope::begin()
+	{
+		//start values are kept in the event, the destructor turns them into deltas
+		Q3LoadProfiler::ThreadAllocations(m_event.m_numAllocs, m_event.m_allocBytes);
+		m_event.m_cpuUs = Q3LoadProfiler::ThreadCpuTimeUs();
+		m_start			= Q3LoadProfiler::Clock::now();
+	}
+
+	Q3ProfileScope::~Q3ProfileScope()
+	{
+		if (!m_active)
+			return;
+		auto end = Q3LoadProfiler::Clock::now();
+		std::int64_t numAllocs, allocBytes;
+		Q3LoadProfiler::ThreadAllocations(numAllocs, allocBytes);
+
+		auto& profiler		= Q3LoadProfiler::Global();
+		m_event.m_startUs	= profiler.sinceStartUs(m_start);
+		m_event.m_wallUs	= std::chrono::duration_cast<std::chrono::microseconds>(end - m_start).count();
+		m_event.m_cpuUs		= Q3LoadProfiler::ThreadCpuTimeUs() - m_event.m_cpuUs;
+		m_event.m_numAllocs	= numAllocs - m_event.m_numAllocs;
+		m_event.m_allocBytes= allocBytes - m_event.m_allocBytes;
+		profiler.addEvent(std::move(m_event));
+	}
+}
+
+#if defined(Q3_PROFILE_ALLOCATIONS)
+//counts every allocation of the process per thread, only meant for profiling builds
+namespace
+{
+	void* CountedAlloc(std::size_t size, std::size_t alignment) noexcept
+	{
+		Misc::t_numAllocs++;
+		Misc::t_allocBytes += static_cast<std::int64_t>(size);
+		size = size ? size : 1;
+		if (!alignment)
+			return std::malloc(size);
+#if defined(_WIN32)
+		return _aligned_malloc(size, alignment);
+#else
+		void* ptr = nullptr;
+		return posix_memalign(&ptr, std::max(alignment, sizeof(void*)), size) == 0 ? ptr : nullptr;
+#endif
+	}
+
+	//aligned blocks need their own free on windows
+	void AlignedFree(void* ptr) noexcept
+	{
+#if defined(_WIN32)
+		_aligned_free(ptr);
+#else
+		std::free(ptr);
+#endif
+	}
+
+	void* CountedAllocOrThrow(std::size_t size, std::size_t alignment)
+	{
+		if (auto ptr = CountedAlloc(size, alignment))
+			return ptr;
+		throw std::bad_alloc();
+	}
+}
+
+void* operator new(std::size_t size)									{ return CountedAllocOrThrow(size, 0); }
+void* operator new[](std::size_t size)									{ return CountedAllocOrThrow(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept	{ return CountedAlloc(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept	{ return CountedAlloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t align)			{ return CountedAllocOrThrow(size, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t size, std::align_val_t align)			{ return CountedAllocOrThrow(size, static_cast<std::size_t>(align)); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept	{ return CountedAlloc(size, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept	{ return CountedAlloc(size, static_cast<std::size_t>(align)); }
+
+void operator delete(void* ptr) noexcept									{ std::free(ptr); }
+void operator delete[](void* ptr) noexcept									{ std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept						{ std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept						{ std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept				{ std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept			{ std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept					{ AlignedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept				{ AlignedFree(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept		{ AlignedFree(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept	{ AlignedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept	{ AlignedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept	{ AlignedFree(ptr); }
+#endif
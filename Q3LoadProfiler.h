@@ -0,0 +1,108 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <App/AppTypeDefs.h>
+
+namespace Misc
+{
+	/*
+		@brief: Scoped timers & counters for map loading. Every scope records wall time, thread cpu time
+		and the allocations made on its thread( counted when built with Q3_PROFILE_ALLOCATIONS ). Results
+		are written as a per-scope summary in JSON & as a Chrome trace-event timeline( chrome://tracing )
+	*/
+	class Q3LoadProfiler
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct Event
+		{
+			String				m_name;
+			String				m_detail;		//ie file name, optional
+			std::int64_t		m_startUs;		//since the start of the session
+			std::int64_t		m_wallUs;
+			std::int64_t		m_cpuUs;
+			std::int64_t		m_numAllocs;
+			std::int64_t		m_allocBytes;
+		};
+
+		static Q3LoadProfiler&	Global();
+
+		/*
+			@brief: Drop earlier results & start recording
+		*/
+		void					beginSession( const String& name );
+		void					endSession();
+		bool					enabled() const { return m_enabled; }
+
+		void					addEvent( Event&& event );
+
+		/*
+			@brief: Named totals, ie number of faces per type
+		*/
+		void					addCounter( const String& name, std::int64_t value );
+		void					setCounter( const String& name, std::int64_t value );
+
+		bool					writeJson( const String& path ) const;
+		bool					writeChromeTrace( const String& path ) const;
+
+		std::int64_t			sinceStartUs( Clock::time_point time ) const;
+
+		/*
+			@brief: Cpu time used by the calling thread & its allocation totals
+		*/
+		static std::int64_t		ThreadCpuTimeUs();
+		static void				ThreadAllocations( std::int64_t& count, std::int64_t& bytes );
+
+	private:
+		//one per thread that recorded events, so recording doesn't contend
+		struct ThreadBuffer
+		{
+			int					m_threadIndex;
+			mutable std::mutex	m_mutex;
+			std::vector<Event>	m_events;
+		};
+
+		ThreadBuffer&			threadBuffer();
+
+		std::atomic<bool>		m_enabled{ false };
+		String					m_sessionName;
+		Clock::time_point		m_sessionStart;
+
+		mutable std::mutex		m_mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+		std::map<String, std::int64_t> m_counters;
+	};
+
+	/*
+		@brief: Records an event for its lifetime when the profiler is enabled, costs a flag check otherwise
+	*/
+	class Q3ProfileScope
+	{
+	public:
+		explicit Q3ProfileScope( const char* name, const String& detail = String() );
+		explicit Q3ProfileScope( const String& name, const String& detail = String() );
+		~Q3ProfileScope();
+
+		Q3ProfileScope( const Q3ProfileScope& ) = delete;
+		Q3ProfileScope& operator = ( const Q3ProfileScope& ) = delete;
+
+	private:
+		void					begin();
+
+		bool					m_active;
+		Q3LoadProfiler::Event	m_event;
+		Q3LoadProfiler::Clock::time_point m_start;
+	};
+}
+
+#define Q3_PROFILE_CONCAT_IMP(a, b) a##b
+#define Q3_PROFILE_CONCAT(a, b) Q3_PROFILE_CONCAT_IMP(a, b)
+#define Q3_PROFILE_SCOPE(...) Misc::Q3ProfileScope Q3_PROFILE_CONCAT(q3ProfileScope, __LINE__)(__VA_ARGS__)
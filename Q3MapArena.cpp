@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <Misc/Q3MapArena.h>
+
+namespace Misc
+{
+	namespace
+	{
+		const std::size_t MIN_BLOCK_SIZE   = 64 * 1024;
+		const std::size_t BLOCK_ALIGNMENT  = alignof(std::max_align_t);
+	}
+
+	Q3MapArena::Q3MapArena(std::pmr::memory_resource* upstream)
+		: m_upstream(upstream)
+		, m_offset(0)
+		, m_bytesUsed(0)
+		, m_nextBlockSize(MIN_BLOCK_SIZE)
+	{
+
+	}
+
+	Q3MapArena::~Q3MapArena()
+	{
+		freeBlocks(0);
+	}
+
+	void Q3MapArena::reserve(std::size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_blocks.empty() && m_blocks.front().m_size >= bytes)
+			return;
+		//too small for this map, the old block is replaced rather than chained
+		freeBlocks(0);
+		addBlock(bytes);
+	}
+
+	void Q3MapArena::release(bool keepFirstBlock)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		//the next map of a rotation usually fits in the first block again
+		freeBlocks(keepFirstBlock ? 1 : 0);
+		m_offset		= 0;
+		m_bytesUsed		= 0;
+		m_nextBlockSize = std::max(MIN_BLOCK_SIZE, m_blocks.empty() ? 0 : m_blocks.front().m_size / 2);
+	}
+
+	std::size_t Q3MapArena::bytesUsed() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_bytesUsed;
+	}
+
+	std::size_t Q3MapArena::bytesReserved() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::size_t result = 0;
+		for (const auto& block : m_blocks)
+			result += block.m_size;
+		return result;
+	}
+
+	int Q3MapArena::numBlocks() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<int>(m_blocks.size());
+	}
+
+	void* Q3MapArena::do_allocate(std::size_t bytes, std::size_t alignment)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			if (!m_blocks.empty())
+			{
+				const auto& block = m_blocks.back();
+				auto address = reinterpret_cast<std::uintptr_t>(block.m_data) + m_offset;
+				auto padding = (alignment - address % alignment) % alignment;
+				if (m_offset + padding + bytes <= block.m_size)
+				{
+					m_offset	+= padding + bytes;
+					m_bytesUsed += padding + bytes;
+					return reinterpret_cast<void*>(address + padding);
+				}
+			}
+			//the rest of the current block is left unused, blocks grow so this happens rarely
+			addBlock(bytes + alignment);
+		}
+	}
+
+	void Q3MapArena::do_deallocate(void* /*ptr*/, std::size_t /*bytes*/, std::size_t /*alignment*/)
+	{
+		//memory is given back by release
+	}
+
+	bool Q3MapArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+	{
+		return this == &other;
+	}
+
+	void Q3MapArena::addBlock(std::size_t minSize)
+	{
+		auto size = std::max(minSize, m_nextBlockSize);
+		Block block;
+		block.m_data = static_cast<std::uint8_t*>(m_upstream->allocate(size, BLOCK_ALIGNMENT));
+		block.m_size = size;
+		m_blocks.push_back(block);
+		m_offset		= 0;
+		m_nextBlockSize = size * 2;
+	}
+
+	void Q3MapArena::freeBlocks(std::size_t firstBlock)
+	{
+		for (auto i = firstBlock; i < m_blocks.size(); ++i)
+			m_upstream->deallocate(m_blocks[i].m_data, m_blocks[i].m_size, BLOCK_ALIGNMENT);
+		m_blocks.resize(std::min(firstBlock, m_blocks.size()));
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <memory_resource>
+
+namespace Misc
+{
+	template<typename T>
+	using Q3ArenaVector = std::pmr::vector<T>;
+	template<typename Key, typename T>
+	using Q3ArenaMap	= std::pmr::map<Key, T>;
+
+	/*
+		@brief: Bump allocator for everything that lives as long as a map. Blocks come from the upstream
+		resource, the first one is sized up front( reserve ) so a load needs few heap calls. Deallocation
+		is a no-op, release gives all memory back at once & keeps the first block for the next map.
+		Safe to allocate from several threads
+	*/
+	class Q3MapArena : public std::pmr::memory_resource
+	{
+	public:
+		explicit Q3MapArena( std::pmr::memory_resource* upstream = std::pmr::new_delete_resource() );
+		~Q3MapArena();
+
+		Q3MapArena( const Q3MapArena& ) = delete;
+		Q3MapArena& operator = ( const Q3MapArena& ) = delete;
+
+		/*
+			@brief: Make sure the first block holds at least 'bytes', call while the arena is empty
+		*/
+		void						reserve( std::size_t bytes );
+
+		/*
+			@brief: Drop everything allocated so far, containers using the arena have to be empty or gone.
+			The first block is kept for the next map unless 'keepFirstBlock' is false
+		*/
+		void						release( bool keepFirstBlock = true );
+
+		std::size_t					bytesUsed() const;		//handed out, including alignment padding
+		std::size_t					bytesReserved() const;	//taken from upstream
+		int							numBlocks() const;		//upstream allocations of this map
+
+	private:
+		struct Block
+		{
+			std::uint8_t*			m_data;
+			std::size_t				m_size;
+		};
+
+		void*						do_allocate( std::size_t bytes, std::size_t alignment ) override;
+		void						do_deallocate( void* ptr, std::size_t bytes, std::size_t alignment ) override;
+		bool						do_is_equal( const std::pmr::memory_resource& other ) const noexcept override;
+
+		void						addBlock( std::size_t minSize );
+		void						freeBlocks( std::size_t firstBlock );
+
+		std::pmr::memory_resource*	m_upstream;
+		mutable std::mutex			m_mutex;
+		std::vector<Block>			m_blocks;			//current block is the last one
+		std::size_t					m_offset;			//into the current block
+		std::size_t					m_bytesUsed;
+		std::size_t					m_nextBlockSize;
+	};
+}
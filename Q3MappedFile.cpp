@@ -0,0 +1,161 @@
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <Misc/Q3MappedFile.h>
+
+namespace Misc
+{
+	Q3MappedFile::Q3MappedFile()
+		: m_data(nullptr)
+		, m_size(0)
+		, m_modifiedTime(0)
+#if defined(_WIN32)
+		, m_file(nullptr)
+		, m_mapping(nullptr)
+#endif
+	{
+
+	}
+
+	Q3MappedFile::~Q3MappedFile()
+	{
+		close();
+	}
+
+	void Q3MappedFile::assign(std::vector<std::uint8_t> data)
+	{
+		close();
+		m_copy = std::move(data);
+		m_data = m_copy.empty() ? nullptr : m_copy.data();
+		m_size = m_copy.size();
+	}
+
+#if defined(_WIN32)
+	bool Q3MappedFile::open(const String& path)
+	{
+		close();
+		auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		FILETIME writeTime;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || !GetFileTime(file, nullptr, nullptr, &writeTime))
+		{
+			CloseHandle(file);
+			return false;
+		}
+		auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		auto view	 = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!view)
+		{
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+		m_file	  = file;
+		m_mapping = mapping;
+		m_data	  = static_cast<const std::uint8_t*>(view);
+		m_size	  = static_cast<std::size_t>(size.QuadPart);
+		m_modifiedTime = static_cast<std::int64_t>((static_cast<std::uint64_t>(writeTime.dwHighDateTime) << 32) | writeTime.dwLowDateTime);
+		return true;
+	}
+
+	void Q3MappedFile::close()
+	{
+		if (m_data && m_copy.empty())
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file)
+			CloseHandle(m_file);
+		m_data	  = nullptr;
+		m_size	  = 0;
+		m_modifiedTime = 0;
+		m_file	  = nullptr;
+		m_mapping = nullptr;
+		m_copy	  = std::vector<std::uint8_t>();
+	}
+
+	void Q3MappedFile::willNeed() const
+	{
+		if (!m_data || !m_copy.empty())
+			return;
+		WIN32_MEMORY_RANGE_ENTRY range = { const_cast<std::uint8_t*>(m_data), m_size };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+
+	void Q3MappedFile::ReadAhead(const String& path)
+	{
+		auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		static thread_local std::uint8_t buffer[64 * 1024];
+		DWORD numRead = 0;
+		while (ReadFile(file, buffer, sizeof(buffer), &numRead, nullptr) && numRead)
+			;
+		CloseHandle(file);
+	}
+#else
+	bool Q3MappedFile::open(const String& path)
+	{
+		close();
+		auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		auto size = static_cast<std::size_t>(st.st_size);
+		auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd); //mapping keeps its own reference
+		if (data == MAP_FAILED)
+			return false;
+		m_data = static_cast<const std::uint8_t*>(data);
+		m_size = size;
+		m_modifiedTime = static_cast<std::int64_t>(st.st_mtime);
+		return true;
+	}
+
+	void Q3MappedFile::close()
+	{
+		if (m_data && m_copy.empty())
+			munmap(const_cast<std::uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+		m_size = 0;
+		m_modifiedTime = 0;
+		m_copy = std::vector<std::uint8_t>();
+	}
+
+	void Q3MappedFile::willNeed() const
+	{
+		if (m_data && m_copy.empty())
+			madvise(const_cast<std::uint8_t*>(m_data), m_size, MADV_WILLNEED);
+	}
+
+	void Q3MappedFile::ReadAhead(const String& path)
+	{
+		auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return;
+#if defined(POSIX_FADV_WILLNEED)
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED); //reads go on after the close
+#endif
+		::close(fd);
+	}
+#endif
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <App/AppTypeDefs.h>
+
+namespace Misc
+{
+	/*
+		@brief: Read-only memory mapping of a whole file, or a copy of files that can't be mapped
+	*/
+	class Q3MappedFile
+	{
+	public:
+		Q3MappedFile();
+		~Q3MappedFile();
+
+		Q3MappedFile( const Q3MappedFile& ) = delete;
+		Q3MappedFile& operator = ( const Q3MappedFile& ) = delete;
+
+		/*
+			@brief: Map 'path', closes a previously mapped file. Returns false upon failure
+		*/
+		bool						open( const String& path );
+		void						close();
+
+		/*
+			@brief: Use 'data' as the file contents, for files read through the engine file stream
+			( packaged files ). Closes a previously mapped file
+		*/
+		void						assign( std::vector<std::uint8_t> data );
+
+		/*
+			@brief: Hint that the whole file will be read soon, starts read-ahead in the background
+		*/
+		void						willNeed() const;
+
+		/*
+			@brief: Start reading 'path' into the OS file cache without mapping or keeping it. A hint where
+			the OS has one( posix_fadvise ), elsewhere the file is read through a small buffer
+		*/
+		static void					ReadAhead( const String& path );
+
+		bool						isOpen() const	{ return m_data != nullptr; }
+		const std::uint8_t*			data() const	{ return m_data; }
+		std::size_t					size() const	{ return m_size; }
+		/*
+			@brief: Last write time of the mapped file, 0 for assigned files
+		*/
+		std::int64_t				modifiedTime() const { return m_modifiedTime; }
+
+	private:
+		const std::uint8_t*			m_data;
+		std::size_t					m_size;
+		std::int64_t				m_modifiedTime;
+		std::vector<std::uint8_t>	m_copy;		//contents of an assigned file, nothing is mapped then
+#if defined(_WIN32)
+		void*						m_file;
+		void*						m_mapping;
+#endif
+	};
+}
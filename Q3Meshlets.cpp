@@ -0,0 +1,168 @@
+#include <cmath>
+#include <algorithm>
+#include <Misc/Q3Meshlets.h>
+
+namespace Misc
+{
+	namespace
+	{
+		//triangles joining a meshlet stay within ~60 degrees of its average facing
+		const float		MESHLET_MIN_FACING	= 0.5f;
+		//below this the normal cone spans ~84 degrees off its axis & never culls
+		const float		MESHLET_MIN_CONE	= 0.1f;
+
+		float Dot(const float* a, const float* b)
+		{
+			return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+		}
+
+		void Normalize(float* v)
+		{
+			auto len = std::sqrt(Dot(v, v));
+			if (len <= 0.0f)
+				return;
+			for (int k = 0; k < 3; ++k)
+				v[k] /= len;
+		}
+
+		//unit normal, flipped to the side the vertex normals point to
+		void TriangleFacing(const std::uint32_t* triangle, const App::MeshVertex* vertices, float* result)
+		{
+			const auto& p0 = vertices[triangle[0]].m_worldCoord;
+			const auto& p1 = vertices[triangle[1]].m_worldCoord;
+			const auto& p2 = vertices[triangle[2]].m_worldCoord;
+			float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			result[0] = e0[1] * e1[2] - e0[2] * e1[1];
+			result[1] = e0[2] * e1[0] - e0[0] * e1[2];
+			result[2] = e0[0] * e1[1] - e0[1] * e1[0];
+
+			float vertexNormal[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 3; ++i)
+			{
+				auto n = vertices[triangle[i]].getNormal();
+				for (int k = 0; k < 3; ++k)
+					vertexNormal[k] += n[k];
+			}
+			if (Dot(result, result) <= 0.0f) //degenerate
+				std::copy(vertexNormal, vertexNormal + 3, result);
+			else if (Dot(result, vertexNormal) < 0.0f)
+				for (int k = 0; k < 3; ++k)
+					result[k] = -result[k];
+			Normalize(result);
+		}
+
+		Q3Meshlet MeshletBounds(const std::uint32_t* indices, int start, int count, const App::MeshVertex* vertices, const std::vector<float>& facing)
+		{
+			Q3Meshlet result;
+			result.m_indexStart = start;
+			result.m_indexCount = count;
+			for (int i = start; i < start + count; ++i)
+				result.m_bounds.updateBounds(vertices[indices[i]].m_worldCoord);
+			result.m_center = result.m_bounds.getCenter();
+			float radiusSqr = 0.0f;
+			for (int i = start; i < start + count; ++i)
+				radiusSqr = std::max(radiusSqr, vertices[indices[i]].m_worldCoord.distanceSquared(result.m_center));
+			result.m_radius = std::sqrt(radiusSqr);
+
+			float axis[3] = { 0.0f, 0.0f, 0.0f };
+			for (int t = start / 3; t < (start + count) / 3; ++t)
+				for (int k = 0; k < 3; ++k)
+					axis[k] += facing[t * 3 + k];
+			Normalize(axis);
+			auto minDot = 1.0f;
+			for (int t = start / 3; t < (start + count) / 3; ++t)
+				minDot = std::min(minDot, Dot(axis, &facing[t * 3]));
+			result.m_coneAxis	= Math::Vector3f(axis[0], axis[1], axis[2]);
+			result.m_coneCutoff = minDot <= MESHLET_MIN_CONE ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+			return result;
+		}
+	}
+
+	bool Q3Meshlet::backFacing(const Math::Vector3f& eye) const
+	{
+		//the eye is behind every triangle plane when it sees the sphere from within the cone's back side
+		float toCenter[3] = { m_center[0] - eye[0], m_center[1] - eye[1], m_center[2] - eye[2] };
+		float axis[3]	  = { m_coneAxis[0], m_coneAxis[1], m_coneAxis[2] };
+		return Dot(toCenter, axis) >= m_coneCutoff * std::sqrt(Dot(toCenter, toCenter)) + m_radius;
+	}
+
+	void BuildMeshlets(std::uint32_t* indices, std::size_t numIndices, const App::MeshVertex* vertices, std::size_t numVertices,
+		std::vector<Q3Meshlet>& result)
+	{
+		result.clear();
+		const auto numTriangles = static_cast<int>(numIndices / 3);
+		if (numTriangles == 0)
+			return;
+
+		std::vector<float> facing(numTriangles * 3);
+		for (int t = 0; t < numTriangles; ++t)
+			TriangleFacing(indices + t * 3, vertices, &facing[t * 3]);
+
+		//triangles of each vertex
+		std::vector<int> triangleStart(numVertices + 1, 0);
+		for (int i = 0; i < numTriangles * 3; ++i)
+			triangleStart[indices[i] + 1]++;
+		for (std::size_t v = 0; v < numVertices; ++v)
+			triangleStart[v + 1] += triangleStart[v];
+		std::vector<int> vertexTriangles(triangleStart[numVertices]);
+		{
+			auto next = triangleStart;
+			for (int i = 0; i < numTriangles * 3; ++i)
+				vertexTriangles[next[indices[i]]++] = i / 3;
+		}
+
+		std::vector<std::uint32_t> ordered;
+		ordered.reserve(numTriangles * 3);
+		std::vector<float> orderedFacing;
+		orderedFacing.reserve(numTriangles * 3);
+		std::vector<bool> assigned(numTriangles, false);
+		std::vector<int> frontier;
+		int seed = 0;
+		while (static_cast<int>(ordered.size()) < numTriangles * 3)
+		{
+			while (assigned[seed])
+				seed++;
+			const auto start = static_cast<int>(ordered.size());
+			float sumFacing[3] = { 0.0f, 0.0f, 0.0f };
+
+			//breadth first over shared vertices keeps the meshlets compact
+			frontier.clear();
+			frontier.push_back(seed);
+			assigned[seed] = true;
+			int count = 0;
+			for (std::size_t f = 0; f < frontier.size() && count < MESHLET_MAX_TRIANGLES; ++f)
+			{
+				const auto t = frontier[f];
+				const auto* triangle = indices + t * 3;
+				ordered.insert(std::end(ordered), triangle, triangle + 3);
+				orderedFacing.insert(std::end(orderedFacing), &facing[t * 3], &facing[t * 3] + 3);
+				for (int k = 0; k < 3; ++k)
+					sumFacing[k] += facing[t * 3 + k];
+				count++;
+
+				float average[3] = { sumFacing[0], sumFacing[1], sumFacing[2] };
+				Normalize(average);
+				for (int k = 0; k < 3; ++k)
+				{
+					for (auto i = triangleStart[triangle[k]]; i < triangleStart[triangle[k] + 1]; ++i)
+					{
+						auto other = vertexTriangles[i];
+						if (assigned[other] || Dot(average, &facing[other * 3]) < MESHLET_MIN_FACING)
+							continue;
+						assigned[other] = true;
+						frontier.push_back(other);
+					}
+				}
+			}
+			//queued past the limit, they start the next meshlets
+			for (auto f = static_cast<std::size_t>(count); f < frontier.size(); ++f)
+			{
+				assigned[frontier[f]] = false;
+				seed = std::min(seed, frontier[f]);
+			}
+			result.push_back(MeshletBounds(ordered.data(), start, count * 3, vertices, orderedFacing));
+		}
+		std::copy(std::begin(ordered), std::end(ordered), indices);
+	}
+}
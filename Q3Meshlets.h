@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <Math/AABB.h>
+#include <Graphics/MeshVertex.h>
+
+namespace Misc
+{
+	static const int	MESHLET_MAX_TRIANGLES	= 96;
+
+	/*
+		@brief: Cluster of triangles in a draw range, culled on its own against the frustum & by its normal cone
+	*/
+	struct Q3Meshlet
+	{
+		/*
+			@brief: True if every triangle faces away from 'eye'
+		*/
+		bool						backFacing( const Math::Vector3f& eye ) const;
+
+		int							m_indexStart;	//relative to the draw info's index range
+		int							m_indexCount;
+		Math::BBox3f				m_bounds;
+		Math::Vector3f				m_center;		//bounding sphere
+		float						m_radius;
+		Math::Vector3f				m_coneAxis;		//average facing of the triangles
+		float						m_coneCutoff;	//sine of the cone spread, 1 never culls
+	};
+
+	/*
+		@brief: Reorder the triangles of a draw range into meshlets of up to MESHLET_MAX_TRIANGLES. Meshlets are
+		grown over shared vertices from the first triangle left, only taking triangles that face the same way
+		as the ones in it. Triangles face the side their vertex normals point to
+	*/
+	void			BuildMeshlets( std::uint32_t* indices, std::size_t numIndices, const App::MeshVertex* vertices, std::size_t numVertices,
+						std::vector<Q3Meshlet>& result );
+}
@@ -0,0 +1,187 @@
+#include <cmath>
+#include <algorithm>
+
+#include <Math/GenMath.h>
+#include <Misc/Q3PatchKernels.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define Q3_PATCH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace Misc
+{
+	namespace
+	{
+		//control point attributes as channels, [control][channel]
+		using ControlChannels = float[9][NUM_PATCH_CHANNELS];
+
+		void GetControlChannels(const App::MeshVertex* controls, ControlChannels& result)
+		{
+			for (int i = 0; i < 9; ++i)
+			{
+				const auto& vert  = controls[i];
+				const auto normal = vert.getNormal();
+				auto* channels	  = result[i];
+				for (int k = 0; k < 3; ++k)
+				{
+					channels[PATCH_POS_X + k]	 = vert.m_worldCoord[k];
+					channels[PATCH_NORMAL_X + k] = normal[k];
+				}
+				for (int k = 0; k < 2; ++k)
+				{
+					channels[PATCH_ST_S + k] = vert.m_stCoord[k];
+					channels[PATCH_UV_S + k] = vert.m_uvCoord[k];
+				}
+				for (int k = 0; k < 4; ++k)
+					channels[PATCH_COLOR_R + k] = static_cast<float>(vert.m_vertexColor[k]);
+			}
+		}
+
+		//quadratic bezier basis at t
+		void Basis(float t, float& b0, float& b1, float& b2)
+		{
+			auto s = 1.0f - t;
+			b0 = s * s;
+			b1 = 2.0f * s * t;
+			b2 = t * t;
+		}
+
+		//the 3 control rows evaluated at grid column x, [row][channel]
+		void EvaluateRows(const ControlChannels& controls, float t, float (&result)[3][NUM_PATCH_CHANNELS])
+		{
+			float b0, b1, b2;
+			Basis(t, b0, b1, b2);
+			for (int row = 0; row < 3; ++row)
+				for (int ch = 0; ch < NUM_PATCH_CHANNELS; ++ch)
+					result[row][ch] = b0 * controls[row * 3 + 0][ch] + b1 * controls[row * 3 + 1][ch] + b2 * controls[row * 3 + 2][ch];
+		}
+
+		void ResizeGrid(int levelX, int levelY, Q3PatchGrid& grid)
+		{
+			grid.m_levelX = levelX;
+			grid.m_levelY = levelY;
+			for (auto& channel : grid.m_channels)
+				channel.resize(grid.numVertices());
+
+			//per quad (x, y): (x+1, y+1), (x, y), (x+1, y) & (x, y+1), (x, y), (x+1, y+1)
+			const auto L1 = static_cast<std::uint32_t>(levelY + 1);
+			grid.m_indices.resize(static_cast<std::size_t>(levelX) * levelY * 6);
+			auto* index = grid.m_indices.data();
+			for (std::uint32_t x = 0; x < static_cast<std::uint32_t>(levelX); ++x)
+			{
+				for (std::uint32_t y = 0; y < static_cast<std::uint32_t>(levelY); ++y)
+				{
+					auto v00 = x * L1 + y;
+					auto v10 = v00 + L1;
+					*index++ = v10 + 1;
+					*index++ = v00;
+					*index++ = v10;
+					*index++ = v00 + 1;
+					*index++ = v00;
+					*index++ = v10 + 1;
+				}
+			}
+		}
+	}
+
+	bool PatchKernelsSIMD()
+	{
+#if Q3_PATCH_SSE
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	App::MeshVertex Q3PatchGrid::getVertex(int index) const
+	{
+		auto channel = [this, index](int ch) { return m_channels[ch][index]; };
+		auto color	 = [&channel](int ch)
+		{
+			return static_cast<std::uint8_t>(Math::Clamp(0.0f, 255.0f, std::floor(channel(ch) + 0.5f)));
+		};
+
+		App::MeshVertex result;
+		result.m_worldCoord	 = Math::Vector3f(channel(PATCH_POS_X), channel(PATCH_POS_Y), channel(PATCH_POS_Z));
+		result.m_stCoord	 = Math::Vector2f(channel(PATCH_ST_S), channel(PATCH_ST_T));
+		result.m_uvCoord	 = Math::Vector2f(channel(PATCH_UV_S), channel(PATCH_UV_T));
+		result.m_vertexColor = Math::Vector4ub(color(PATCH_COLOR_R), color(PATCH_COLOR_G), color(PATCH_COLOR_B), color(PATCH_COLOR_A));
+		result.setNormal(Math::Vector3f(channel(PATCH_NORMAL_X), channel(PATCH_NORMAL_Y), channel(PATCH_NORMAL_Z)).getNormalized());
+		return result;
+	}
+
+	void TessellatePatchGridScalar(const App::MeshVertex* controls, int levelX, int levelY, Q3PatchGrid& grid)
+	{
+		ControlChannels controlChannels;
+		GetControlChannels(controls, controlChannels);
+		ResizeGrid(levelX, levelY, grid);
+
+		const auto L1	 = levelY + 1;
+		const auto stepX = 1.0f / static_cast<float>(levelX);
+		const auto stepY = 1.0f / static_cast<float>(levelY);
+		for (int x = 0; x <= levelX; ++x)
+		{
+			float rows[3][NUM_PATCH_CHANNELS];
+			EvaluateRows(controlChannels, x * stepX, rows);
+			for (int y = 0; y <= levelY; ++y)
+			{
+				float b0, b1, b2;
+				Basis(y * stepY, b0, b1, b2);
+				for (int ch = 0; ch < NUM_PATCH_CHANNELS; ++ch)
+					grid.m_channels[ch][x * L1 + y] = b0 * rows[0][ch] + b1 * rows[1][ch] + b2 * rows[2][ch];
+			}
+		}
+	}
+
+	void TessellatePatchGrid(const App::MeshVertex* controls, int levelX, int levelY, Q3PatchGrid& grid)
+	{
+#if Q3_PATCH_SSE
+		if (levelY > MAX_PATCH_LEVEL)
+		{
+			TessellatePatchGridScalar(controls, levelX, levelY, grid);
+			return;
+		}
+		ControlChannels controlChannels;
+		GetControlChannels(controls, controlChannels);
+		ResizeGrid(levelX, levelY, grid);
+
+		//basis along the grid rows is the same for every row, the tail past whole vectors is scalar
+		const auto L1		= levelY + 1;
+		const auto numWide	= L1 & ~3;
+		const auto stepX	= 1.0f / static_cast<float>(levelX);
+		const auto stepY	= 1.0f / static_cast<float>(levelY);
+		float basis[3][MAX_PATCH_LEVEL + 1];
+		for (int y = 0; y < L1; ++y)
+			Basis(y * stepY, basis[0][y], basis[1][y], basis[2][y]);
+
+		for (int x = 0; x <= levelX; ++x)
+		{
+			float rows[3][NUM_PATCH_CHANNELS];
+			EvaluateRows(controlChannels, x * stepX, rows);
+			const auto rowStart = x * L1;
+			int y = 0;
+			for (; y < numWide; y += 4)
+			{
+				const __m128 b0 = _mm_loadu_ps(basis[0] + y);
+				const __m128 b1 = _mm_loadu_ps(basis[1] + y);
+				const __m128 b2 = _mm_loadu_ps(basis[2] + y);
+				for (int ch = 0; ch < NUM_PATCH_CHANNELS; ++ch)
+				{
+					__m128 value = _mm_mul_ps(b0, _mm_set1_ps(rows[0][ch]));
+					value = _mm_add_ps(value, _mm_mul_ps(b1, _mm_set1_ps(rows[1][ch])));
+					value = _mm_add_ps(value, _mm_mul_ps(b2, _mm_set1_ps(rows[2][ch])));
+					_mm_storeu_ps(grid.m_channels[ch].data() + rowStart + y, value);
+				}
+			}
+			for (; y < L1; ++y)
+			{
+				for (int ch = 0; ch < NUM_PATCH_CHANNELS; ++ch)
+					grid.m_channels[ch][rowStart + y] = basis[0][y] * rows[0][ch] + basis[1][y] * rows[1][ch] + basis[2][y] * rows[2][ch];
+			}
+		}
+#else
+		TessellatePatchGridScalar(controls, levelX, levelY, grid);
+#endif
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <Graphics/MeshVertex.h>
+
+namespace Misc
+{
+	/*
+		@brief: Returns true if the patch kernels below run their SIMD(SSE) path
+	*/
+	bool			PatchKernelsSIMD();
+
+	/*
+		@brief: Largest level the SIMD path evaluates without allocating, higher levels run the scalar path
+	*/
+	const static int MAX_PATCH_LEVEL = 16;
+
+	/*
+		@brief: Vertex attributes of a tessellated patch, one float stream each
+	*/
+	enum eQ3PatchChannel
+	{
+		PATCH_POS_X = 0,
+		PATCH_POS_Y,
+		PATCH_POS_Z,
+		PATCH_NORMAL_X,
+		PATCH_NORMAL_Y,
+		PATCH_NORMAL_Z,
+		PATCH_ST_S,			//texture map
+		PATCH_ST_T,
+		PATCH_UV_S,			//lightmap
+		PATCH_UV_T,
+		PATCH_COLOR_R,
+		PATCH_COLOR_G,
+		PATCH_COLOR_B,
+		PATCH_COLOR_A,
+		NUM_PATCH_CHANNELS
+	};
+
+	/*
+		@brief: Tessellated 3x3 patch block. Vertex (x, y) is at x * (levelY + 1) + y in every channel,
+		x runs along the control rows. m_indices holds 2 triangles per grid quad, wound like the other faces
+	*/
+	struct Q3PatchGrid
+	{
+		int							numVertices() const { return (m_levelX + 1) * (m_levelY + 1); }
+
+		/*
+			@brief: Interleaved vertex 'index', normal renormalized & colour rounded to bytes
+		*/
+		App::MeshVertex				getVertex( int index ) const;
+
+		int							m_levelX = 0;
+		int							m_levelY = 0;
+		std::vector<float>			m_channels[NUM_PATCH_CHANNELS];
+		std::vector<std::uint32_t>	m_indices;
+	};
+
+	/*
+		@brief: Evaluate the biquadratic patch of 'controls'( 3 rows of 3 ) on a 'levelX' by 'levelY' grid.
+		Rows of the grid are evaluated 4 vertices at a time for all channels
+	*/
+	void			TessellatePatchGrid( const App::MeshVertex* controls, int levelX, int levelY, Q3PatchGrid& grid );
+
+	/*
+		@brief: Scalar reference implementation, used as fallback & to validate the SIMD path
+	*/
+	void			TessellatePatchGridScalar( const App::MeshVertex* controls, int levelX, int levelY, Q3PatchGrid& grid );
+}
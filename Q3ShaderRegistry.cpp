@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <Misc/Q3LoadProfiler.h>
+#include <Misc/Q3ShaderRegistry.h>
+
+namespace Misc
+{
+	Q3ShaderRegistry& Q3ShaderRegistry::Global()
+	{
+		static Q3ShaderRegistry registry;
+		return registry;
+	}
+
+	Q3ShaderRegistry::ShaderList Q3ShaderRegistry::getScriptShaders(App::EngineContext* context, const String& path,
+		const std::uint8_t* data, std::size_t size, std::uint64_t hash)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_scripts.find(path);
+			if (it != std::end(m_scripts) && it->second.m_hash == hash)
+				return it->second.m_shaders;
+		}
+
+		//parse outside the lock, scripts are independent
+		Q3_PROFILE_SCOPE( "parse shader script", path );
+		Script script;
+		script.m_hash = hash;
+		Q3ParseShader parseShader( context, path );
+		if (parseShader.parseShaderData( reinterpret_cast<const char*>(data), size ))
+			script.m_shaders = std::move(parseShader.m_shaders);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& entry = m_scripts[path];
+		m_retired.insert(std::end(m_retired), std::begin(entry.m_shaders), std::end(entry.m_shaders));
+		entry = std::move(script);
+		return entry.m_shaders;
+	}
+
+	Q3ShaderPtr Q3ShaderRegistry::getRegularShader(App::EngineContext* context, const String& name)
+	{
+		if (auto shader = findRegularShader(name))
+			return shader;
+		auto shader = Q3Shader::CreateRegularShader(context, name);
+		if (!shader)
+			return nullptr;	//not cached, the texture may show up later
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto result = m_regularShaders.emplace(name, shader);
+		return result.first->second;
+	}
+
+	Q3ShaderPtr Q3ShaderRegistry::findRegularShader(const String& name) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_regularShaders.find(name);
+		return it != std::end(m_regularShaders) ? it->second : nullptr;
+	}
+
+	Q3ShaderPtr Q3ShaderRegistry::getFallbackShader(App::EngineContext* context)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_fallbackShader)
+			m_fallbackShader = Q3Shader::CreateFallBackShader(context);
+		return m_fallbackShader;
+	}
+
+	void Q3ShaderRegistry::acquire(const ShaderList& shaders)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& shader : shaders)
+			m_refCounts[shader.get()]++;
+	}
+
+	void Q3ShaderRegistry::release(const ShaderList& shaders)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& shader : shaders)
+		{
+			auto it = m_refCounts.find(shader.get());
+			if (it != std::end(m_refCounts) && --it->second <= 0)
+				m_refCounts.erase(it);
+		}
+	}
+
+	bool Q3ShaderRegistry::isUsed(const Q3Shader* shader) const
+	{
+		return m_refCounts.find(shader) != std::end(m_refCounts);
+	}
+
+	void Q3ShaderRegistry::unloadIfUnused(const Q3ShaderPtr& shader)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		//the fallback shader holds the default textures, those are never unloaded
+		if (shader != m_fallbackShader && !isUsed(shader.get()))
+			shader->unloadShader();
+	}
+
+	void Q3ShaderRegistry::purgeUnused()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto unload = [this](const Q3ShaderPtr& shader)
+		{
+			if (!isUsed(shader.get()))
+				shader->unloadShader();
+		};
+		for (auto& script : m_scripts)
+			std::for_each(std::begin(script.second.m_shaders), std::end(script.second.m_shaders), unload);
+		for (auto& regular : m_regularShaders)
+			unload(regular.second);
+
+		//retired shaders are gone for good once no map holds on to them
+		std::for_each(std::begin(m_retired), std::end(m_retired), unload);
+		m_retired.erase(std::remove_if(std::begin(m_retired), std::end(m_retired), [this](const Q3ShaderPtr& shader)
+		{
+			return !isUsed(shader.get());
+		}), std::end(m_retired));
+	}
+
+	int Q3ShaderRegistry::numScripts() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<int>(m_scripts.size());
+	}
+}
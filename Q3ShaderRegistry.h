@@ -0,0 +1,84 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include <App/AppTypeDefs.h>
+#include <Misc/Q3BSPShader.h>
+
+namespace Misc
+{
+	/*
+		@brief: Process wide cache of parsed shaders & their compiled programs, shared by all maps
+		and kept across map changes. Maps reference count the shaders they use, purgeUnused releases
+		the textures & programs of shaders no loaded map uses but keeps their parsed definition
+	*/
+	class Q3ShaderRegistry
+	{
+	public:
+		using ShaderList = std::vector<Q3ShaderPtr>;
+
+		Q3ShaderRegistry() = default;
+
+		Q3ShaderRegistry( const Q3ShaderRegistry& ) = delete;
+		Q3ShaderRegistry& operator = ( const Q3ShaderRegistry& ) = delete;
+
+		static Q3ShaderRegistry&	Global();
+
+		/*
+			@brief: Shaders defined by the script at 'path'. The script is only parsed when its contents
+			hash differs from the last call, shaders of a changed script are replaced
+		*/
+		ShaderList					getScriptShaders( App::EngineContext* context, const String& path,
+													  const std::uint8_t* data, std::size_t size, std::uint64_t hash );
+
+		/*
+			@brief: Shader for a texture without a script, created on first use. nullptr when the
+			texture doesn't exist
+		*/
+		Q3ShaderPtr					getRegularShader( App::EngineContext* context, const String& name );
+		Q3ShaderPtr					findRegularShader( const String& name ) const;
+
+		/*
+			@brief: Shader used when nothing else matches, created on first use. Looks up default
+			textures in the resource manager so the first call should be on the main thread
+		*/
+		Q3ShaderPtr					getFallbackShader( App::EngineContext* context );
+
+		/*
+			@brief: A map starts/stops using 'shaders', duplicates count once per occurence
+		*/
+		void						acquire( const ShaderList& shaders );
+		void						release( const ShaderList& shaders );
+
+		/*
+			@brief: Unload textures & program of 'shader' right away unless a map uses it, call on the main thread
+		*/
+		void						unloadIfUnused( const Q3ShaderPtr& shader );
+
+		/*
+			@brief: Unload textures & programs of all shaders no map uses, call on the main thread
+		*/
+		void						purgeUnused();
+
+		int							numScripts() const;
+
+	private:
+		struct Script
+		{
+			std::uint64_t			m_hash = 0;
+			ShaderList				m_shaders;
+		};
+
+		bool						isUsed( const Q3Shader* shader ) const;	//expects m_mutex to be locked
+
+		mutable std::mutex			m_mutex;
+		std::map<String, Script>	m_scripts;
+		std::map<String, Q3ShaderPtr> m_regularShaders;
+		ShaderList					m_retired;			//from changed scripts, unloaded once no map uses them
+		std::map<const Q3Shader*, int> m_refCounts;
+		Q3ShaderPtr					m_fallbackShader;
+	};
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cassert>
+#include <Misc/Q3LoadProfiler.h>
+#include <Misc/Q3TaskGraph.h>
+
+namespace Misc
+{
+	Q3TaskGraph::Q3TaskGraph(Q3ThreadPool& pool)
+		: m_pool(pool)
+		, m_cancelled(false)
+		, m_numDone(0)
+	{
+	}
+
+	Q3TaskGraph::TaskId Q3TaskGraph::addTask(const String& name, Task task, const std::vector<TaskId>& dependencies)
+	{
+		auto id	  = static_cast<TaskId>(m_tasks.size());
+		auto node = std::make_unique<Node>();
+		node->m_name			= name;
+		node->m_task			= std::move(task);
+		node->m_numDependencies = static_cast<int>(dependencies.size());
+		for (auto dependency : dependencies)
+		{
+			assert(dependency >= 0 && dependency < id);
+			m_tasks[dependency]->m_dependents.push_back(id);
+		}
+		m_tasks.push_back(std::move(node));
+		return id;
+	}
+
+	void Q3TaskGraph::run(bool serial)
+	{
+		if (m_tasks.empty())
+			return;
+		if (serial)
+		{
+			for (auto& node : m_tasks)
+				if (!m_cancelled)
+				{
+					Q3_PROFILE_SCOPE( node->m_name );
+					node->m_task();
+				}
+			return;
+		}
+
+		m_numDone = 0;
+		for (auto& node : m_tasks)
+			node->m_numWaiting = node->m_numDependencies;
+		//roots are collected first, a finishing root could otherwise start a task twice
+		std::vector<TaskId> roots;
+		for (TaskId id = 0; id < static_cast<TaskId>(m_tasks.size()); ++id)
+			if (m_tasks[id]->m_numDependencies == 0)
+				roots.push_back(id);
+		for (auto id : roots)
+			start(id);
+
+		//help out, tasks may wait on pool work( file reads, parallelFor ) themselves
+		for (;;)
+		{
+			if (m_pool.runPendingTask())
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_numDone == m_tasks.size())
+					return;
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_done.wait_for(lock, std::chrono::milliseconds(1), [this]() { return m_numDone == m_tasks.size(); }))
+				return;
+		}
+	}
+
+	void Q3TaskGraph::start(TaskId id)
+	{
+		m_pool.enqueue([this, id]()
+		{
+			if (!m_cancelled)
+			{
+				Q3_PROFILE_SCOPE( m_tasks[id]->m_name );
+				m_tasks[id]->m_task();
+			}
+			finish(id);
+		});
+	}
+
+	void Q3TaskGraph::finish(TaskId id)
+	{
+		//dependents are queued from this worker, so they tend to run where their inputs are hot
+		for (auto dependent : m_tasks[id]->m_dependents)
+			if (--m_tasks[dependent]->m_numWaiting == 0)
+				start(dependent);
+
+		//nothing of the graph is touched after this, run may return & destroy it
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (++m_numDone == m_tasks.size())
+			m_done.notify_all();
+	}
+}
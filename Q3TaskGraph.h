@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+#include <App/AppTypeDefs.h>
+#include <Misc/Q3ThreadPool.h>
+
+namespace Misc
+{
+	/*
+		@brief: Tasks with explicit dependencies, run on a thread pool. A task starts as soon as all
+		the tasks it depends on are done. Dependencies have to be added first, so the order tasks are
+		added in is also a valid serial order
+	*/
+	class Q3TaskGraph
+	{
+	public:
+		using TaskId = int;
+		using Task	 = std::function<void()>;
+
+		explicit Q3TaskGraph( Q3ThreadPool& pool = Q3ThreadPool::Global() );
+
+		Q3TaskGraph( const Q3TaskGraph& ) = delete;
+		Q3TaskGraph& operator = ( const Q3TaskGraph& ) = delete;
+
+		TaskId						addTask( const String& name, Task task, const std::vector<TaskId>& dependencies = {} );
+
+		/*
+			@brief: Run all tasks & block until they're done, the calling thread runs pool tasks while
+			it waits. 'serial' runs the tasks one by one on the calling thread in the order they were
+			added, for reproducible debugging
+		*/
+		void						run( bool serial = false );
+
+		/*
+			@brief: Skip all tasks that haven't started yet, safe to call from a task
+		*/
+		void						cancel() { m_cancelled = true; }
+		bool						cancelled() const { return m_cancelled; }
+
+		std::size_t					numTasks() const { return m_tasks.size(); }
+		const String&				getName( TaskId id ) const { return m_tasks[id]->m_name; }
+
+	private:
+		struct Node
+		{
+			String					m_name;
+			Task					m_task;
+			std::vector<TaskId>		m_dependents;
+			int						m_numDependencies = 0;
+			std::atomic<int>		m_numWaiting{ 0 };		//dependencies not done yet
+		};
+
+		void						start( TaskId id );
+		void						finish( TaskId id );
+
+		Q3ThreadPool&				m_pool;
+		std::vector<std::unique_ptr<Node>> m_tasks;
+		std::atomic<bool>			m_cancelled;
+
+		std::mutex					m_mutex;
+		std::condition_variable		m_done;
+		std::size_t					m_numDone;
+	};
+}
@@ -0,0 +1,404 @@
+#include <chrono>
+#include <algorithm>
+
+#include <Engine/EngineContext.hpp>
+#include <Resource/ConcreteResources.hpp>
+#include <App/AppCommon.h>
+#include <Misc/Q3ImageKernels.h>
+#include <Misc/Q3ThreadPool.h>
+#include <Misc/Q3LoadProfiler.h>
+#include <Misc/Q3MappedFile.h>
+#include <Misc/Q3TextureStream.h>
+
+namespace Misc
+{
+	namespace
+	{
+		const Common::Image& GetPlaceholderImage()
+		{
+			static Common::Image placeholder;
+			static std::once_flag once;
+			std::call_once(once, []()
+			{
+				std::vector<std::uint8_t> grey(4 * 4 * 3, 128);
+				placeholder.loadFromMemory(grey.data(), Common::IMAGE_FORMAT_RGB8_UI, 4, 4);
+			});
+			return placeholder;
+		}
+	}
+
+	void GenerateBoxMipmaps(Common::Image& image, int maxLevels)
+	{
+		auto width	= image.getWidth();
+		auto height = image.getHeight();
+		auto bpp	= image.getImageFormat().m_numChannels;
+		if (bpp != 3 && bpp != 4)
+		{
+			Common::MipMapPixelFilter filter;
+			image.generateMipmaps(&filter);
+			return;
+		}
+
+		const auto format = bpp == 4 ? Common::IMAGE_FORMAT_RGBA8_UI : Common::IMAGE_FORMAT_RGB8_UI;
+		image.m_mipMaps.clear();
+		const std::uint8_t* src = image.m_data.data();
+		std::vector<std::uint8_t> dst;
+		while ((width > 1 || height > 1) && static_cast<int>(image.m_mipMaps.size()) != maxLevels)
+		{
+			auto newWidth  = std::max(1, width / 2);
+			auto newHeight = std::max(1, height / 2);
+			dst.resize(static_cast<std::size_t>(newWidth) * newHeight * bpp);
+			BoxFilterDownsample(src, width, height, bpp, dst.data());
+			Common::Image level;
+			if (!level.loadFromMemory(dst.data(), format, newWidth, newHeight))
+				return;
+			image.m_mipMaps.push_back(std::move(level));
+			src	   = image.m_mipMaps.back().m_data.data();
+			width  = newWidth;
+			height = newHeight;
+		}
+	}
+
+	bool DecodeQ3Texture(const std::uint8_t* data, std::size_t size, bool flipVertical, bool addAlpha,
+		Common::Image& full, Common::Image* preview)
+	{
+		if (!full.loadFromFileMemory(data, size))
+			return false;
+
+		auto width	= full.getWidth();
+		auto height = full.getHeight();
+		auto bpp	= full.getImageFormat().m_numChannels;
+		if (flipVertical)
+			FlipImageVertical(full.m_data.data(), width, height, bpp);
+		if (addAlpha && bpp == 3)
+		{
+			std::vector<std::uint8_t> rgba(static_cast<std::size_t>(width) * height * 4);
+			ExpandRGBToRGBA(full.m_data.data(), rgba.data(), static_cast<std::size_t>(width) * height, 0);
+			full.loadFromMemory(rgba.data(), Common::IMAGE_FORMAT_RGBA8_UI, width, height);
+			bpp = 4;
+		}
+
+		//preview is the tail of the mip chain
+		const auto previewSize = Q3TextureStreamer::PREVIEW_SIZE;
+		if (preview && (bpp == 3 || bpp == 4) && (width > previewSize || height > previewSize))
+		{
+			std::vector<std::uint8_t> src(full.m_data), dst;
+			while (width > previewSize || height > previewSize)
+			{
+				auto newWidth  = std::max(1, width / 2);
+				auto newHeight = std::max(1, height / 2);
+				dst.resize(static_cast<std::size_t>(newWidth) * newHeight * bpp);
+				BoxFilterDownsample(src.data(), width, height, bpp, dst.data());
+				src.swap(dst);
+				width  = newWidth;
+				height = newHeight;
+			}
+			auto format = bpp == 4 ? Common::IMAGE_FORMAT_RGBA8_UI : Common::IMAGE_FORMAT_RGB8_UI;
+			if (preview->loadFromMemory(src.data(), format, width, height))
+				GenerateBoxMipmaps(*preview);
+		}
+
+		//full mip chain is built here instead of on the render thread
+		GenerateBoxMipmaps(full);
+		return true;
+	}
+
+	Q3TexturePrefetcher::~Q3TexturePrefetcher()
+	{
+		clear();
+	}
+
+	void Q3TexturePrefetcher::prefetch(const StringList& paths)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		StringList newPaths;
+		for (const auto& path : paths)
+		{
+			if (!path.empty() && m_paths.insert(path).second)
+				newPaths.push_back(path);
+		}
+		if (newPaths.empty())
+			return;
+		//a single job, read ahead may block where there's no hint for it
+		m_activeReads++;
+		Q3ThreadPool::Global().enqueue([this, newPaths]()
+		{
+			for (const auto& path : newPaths)
+			{
+				if (m_cancel)
+					break;
+				Q3MappedFile::ReadAhead(path);
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_activeReads--;
+			m_readDone.notify_all();
+		});
+	}
+
+	void Q3TexturePrefetcher::clear()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cancel = true;
+		m_readDone.wait(lock, [this]() { return m_activeReads == 0; });
+		m_paths.clear();
+		m_cancel = false;
+	}
+
+	int Q3TexturePrefetcher::numPrefetched() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<int>(m_paths.size());
+	}
+
+	Q3TextureStreamer::Q3TextureStreamer(App::EngineContext* context)
+		: m_context(context)
+		, m_activeReads(0)
+		, m_activeDecodes(0)
+		, m_maxDecodes(std::max(1, Q3ThreadPool::Global().numThreads() / 2))
+		, m_cancel(false)
+	{
+
+	}
+
+	Q3TextureStreamer::~Q3TextureStreamer()
+	{
+		clear();
+	}
+
+	bool Q3TextureStreamer::request(const TexturePtr& texture, const String& path, const Q3Shader* owner, bool flipVertical, bool addAlpha)
+	{
+		//usable right away, real data follows
+		if (!texture->setFromImage(GetPlaceholderImage()))
+			return false;
+
+		auto request = std::make_shared<StreamRequest>();
+		request->m_texture	= texture;
+		request->m_path		= path;
+		request->m_flip		= flipVertical;
+		request->m_addAlpha = addAlpha;
+		request->m_priority = 0.0f;
+		request->m_state	= STATE_QUEUED;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_requests.push_back(request);
+			m_byTexture[texture.get()] = request;
+			m_byShader[owner].push_back(request);
+			scheduleReads();
+		}
+		return true;
+	}
+
+	void Q3TextureStreamer::addOwner(const TexturePtr& texture, const Q3Shader* owner)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_byTexture.find(texture.get());
+		if (it != std::end(m_byTexture))
+			m_byShader[owner].push_back(it->second);
+	}
+
+	void Q3TextureStreamer::touch(const Q3Shader* shader, float screenSize)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_byShader.find(shader);
+		if (it == std::end(m_byShader))
+			return;
+		for (auto& request : it->second)
+			request->m_priority = std::max(request->m_priority, screenSize);
+	}
+
+	void Q3TextureStreamer::update(float budgetMs)
+	{
+		using Clock = std::chrono::steady_clock;
+		const auto start = Clock::now();
+		auto elapsedMs = [start]() -> float
+		{
+			return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+		};
+
+		std::vector<RequestPtr> ready;
+		std::vector<RequestPtr> failed;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& request : m_requests)
+			{
+				if (request->m_state == STATE_DECODED || request->m_state == STATE_PREVIEW)
+					ready.push_back(request);
+				else if (request->m_state == STATE_FAILED)
+					failed.push_back(request);
+				request->m_priority *= 0.95f; //forget shaders that are no longer visible
+			}
+			//drop finished requests
+			m_requests.erase(std::remove_if(std::begin(m_requests), std::end(m_requests), [](const RequestPtr& r)
+			{
+				return r->m_state == STATE_RESIDENT || r->m_state == STATE_FAILED;
+			}), std::end(m_requests));
+		}
+		for (auto& request : failed)
+			App::AddConsoleMessage(m_context, String("Could not stream texture: ") + request->m_path, App::LOG_LEVEL_WARNING);
+
+		std::sort(std::begin(ready), std::end(ready), [](const RequestPtr& a, const RequestPtr& b)
+		{
+			return a->m_priority > b->m_priority;
+		});
+
+		//previews are tiny, always upload them
+		for (auto& request : ready)
+		{
+			if (request->m_state != STATE_DECODED)
+				continue;
+			if (request->m_preview.m_data.empty() || request->m_texture->setFromImage(request->m_preview))
+				request->m_preview = Common::Image();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			request->m_state = STATE_PREVIEW;
+		}
+		//full images by priority, at least one per frame
+		bool uploaded = false;
+		for (auto& request : ready)
+		{
+			if (uploaded && elapsedMs() > budgetMs)
+				break;
+			request->m_texture->setFromImage(request->m_full);
+			request->m_full = Common::Image();
+			uploaded = true;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			request->m_state = STATE_RESIDENT;
+		}
+	}
+
+	void Q3TextureStreamer::clear()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cancel = true;
+		m_decodesDone.wait(lock, [this]() { return m_activeDecodes == 0 && m_activeReads == 0; });
+		m_requests.clear();
+		m_byTexture.clear();
+		m_byShader.clear();
+		m_cancel = false;
+	}
+
+	int Q3TextureStreamer::numPending() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<int>(std::count_if(std::begin(m_requests), std::end(m_requests), [](const RequestPtr& r)
+		{
+			return r->m_state != STATE_RESIDENT && r->m_state != STATE_FAILED;
+		}));
+	}
+
+	bool Q3TextureStreamer::isStreaming(const Q3Shader* shader) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_byShader.find(shader);
+		if (it == std::end(m_byShader))
+			return false;
+		return std::any_of(std::begin(it->second), std::end(it->second), [](const RequestPtr& r)
+		{
+			return r->m_state != STATE_RESIDENT && r->m_state != STATE_FAILED;
+		});
+	}
+
+	void Q3TextureStreamer::scheduleReads()
+	{
+		//highest priority first, a small window keeps late priority changes effective
+		while (!m_cancel && m_activeReads < READ_WINDOW)
+		{
+			RequestPtr next;
+			for (auto& request : m_requests)
+			{
+				if (request->m_state != STATE_QUEUED)
+					continue;
+				if (!next || request->m_priority > next->m_priority)
+					next = request;
+			}
+			if (!next)
+				return;
+			next->m_state = STATE_READING;
+			m_activeReads++;
+			auto onDone = [this, next](Q3ReadResult& result)
+			{
+				onRead(next, result);
+			};
+			//through the engine file stream, packaged textures aren't loose files
+			auto context = m_context;
+			auto path	 = next->m_path;
+			Q3ThreadPool::Global().enqueue([context, path, onDone]()
+			{
+				Q3ReadResult result;
+				result.m_path	= path;
+				result.m_succes = Q3ReadFile(context, path, result.m_data);
+				onDone(result);
+			});
+		}
+	}
+
+	void Q3TextureStreamer::onRead(const RequestPtr& request, Q3ReadResult& result)
+	{
+		//everything under the lock, clear() may destroy us as soon as m_activeReads drops
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (result.m_succes)
+		{
+			request->m_fileData = std::move(result.m_data);
+			request->m_state	= STATE_READ;
+		}
+		else
+			request->m_state	= STATE_FAILED;
+		scheduleReads();
+		scheduleDecodes();
+		m_activeReads--;
+		m_decodesDone.notify_all();
+	}
+
+	void Q3TextureStreamer::scheduleDecodes()
+	{
+		while (!m_cancel && m_activeDecodes < m_maxDecodes)
+		{
+			m_activeDecodes++;
+			Q3ThreadPool::Global().enqueue([this]() { decodeNext(); });
+		}
+	}
+
+	void Q3TextureStreamer::decodeNext()
+	{
+		for (;;)
+		{
+			RequestPtr next;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_cancel)
+				{
+					for (auto& request : m_requests)
+					{
+						if (request->m_state != STATE_READ)
+							continue;
+						if (!next || request->m_priority > next->m_priority)
+							next = request;
+					}
+				}
+				if (!next)
+				{
+					//nothing left, a new request will schedule another decoder
+					m_activeDecodes--;
+					m_decodesDone.notify_all();
+					return;
+				}
+				next->m_state = STATE_DECODING;
+			}
+
+			Common::Image preview, full;
+			bool succes = false;
+			{
+				Q3_PROFILE_SCOPE( "decode texture", next->m_path );
+				succes = DecodeQ3Texture(next->m_fileData.data(), next->m_fileData.size(), next->m_flip, next->m_addAlpha, full, &preview);
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			next->m_fileData = std::vector<std::uint8_t>();
+			if (succes)
+			{
+				next->m_preview = std::move(preview);
+				next->m_full	= std::move(full);
+			}
+			next->m_state = succes ? STATE_DECODED : STATE_FAILED;
+		}
+	}
+}
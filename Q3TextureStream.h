@@ -0,0 +1,155 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <Common/Image.h>
+#include <App/AppTypeDefs.h>
+#include <Misc/Q3BspTypes.h>
+#include <Misc/Q3AsyncIO.h>
+
+namespace Misc
+{
+	class Q3Shader;
+
+	/*
+		@brief: Replace the mip chain of 'image' with 2x2 box filtered levels( BoxFilterDownsample ), at most
+		'maxLevels' below the image when it's not negative. Formats other than RGB8 & RGBA8 use the engine filter
+	*/
+	void			GenerateBoxMipmaps( Common::Image& image, int maxLevels = -1 );
+
+	/*
+		@brief: Decode the image file in 'data', flip & add alpha with the image kernels & build its mip
+		chain. 'preview' gets the tail of the chain when given & the image is larger than PREVIEW_SIZE
+	*/
+	bool			DecodeQ3Texture( const std::uint8_t* data, std::size_t size, bool flipVertical, bool addAlpha,
+									 Common::Image& full, Common::Image* preview = nullptr );
+
+	/*
+		@brief: Warms the OS file cache with the texture files of a map before the shaders that use them
+		are loaded. Only read ahead hints( Q3MappedFile::ReadAhead ) are issued, no file data is kept
+	*/
+	class Q3TexturePrefetcher
+	{
+	public:
+		Q3TexturePrefetcher() = default;
+		~Q3TexturePrefetcher();
+
+		/*
+			@brief: Queue read ahead for 'paths' on the thread pool, paths already prefetched are ignored
+		*/
+		void							prefetch( const StringList& paths );
+
+		/*
+			@brief: Stop the queued read ahead after the file it's at
+		*/
+		void							clear();
+
+		int								numPrefetched() const;
+
+	private:
+		mutable std::mutex				m_mutex;
+		std::condition_variable			m_readDone;
+		std::set<String>				m_paths;
+		int								m_activeReads = 0;
+		std::atomic<bool>				m_cancel{ false };
+	};
+
+	/*
+		@brief: Progressive texture loader. A requested texture is usable immediately with a small
+		placeholder, gets a low resolution preview once it has been decoded in the background and
+		the full mip chain when the per-frame upload budget allows. Files are read through the engine file stream
+		on the thread pool. Textures are decoded & uploaded in order of the projected screen size of the shaders that use them.
+	*/
+	class Q3TextureStreamer
+	{
+	public:
+		const static int PREVIEW_SIZE = 32;	//max width/height of the preview mip
+		const static int READ_WINDOW  = 16;	//max file reads in flight, ahead of the decoders
+
+		explicit Q3TextureStreamer( App::EngineContext* context );
+		~Q3TextureStreamer();
+
+		/*
+			@brief: Set a placeholder on 'texture' & queue the image at 'path' for decoding
+		*/
+		bool							request( const TexturePtr& texture, const String& path, const Q3Shader* owner,
+												 bool flipVertical, bool addAlpha );
+
+		/*
+			@brief: Another shader uses an already requested texture, ignored for non-streamed textures
+		*/
+		void							addOwner( const TexturePtr& texture, const Q3Shader* owner );
+
+		/*
+			@brief: Shader is visible this frame, 'screenSize' is its projected size
+		*/
+		void							touch( const Q3Shader* shader, float screenSize );
+
+		/*
+			@brief: Upload decoded images within 'budgetMs', call once per frame on the render thread
+		*/
+		void							update( float budgetMs );
+
+		/*
+			@brief: Cancel background work & drop all requests
+		*/
+		void							clear();
+
+		int								numPending() const;
+
+		/*
+			@brief: True while textures of 'shader' haven't got their full image yet
+		*/
+		bool							isStreaming( const Q3Shader* shader ) const;
+
+	private:
+		enum eStreamState
+		{
+			STATE_QUEUED,
+			STATE_READING,
+			STATE_READ,			//file data in memory, waiting for a decoder
+			STATE_DECODING,
+			STATE_DECODED,
+			STATE_PREVIEW,		//preview uploaded, full image pending
+			STATE_RESIDENT,
+			STATE_FAILED
+		};
+
+		struct StreamRequest
+		{
+			TexturePtr					m_texture;
+			String						m_path;
+			bool						m_flip;
+			bool						m_addAlpha;
+			float						m_priority;
+			eStreamState				m_state;
+			std::vector<std::uint8_t>	m_fileData;
+			Common::Image				m_preview;
+			Common::Image				m_full;
+		};
+		using RequestPtr = std::shared_ptr<StreamRequest>;
+
+		void							scheduleReads();	//expects m_mutex to be locked
+		void							onRead( const RequestPtr& request, Q3ReadResult& result );
+		void							scheduleDecodes();	//expects m_mutex to be locked
+		void							decodeNext();
+
+		App::EngineContext*				m_context;
+		std::vector<RequestPtr>			m_requests;
+		std::map<const App::Texture*, RequestPtr>				m_byTexture;
+		std::map<const Q3Shader*, std::vector<RequestPtr>>		m_byShader;
+
+		mutable std::mutex				m_mutex;
+		std::condition_variable			m_decodesDone;	//also signals finished reads
+		int								m_activeReads;
+		int								m_activeDecodes;
+		int								m_maxDecodes;
+		std::atomic<bool>				m_cancel;
+	};
+}
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <memory>
+#include <Misc/Q3ThreadPool.h>
+
+namespace Misc
+{
+	namespace
+	{
+		//worker index of the current thread in the pool that owns it
+		thread_local const Q3ThreadPool* t_workerPool  = nullptr;
+		thread_local int				 t_workerIndex = -1;
+	}
+
+	Q3ThreadPool::Q3ThreadPool(int numThreads)
+		: m_numQueued(0)
+		, m_nextQueue(0)
+		, m_numPending(0)
+		, m_quit(false)
+	{
+		if (numThreads <= 0)
+			numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+		for (int i = 0; i < numThreads; ++i)
+			m_queues.push_back(std::make_unique<WorkQueue>());
+		for (int i = 0; i < numThreads; ++i)
+			m_workers.emplace_back(&Q3ThreadPool::workerMain, this, i);
+	}
+
+	Q3ThreadPool::~Q3ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_taskReady.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	Q3ThreadPool& Q3ThreadPool::Global()
+	{
+		static Q3ThreadPool pool;
+		return pool;
+	}
+
+	void Q3ThreadPool::enqueue(Task task)
+	{
+		//workers keep their own tasks close, other threads spread them out
+		auto index = (t_workerPool == this) ? t_workerIndex : static_cast<int>(m_nextQueue++ % m_queues.size());
+		{
+			//counted before it can be run, so waitIdle never sees a finished task that wasn't pending
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_numPending++;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_queues[index]->m_mutex);
+			m_queues[index]->m_tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_numQueued++;
+		}
+		m_taskReady.notify_one();
+	}
+
+	void Q3ThreadPool::waitIdle()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_numPending == 0; });
+	}
+
+	bool Q3ThreadPool::runPendingTask()
+	{
+		Task task;
+		if (!popTask(t_workerPool == this ? t_workerIndex : 0, task))
+			return false;
+		runTask(task);
+		return true;
+	}
+
+	void Q3ThreadPool::parallelFor(std::size_t count, std::size_t grainSize, const RangeTask& task)
+	{
+		if (count == 0)
+			return;
+		grainSize = std::max<std::size_t>(1, grainSize);
+		const auto numChunks = (count + grainSize - 1) / grainSize;
+		if (numChunks == 1)
+		{
+			task(0, count);
+			return;
+		}
+
+		//helpers that start late find no chunks left, so the state has to outlive this call
+		struct ForState
+		{
+			std::atomic<std::size_t>	m_nextChunk{ 0 };
+			std::size_t					m_chunksDone = 0;
+			std::mutex					m_mutex;
+			std::condition_variable		m_done;
+		};
+		auto state = std::make_shared<ForState>();
+		auto runChunks = [state, numChunks, count, grainSize, &task]()
+		{
+			std::size_t numRun = 0;
+			for (auto chunk = state->m_nextChunk++; chunk < numChunks; chunk = state->m_nextChunk++, ++numRun)
+			{
+				auto begin = chunk * grainSize;
+				task(begin, std::min(count, begin + grainSize));
+			}
+			if (numRun == 0)
+				return;
+			std::lock_guard<std::mutex> lock(state->m_mutex);
+			state->m_chunksDone += numRun;
+			if (state->m_chunksDone == numChunks)
+				state->m_done.notify_all();
+		};
+
+		//'task' is only referenced while chunks remain, which can't outlive this call
+		auto numHelpers = std::min(numChunks - 1, m_workers.size());
+		for (std::size_t i = 0; i < numHelpers; ++i)
+			enqueue(runChunks);
+		runChunks();
+
+		std::unique_lock<std::mutex> lock(state->m_mutex);
+		state->m_done.wait(lock, [&state, numChunks]() { return state->m_chunksDone == numChunks; });
+	}
+
+	void Q3ThreadPool::parallelInvoke(const std::vector<Task>& tasks)
+	{
+		parallelFor(tasks.size(), 1, [&tasks](std::size_t begin, std::size_t end)
+		{
+			for (auto i = begin; i < end; ++i)
+				tasks[i]();
+		});
+	}
+
+	bool Q3ThreadPool::popTask(int index, Task& task)
+	{
+		const auto numQueues = static_cast<int>(m_queues.size());
+		//newest task of our own queue first, it's likely to touch what we just worked on
+		{
+			auto& queue = *m_queues[index];
+			std::lock_guard<std::mutex> lock(queue.m_mutex);
+			if (!queue.m_tasks.empty())
+			{
+				task = std::move(queue.m_tasks.back());
+				queue.m_tasks.pop_back();
+				m_numQueued--;
+				return true;
+			}
+		}
+		//steal the oldest task of another queue
+		for (int i = 1; i < numQueues; ++i)
+		{
+			auto& queue = *m_queues[(index + i) % numQueues];
+			std::lock_guard<std::mutex> lock(queue.m_mutex);
+			if (!queue.m_tasks.empty())
+			{
+				task = std::move(queue.m_tasks.front());
+				queue.m_tasks.pop_front();
+				m_numQueued--;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Q3ThreadPool::runTask(Task& task)
+	{
+		task();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_numPending--;
+		if (m_numPending == 0)
+			m_idle.notify_all();
+	}
+
+	void Q3ThreadPool::workerMain(int index)
+	{
+		t_workerPool  = this;
+		t_workerIndex = index;
+		for (;;)
+		{
+			Task task;
+			if (popTask(index, task))
+			{
+				runTask(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_taskReady.wait(lock, [this]() { return m_quit || m_numQueued > 0; });
+			if (m_quit && m_numQueued == 0)
+				return;
+		}
+	}
+}
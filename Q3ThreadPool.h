@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace Misc
+{
+	/*
+		@brief: Fixed size work-stealing pool used by the map loader. Every worker has its own queue,
+		tasks queued from a worker go to the back of its queue & are run from there first, idle workers
+		steal from the front of the other queues
+	*/
+	class Q3ThreadPool
+	{
+	public:
+		using Task		= std::function<void()>;
+		using RangeTask = std::function<void(std::size_t begin, std::size_t end)>;
+
+		explicit Q3ThreadPool( int numThreads = 0 );
+		~Q3ThreadPool();
+
+		Q3ThreadPool( const Q3ThreadPool& ) = delete;
+		Q3ThreadPool& operator = ( const Q3ThreadPool& ) = delete;
+
+		/*
+			@brief: Process wide pool, sized to the hardware concurrency
+		*/
+		static Q3ThreadPool&		Global();
+
+		/*
+			@brief: Queue a task, it will run on one of the worker threads
+		*/
+		void						enqueue( Task task );
+
+		/*
+			@brief: Block until all queued & running tasks are done
+		*/
+		void						waitIdle();
+
+		/*
+			@brief: Run one queued task on the calling thread if there is one, lets a thread that
+			waits on pool work help out instead of blocking a worker's progress
+		*/
+		bool						runPendingTask();
+
+		/*
+			@brief: Split [0, count) in chunks of at most 'grainSize' & run 'task' on them in parallel.
+			The calling thread helps out & returns when all chunks are done, safe to call from a task
+		*/
+		void						parallelFor( std::size_t count, std::size_t grainSize, const RangeTask& task );
+
+		/*
+			@brief: Run independent tasks in parallel, returns when all of them are done
+		*/
+		void						parallelInvoke( const std::vector<Task>& tasks );
+
+		int							numThreads() const { return static_cast<int>(m_workers.size()); }
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex				m_mutex;
+			std::deque<Task>		m_tasks;
+		};
+
+		void						workerMain( int index );
+		bool						popTask( int index, Task& task );
+		void						runTask( Task& task );
+
+		std::vector<std::thread>	m_workers;
+		std::vector<std::unique_ptr<WorkQueue>> m_queues;	//one per worker
+		std::atomic<int>			m_numQueued;			//tasks in the queues
+		std::atomic<unsigned>		m_nextQueue;			//round robin for tasks from other threads
+		std::mutex					m_mutex;
+		std::condition_variable		m_taskReady;
+		std::condition_variable		m_idle;
+		int							m_numPending;			//queued + running
+		bool						m_quit;
+	};
+}
@@ -0,0 +1,128 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <Misc/Q3VertexFormat.h>
+
+namespace Misc
+{
+	namespace
+	{
+		const float		MIN_POSITION_STEP	= 1.0f / 64.0f;
+		const float		MAX_UNORM16			= 65535.0f;
+
+		std::uint16_t ToUnorm16(float value)
+		{
+			return static_cast<std::uint16_t>(std::min(std::max(std::floor(value * MAX_UNORM16 + 0.5f), 0.0f), MAX_UNORM16));
+		}
+	}
+
+	std::uint16_t FloatToHalf(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		const std::uint32_t sign	 = (bits >> 16) & 0x8000u;
+		const std::uint32_t absBits	 = bits & 0x7fffffffu;
+		if (absBits >= 0x7f800000u) //inf & nan
+			return static_cast<std::uint16_t>(sign | 0x7c00u | (absBits > 0x7f800000u ? 0x200u : 0u));
+		if (absBits >= 0x477ff000u) //rounds past the largest half
+			return static_cast<std::uint16_t>(sign | 0x7c00u);
+		if (absBits < 0x38800000u) //denormal half, rounded through the float unit
+		{
+			float absValue;
+			std::memcpy(&absValue, &absBits, sizeof(absValue));
+			return static_cast<std::uint16_t>(sign | static_cast<std::uint32_t>(std::nearbyint(absValue * 16777216.0f)));
+		}
+		//rebias the exponent & round the mantissa to nearest even
+		std::uint32_t half = (absBits - 0x38000000u) >> 13;
+		const std::uint32_t rest = absBits & 0x1fffu;
+		if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+			half++;
+		return static_cast<std::uint16_t>(sign | half);
+	}
+
+	float HalfToFloat(std::uint16_t value)
+	{
+		const float sign	 = (value & 0x8000u) ? -1.0f : 1.0f;
+		const int exponent	 = (value >> 10) & 0x1f;
+		const int mantissa	 = value & 0x3ff;
+		if (exponent == 0)
+			return sign * std::ldexp(static_cast<float>(mantissa), -24);
+		if (exponent == 31)
+			return mantissa ? std::nanf("") : sign * INFINITY;
+		return sign * std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+	}
+
+	Q3VertexDecode ComputePositionDecode(const Math::Vector3f& boundsMin, const Math::Vector3f& boundsMax)
+	{
+		//grow the step until the bounds fit from their aligned offset
+		Q3VertexDecode result;
+		auto step = MIN_POSITION_STEP;
+		float offset[3];
+		for (;;)
+		{
+			auto fits = true;
+			for (int k = 0; k < 3; ++k)
+			{
+				offset[k] = std::floor(boundsMin[k] / step) * step;
+				fits &= (boundsMax[k] - offset[k]) / step <= MAX_UNORM16;
+			}
+			if (fits)
+				break;
+			step *= 2.0f;
+		}
+		result.m_posOffset = Math::Vector3f(offset[0], offset[1], offset[2]);
+		result.m_posScale  = step * MAX_UNORM16;	//the attribute is normalized
+		return result;
+	}
+
+	Q3VertexDecode ComputeVertexDecode(const Q3VertexDecode& positions, const App::MeshVertex* vertices, std::size_t numVertices)
+	{
+		auto result = positions;
+		if (numVertices == 0)
+			return result;
+
+		float stMin[2], stMax[2];
+		for (int k = 0; k < 2; ++k)
+			stMin[k] = stMax[k] = vertices[0].m_stCoord[k];
+		for (std::size_t i = 1; i < numVertices; ++i)
+		{
+			for (int k = 0; k < 2; ++k)
+			{
+				stMin[k] = std::min(stMin[k], vertices[i].m_stCoord[k]);
+				stMax[k] = std::max(stMax[k], vertices[i].m_stCoord[k]);
+			}
+		}
+
+		//half floats are most precise around 0, whole repeats keep the texture in place
+		result.m_stOffset = Math::Vector2f(std::floor((stMin[0] + stMax[0]) * 0.5f + 0.5f), std::floor((stMin[1] + stMax[1]) * 0.5f + 0.5f));
+		return result;
+	}
+
+	void EncodeCompactVertices(const App::MeshVertex* vertices, std::size_t numVertices, const Q3VertexDecode& decode,
+		Q3CompactVertex* result, Q3CompactError& error)
+	{
+		const auto step = decode.m_posScale / MAX_UNORM16;
+		for (std::size_t i = 0; i < numVertices; ++i)
+		{
+			const auto& vert = vertices[i];
+			auto& compact	 = result[i];
+			for (int k = 0; k < 3; ++k)
+			{
+				compact.m_position[k] = ToUnorm16((vert.m_worldCoord[k] - decode.m_posOffset[k]) / decode.m_posScale);
+				auto decoded = decode.m_posOffset[k] + compact.m_position[k] * step;
+				error.m_position = std::max(error.m_position, std::fabs(decoded - vert.m_worldCoord[k]));
+			}
+			compact.m_position[3] = 0;
+			for (int k = 0; k < 2; ++k)
+			{
+				compact.m_stCoord[k] = FloatToHalf(vert.m_stCoord[k] - decode.m_stOffset[k]);
+				compact.m_uvCoord[k] = ToUnorm16(vert.m_uvCoord[k]);
+				error.m_st = std::max(error.m_st, std::fabs(decode.m_stOffset[k] + HalfToFloat(compact.m_stCoord[k]) - vert.m_stCoord[k]));
+				error.m_uv = std::max(error.m_uv, std::fabs(compact.m_uvCoord[k] / MAX_UNORM16 - vert.m_uvCoord[k]));
+			}
+			for (int k = 0; k < 4; ++k)
+				compact.m_vertexColor[k] = vert.m_vertexColor[k];
+			std::memcpy(compact.m_normalTangent, &vert.m_normalTangent, sizeof(compact.m_normalTangent));
+		}
+	}
+}
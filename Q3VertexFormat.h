@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <Graphics/MeshVertex.h>
+
+namespace Misc
+{
+	/*
+		@brief: Compact vertex layout of r_compactVertices, 24 bytes instead of 36. Positions are 16 bit steps
+		on one grid per map, st half floats relative to a per batch st offset, lightmap uv 16 bit unorm
+	*/
+	struct Q3CompactVertex
+	{
+		std::uint16_t				m_position[4];		//w unused
+		std::uint8_t				m_vertexColor[4];
+		std::uint16_t				m_stCoord[2];		//half floats
+		std::uint16_t				m_uvCoord[2];		//lightmap atlas
+		std::uint8_t				m_normalTangent[4];
+	};
+	static_assert(sizeof(Q3CompactVertex) == 24, "Compact vertex layout mismatch");
+
+	using CompactVertexList = std::vector<Q3CompactVertex>;
+
+	/*
+		@brief: Turns a compact vertex of a batch back into world space, world = offset + position * scale &
+		st = offset + st. The identity for the float layout
+	*/
+	struct Q3VertexDecode
+	{
+		Math::Vector3f				m_posOffset = Math::Vector3f(0.0f, 0.0f, 0.0f);
+		float						m_posScale	= 1.0f;
+		Math::Vector2f				m_stOffset	= Math::Vector2f(0.0f, 0.0f);
+	};
+
+	/*
+		@brief: Largest difference between the float vertices & the decoded compact ones
+	*/
+	struct Q3CompactError
+	{
+		float						m_position = 0.0f;		//world units
+		float						m_st	   = 0.0f;		//texture repeats
+		float						m_uv	   = 0.0f;		//lightmap atlas
+	};
+
+	/*
+		@brief: Position grid covering 'boundsMin' to 'boundsMax'. The step is the smallest power of two that
+		fits( at least 1/64 ), the offset a multiple of it. Batches on the same grid quantize a shared position
+		the same & don't crack, the largest error is half a step
+	*/
+	Q3VertexDecode	ComputePositionDecode( const Math::Vector3f& boundsMin, const Math::Vector3f& boundsMax );
+
+	/*
+		@brief: Decode parameters for a batch of 'vertices' on the grid of 'positions', the st offset is the
+		whole repeat closest to the center of the batch
+	*/
+	Q3VertexDecode	ComputeVertexDecode( const Q3VertexDecode& positions, const App::MeshVertex* vertices, std::size_t numVertices );
+
+	/*
+		@brief: Encode a batch with its 'decode', 'error' keeps the largest error seen
+	*/
+	void			EncodeCompactVertices( const App::MeshVertex* vertices, std::size_t numVertices, const Q3VertexDecode& decode,
+						Q3CompactVertex* result, Q3CompactError& error );
+
+	std::uint16_t	FloatToHalf( float value );
+	float			HalfToFloat( std::uint16_t value );
+}
@@ -0,0 +1,66 @@
+#include <cmath>
+#include <algorithm>
+#include <Misc/Q3VertexWeld.h>
+
+namespace Misc
+{
+	Q3VertexWelder::Q3VertexWelder(float epsilon, std::size_t expected)
+		: m_epsilonSqr(epsilon * epsilon)
+		, m_invCellSize(epsilon > 0.0f ? 1.0f / epsilon : 1.0f)
+		, m_reach(epsilon > 0.0f ? 1 : 0)
+	{
+		m_entries.reserve(expected);
+		m_cells.reserve(expected);
+	}
+
+	void Q3VertexWelder::clear()
+	{
+		m_entries.clear();
+		m_cells.clear();
+	}
+
+	std::uint64_t Q3VertexWelder::cellKey(int x, int y, int z) const
+	{
+		//21 bits per axis, cells that wrap onto each other only cost extra distance tests
+		const std::uint64_t mask = (1ull << 21) - 1;
+		return (static_cast<std::uint64_t>(x) & mask) | ((static_cast<std::uint64_t>(y) & mask) << 21) | ((static_cast<std::uint64_t>(z) & mask) << 42);
+	}
+
+	int Q3VertexWelder::cellCoord(float value) const
+	{
+		return static_cast<int>(std::floor(value * m_invCellSize));
+	}
+
+	void SmoothWeldedNormals(const std::vector<App::MeshVertex*>& vertices, const std::vector<int>& shaderIds, float epsilon, float creaseCos)
+	{
+		struct Group
+		{
+			Math::Vector3f	m_first;	//normal of the vertex that opened the group
+			Math::Vector3f	m_sum;
+			int				m_shaderId;
+		};
+		Q3VertexWelder welder(epsilon, vertices.size());
+		std::vector<int> groups(vertices.size());
+		std::vector<Group> normals;
+		for (std::size_t i = 0; i < vertices.size(); ++i)
+		{
+			const auto normal	= vertices[i]->getNormal();
+			const auto shaderId = shaderIds[i];
+			auto group = welder.weld(vertices[i]->m_worldCoord, static_cast<int>(normals.size()), [&](int id)
+			{
+				return normals[id].m_shaderId == shaderId && normals[id].m_first.dot(normal) >= creaseCos;
+			});
+			if (group == static_cast<int>(normals.size()))
+				normals.push_back({ normal, Math::Vector3f(0.0f, 0.0f, 0.0f), shaderId });
+			normals[group].m_sum += normal;
+			groups[i] = group;
+		}
+		for (std::size_t i = 0; i < vertices.size(); ++i)
+		{
+			const auto& sum = normals[groups[i]].m_sum;
+			//opposing normals cancel out, normalizing what is left would give NaN
+			if (sum.lengthSquared() > 1e-6f)
+				vertices[i]->setNormal(sum.getNormalized());
+		}
+	}
+}
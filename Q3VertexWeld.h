@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <Math/AABB.h>
+#include <Graphics/MeshVertex.h>
+
+namespace Misc
+{
+	/*
+		@brief: Groups positions that lie within 'epsilon' of each other, in O(n). Positions are hashed into
+		cells 'epsilon' wide, a query only looks at the 27 cells around it. An epsilon of 0 welds exact
+		positions only & looks at a single cell
+	*/
+	class Q3VertexWelder
+	{
+	public:
+		explicit Q3VertexWelder( float epsilon, std::size_t expected = 0 );
+
+		/*
+			@brief: Id of the first position added within epsilon of 'position' for which 'matches'( id ) holds.
+			When there is none 'position' is added as 'newId', which is returned
+		*/
+		template<typename Match>
+		int							weld( const Math::Vector3f& position, int newId, Match&& matches );
+		int							weld( const Math::Vector3f& position, int newId )
+		{
+			return weld( position, newId, [](int) { return true; } );
+		}
+
+		void						clear();
+		std::size_t					size() const { return m_entries.size(); }
+
+	private:
+		struct Entry
+		{
+			Math::Vector3f			m_position;
+			int						m_id;
+			int						m_next;		//next entry in the same cell, -1 ends it
+		};
+
+		std::uint64_t				cellKey( int x, int y, int z ) const;
+		int							cellCoord( float value ) const;
+
+		float						m_epsilonSqr;
+		float						m_invCellSize;
+		int							m_reach;	//neighbour cells looked at per axis
+		std::vector<Entry>			m_entries;
+		std::unordered_map<std::uint64_t, int>	m_cells;	//first entry of each cell
+	};
+
+	template<typename Match>
+	int Q3VertexWelder::weld(const Math::Vector3f& position, int newId, Match&& matches)
+	{
+		const int x = cellCoord(position[0]);
+		const int y = cellCoord(position[1]);
+		const int z = cellCoord(position[2]);
+		//oldest match wins, so every position of a group welds to the same id
+		int result = -1;
+		std::size_t resultEntry = m_entries.size();
+		for (int dz = -m_reach; dz <= m_reach; ++dz)
+		for (int dy = -m_reach; dy <= m_reach; ++dy)
+		for (int dx = -m_reach; dx <= m_reach; ++dx)
+		{
+			auto it = m_cells.find(cellKey(x + dx, y + dy, z + dz));
+			if (it == std::end(m_cells))
+				continue;
+			for (auto i = it->second; i != -1; i = m_entries[i].m_next)
+			{
+				const auto& entry = m_entries[i];
+				if (static_cast<std::size_t>(i) < resultEntry && entry.m_position.distanceSquared(position) <= m_epsilonSqr && matches(entry.m_id))
+				{
+					result		= entry.m_id;
+					resultEntry = i;
+				}
+			}
+		}
+		if (result != -1)
+			return result;
+
+		auto& head = m_cells.emplace(cellKey(x, y, z), -1).first->second;
+		m_entries.push_back({ position, newId, head });
+		head = static_cast<int>(m_entries.size() - 1);
+		return newId;
+	}
+
+	/*
+		@brief: Distance within which patch vertices share their normal
+	*/
+	static const float PATCH_WELD_EPSILON = 0.0354f;
+
+	/*
+		@brief: Cosine of the largest angle between normals that are still smoothed across a seam, 60 degrees
+	*/
+	static const float PATCH_CREASE_COS = 0.5f;
+
+	/*
+		@brief: Every vertex gets the normalized sum of the normals of the 'vertices' welded to it. Vertices
+		only weld when they share their 'shaderIds' entry & their normal is within the crease angle of the
+		first normal of the group. A sum that cancels out keeps the original normal
+	*/
+	void			SmoothWeldedNormals( const std::vector<App::MeshVertex*>& vertices, const std::vector<int>& shaderIds,
+										 float epsilon = PATCH_WELD_EPSILON, float creaseCos = PATCH_CREASE_COS );
+}